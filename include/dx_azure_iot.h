@@ -27,6 +27,7 @@
 #include <stdlib.h>
 #include <time.h>
 #include "iothub_client_core_common.h"
+#include <iothub_client_ll.h>
 
 #ifndef IOT_HUB_POLL_TIME_SECONDS
 #define IOT_HUB_POLL_TIME_SECONDS 0
@@ -117,9 +118,24 @@ void dx_azureRegisterDeviceTwinCallback(void (*deviceTwinCallbackHandler)(DEVICE
                                                                           void *userContextCallback));
 
 /// <summary>
-/// Register Direct Method callback to process an Azure IoT direct method message
+/// Register the device twin module's connection change handler. It is called before the callbacks
+/// registered with dx_azureRegisterConnectionChangedNotification and does not take one of their slots.
+/// </summary>
+/// <param name="connectionStatusCallback"></param>
+void dx_azureRegisterDeviceTwinConnectionCallback(void (*connectionStatusCallback)(bool connected));
+
+/// <summary>
+/// Register Direct Method callback to process an Azure IoT direct method message. The handler must answer
+/// methodId with IoTHubClient_LL_DeviceMethodResponse, it may do so after returning.
 /// </summary>
 /// <param name="directMethodCallbackHandler"></param>
 void dx_azureRegisterDirectMethodCallback(int (*directMethodCallbackHandler)(const char *method_name, const unsigned char *payload,
-                                                                             size_t payloadSize, unsigned char **responsePayload,
-                                                                             size_t *responsePayloadSize, void *userContextCallback));
\ No newline at end of file
+                                                                             size_t payloadSize, METHOD_HANDLE methodId,
+                                                                             void *userContextCallback));
+
+/// <summary>
+/// Register the direct method module's connection change handler. It is called before the callbacks
+/// registered with dx_azureRegisterConnectionChangedNotification and does not take one of their slots.
+/// </summary>
+/// <param name="connectionStatusCallback"></param>
+void dx_azureRegisterDirectMethodConnectionCallback(void (*connectionStatusCallback)(bool connected));
\ No newline at end of file
@@ -7,6 +7,7 @@
 #include "parson.h"
 #include "dx_gpio.h"
 #include <iothub_device_client_ll.h>
+#include <stddef.h>
 
 typedef enum {
 	DX_TYPE_UNKNOWN = 0,
@@ -14,17 +15,33 @@ typedef enum {
 	DX_DEVICE_TWIN_FLOAT = 2,
 	DX_DEVICE_TWIN_DOUBLE = 3,
 	DX_DEVICE_TWIN_INT = 4,
-	DX_DEVICE_TWIN_STRING = 5
+	DX_DEVICE_TWIN_STRING = 5,
+	DX_DEVICE_TWIN_JSON = 6
 } DX_DEVICE_TWIN_TYPE;
 
+typedef struct {
+	double deadbandAbsolute;	// numeric types, drop reports closer than this to the last reported value
+	double deadbandRelative;	// numeric types, drop reports closer than this fraction of the last reported value
+	int minIntervalMs;			// hold back reports sent sooner than this, the latest value is sent when it expires
+	bool onlyIfChanged;			// drop reports equal to the last reported value
+} DX_DEVICE_TWIN_REPORT_OPTIONS;
+
 typedef struct _deviceTwinBinding {
 	const char* propertyName;
+	const char* componentName;		// IoT Plug and Play component, NULL for a root property
 	void* propertyValue;
 	int propertyVersion;
 	bool propertyUpdated;
 	DX_DEVICE_TWIN_TYPE twinType;
 	void (*handler)(struct _deviceTwinBinding* deviceTwinBinding);
 	void *context;
+	// DX_DEVICE_TWIN_JSON only, valid for the duration of the handler call. Sub-paths (dot notation,
+	// [n] for array items, "" for the whole value) that changed against the previously applied value.
+	const char **changedPaths;
+	size_t changedPathCount;
+	// Options applied by dx_deviceTwinReportValue, acknowledgements are always sent
+	DX_DEVICE_TWIN_REPORT_OPTIONS reportOptions;
+	struct _deviceTwinReportState *reportState;
 } DX_DEVICE_TWIN_BINDING;
 
 typedef enum
@@ -36,6 +53,31 @@ typedef enum
 
 //typedef struct _deviceTwinBinding DX_DEVICE_TWIN_BINDING;
 
+typedef struct {
+	const char* propertyName;
+	DX_DEVICE_TWIN_TYPE twinType;	// BOOL, FLOAT, DOUBLE, INT or STRING (a char array member of size bytes)
+	size_t offset;
+	size_t size;
+	bool updated;					// set for fields changed by the patch being handled
+} DX_DEVICE_TWIN_GROUP_FIELD;
+
+#define DX_DEVICE_TWIN_GROUP_FIELD_INIT(structType, member, name, type)                                             \
+	{                                                                                                               \
+		.propertyName = name, .twinType = type, .offset = offsetof(structType, member),                            \
+		.size = sizeof(((structType *)0)->member)                                                                   \
+	}
+
+typedef struct _deviceTwinGroupBinding {
+	const char* groupName;
+	void* groupValue;				// application struct the fields are applied to
+	size_t groupSize;
+	DX_DEVICE_TWIN_GROUP_FIELD* fields;
+	size_t fieldCount;
+	int propertyVersion;
+	void (*handler)(struct _deviceTwinGroupBinding* deviceTwinGroupBinding);
+	void *context;
+} DX_DEVICE_TWIN_GROUP_BINDING;
+
 /// <summary>
 /// IoT Plug and Play acknowledge receipt of a device twin message with new state and status code.
 /// </summary>
@@ -47,7 +89,8 @@ bool dx_deviceTwinAckDesiredValue(DX_DEVICE_TWIN_BINDING* deviceTwinBinding, voi
 
 
 /// <summary>
-/// Update device twin state.
+/// Update device twin state. For DX_DEVICE_TWIN_JSON bindings state is a JSON_Value*.
+/// Reports are filtered by the binding's reportOptions, a dropped or held back report returns true.
 /// </summary>
 /// <param name="deviceTwinBinding"></param>
 /// <param name="state"></param>
@@ -66,3 +109,35 @@ void dx_deviceTwinUnsubscribe(void);
 /// <param name="deviceTwins"></param>
 /// <param name="deviceTwinCount"></param>
 void dx_deviceTwinSubscribe(DX_DEVICE_TWIN_BINDING* deviceTwins[], size_t deviceTwinCount);
+
+/// <summary>
+/// Request the full device twin from IoT Hub. The desired properties are applied to the bindings as a complete
+/// update and the document is cached, see dx_deviceTwinGetSnapshot. Calls made while a request is outstanding
+/// are served by that request.
+/// </summary>
+/// <returns>true if a request was sent or is outstanding</returns>
+bool dx_deviceTwinRefresh(void);
+
+/// <summary>
+/// The twin document (desired and reported) from the last completed dx_deviceTwinRefresh, NULL if none.
+/// Owned by the library and valid until the next refresh completes or dx_deviceTwinUnsubscribe.
+/// </summary>
+/// <param name="snapshotTimeMs">optional, receives the dx_getNowMilliseconds time the snapshot was taken</param>
+/// <returns></returns>
+const JSON_Value* dx_deviceTwinGetSnapshot(int64_t* snapshotTimeMs);
+
+/// <summary>
+/// Open device twin groups. All fields of a group changed by a desired patch are applied to groupValue
+/// together and the group handler is called once per patch.
+/// </summary>
+/// <param name="deviceTwinGroups"></param>
+/// <param name="deviceTwinGroupCount"></param>
+void dx_deviceTwinGroupSubscribe(DX_DEVICE_TWIN_GROUP_BINDING* deviceTwinGroups[], size_t deviceTwinGroupCount);
+
+/// <summary>
+/// IoT Plug and Play acknowledge the fields updated by the last patch in a single reported state update.
+/// </summary>
+/// <param name="deviceTwinGroupBinding"></param>
+/// <param name="statusCode"></param>
+/// <returns></returns>
+bool dx_deviceTwinGroupAckDesiredValue(DX_DEVICE_TWIN_GROUP_BINDING* deviceTwinGroupBinding, DX_DEVICE_TWIN_RESPONSE_CODE statusCode);
@@ -9,14 +9,45 @@
 typedef enum 
 {
 	DX_METHOD_SUCCEEDED = 200,
+	DX_METHOD_PENDING = 202,	// asyncHandler only, the response is sent later with dx_directMethodResponse
 	DX_METHOD_FAILED = 500,
-	DX_METHOD_NOT_FOUND = 404
+	DX_METHOD_NOT_FOUND = 404,
+	DX_METHOD_TIMEOUT = 504
 } DX_DIRECT_METHOD_RESPONSE_CODE;
 
+// Identifies a pending asynchronous method call, stale once the call is answered or timed out
+typedef uint32_t DX_DIRECT_METHOD_TOKEN;
+
+// Asynchronous calls that can be pending at the same time, further calls are answered DX_METHOD_FAILED
+#define DX_DIRECT_METHOD_MAX_PENDING 8
+// Used when timeoutSeconds is not set, matches the IoT Hub default method response timeout
+#define DX_DIRECT_METHOD_DEFAULT_TIMEOUT_SECONDS 30
+
+// The json passed to a handler is only valid for the duration of the handler call, an asyncHandler that
+// returns DX_METHOD_PENDING must copy what it needs to complete the call later.
 typedef struct _directMethodBinding {
 	const char* methodName;
+	const char* componentName;	// IoT Plug and Play component, invoked as "componentName*methodName". NULL for a root command
 	DX_DIRECT_METHOD_RESPONSE_CODE(*handler)(JSON_Value* json, struct _directMethodBinding* peripheral, char** responseMsg);
+	// Used instead of handler when set. The handler writes the response payload, typically an object, to the writer,
+	// the default message for the response code is sent if no complete value is written.
+	DX_DIRECT_METHOD_RESPONSE_CODE(*jsonHandler)(JSON_Value* json, struct _directMethodBinding* peripheral, JSON_Writer* response);
+	// Used instead of handler when set. Returning DX_METHOD_PENDING defers the response to dx_directMethodResponse,
+	// the call is answered DX_METHOD_TIMEOUT if no response is given within timeoutSeconds.
+	DX_DIRECT_METHOD_RESPONSE_CODE(*asyncHandler)(JSON_Value* json, struct _directMethodBinding* peripheral,
+		DX_DIRECT_METHOD_TOKEN token, char** responseMsg);
+	int timeoutSeconds;
+	void *context;
 } DX_DIRECT_METHOD_BINDING;
 
 void dx_directMethodUnsubscribe(void);
 void dx_directMethodSubscribe(DX_DIRECT_METHOD_BINDING* directMethods[], size_t directMethodCount);
+
+/// <summary>
+/// Complete a direct method call an asyncHandler returned DX_METHOD_PENDING for.
+/// </summary>
+/// <param name="token">token passed to the asyncHandler</param>
+/// <param name="responseCode"></param>
+/// <param name="responseMsg">optional, copied</param>
+/// <returns>false if the call was already answered or timed out</returns>
+bool dx_directMethodResponse(DX_DIRECT_METHOD_TOKEN token, DX_DIRECT_METHOD_RESPONSE_CODE responseCode, const char* responseMsg);
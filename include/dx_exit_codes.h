@@ -53,5 +53,8 @@ typedef enum {
 	DX_ExitCode_Uart_Open_Failed = 215,
 	DX_ExitCode_Uart_Read_Failed = 214,
 	DX_ExitCode_Uart_Write_Failed = 213,
-	DX_ExitCode_UartHandler = 212
+	DX_ExitCode_UartHandler = 212,
+
+	DX_ExitCode_OpenDirectMethod = 210,
+	DX_ExitCode_OpenJob = 209
 } ExitCode;
\ No newline at end of file
@@ -0,0 +1,97 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include "dx_device_twins.h"
+#include "dx_direct_methods.h"
+#include "dx_timer.h"
+
+// Jobs that can run at the same time across all job bindings, further start calls are answered DX_METHOD_FAILED
+#define DX_JOB_MAX_RUNNING 4
+// Finished jobs kept in the reported property of a job binding, older ones are removed from the twin
+#define DX_JOB_REPORT_HISTORY 4
+// Used when sliceIntervalMs is not set
+#define DX_JOB_DEFAULT_SLICE_INTERVAL_MS 10
+
+typedef enum {
+	DX_JOB_RUNNING = 0,
+	DX_JOB_SUCCEEDED = 1,
+	DX_JOB_FAILED = 2,
+	DX_JOB_CANCELLED = 3
+} DX_JOB_STATE;
+
+typedef enum {
+	DX_JOB_STEP_CONTINUE = 0,
+	DX_JOB_STEP_DONE = 1,
+	DX_JOB_STEP_FAILED = 2
+} DX_JOB_STEP_RESULT;
+
+typedef struct _job {
+	uint32_t jobId;
+	struct _jobBinding* binding;
+	DX_JOB_STATE state;
+	int progress;				// percent complete, set by the step handler
+	JSON_Value* result;			// optional, set by the step handler and reported when the job ends, owned by the library
+	void* context;				// per job application state, set by the start handler and released by the cleanup handler
+	int reportedProgress;
+	int64_t nextSliceMs;
+	bool inUse;
+} DX_JOB;
+
+typedef struct _jobBinding {
+	const char* jobName;
+	// Called with the start method payload, valid for the duration of the call. Returning false rejects the job.
+	bool (*startHandler)(struct _job* job, JSON_Value* parameters);
+	// Runs one slice of the job on the event loop, keep each slice short
+	DX_JOB_STEP_RESULT (*stepHandler)(struct _job* job);
+	// optional, called once when the job succeeds, fails, is cancelled or is rejected by startHandler
+	void (*cleanupHandler)(struct _job* job);
+	// DX_DEVICE_TWIN_JSON binding reported as {"<jobId>":{"name":..,"state":..,"progress":..,"result":..}},
+	// its reportOptions throttle progress reports
+	DX_DEVICE_TWIN_BINDING* reportBinding;
+	int maxRunning;				// jobs of this binding that can run at the same time, 0 for 1
+	int sliceIntervalMs;		// delay between slices of a job
+	int runningCount;
+	JSON_Value* report;
+} DX_JOB_BINDING;
+
+/// <summary>
+/// Direct method binding that starts a job, the response message is the job id.
+/// </summary>
+#define DX_JOB_START_METHOD_INIT(name, jobBinding)                                                                    \
+	{                                                                                                               \
+		.methodName = name, .handler = dx_jobStartMethodHandler, .context = &jobBinding                            \
+	}
+
+/// <summary>
+/// Direct method binding that cancels the job named by the payload {"jobId":id}.
+/// </summary>
+#define DX_JOB_CANCEL_METHOD_INIT(name)                                                                               \
+	{                                                                                                               \
+		.methodName = name, .handler = dx_jobCancelMethodHandler                                                    \
+	}
+
+/// <summary>
+/// Open job bindings. Jobs are started and cancelled through direct methods bound with DX_JOB_START_METHOD_INIT
+/// and DX_JOB_CANCEL_METHOD_INIT.
+/// </summary>
+/// <param name="jobs"></param>
+/// <param name="jobCount"></param>
+void dx_jobSubscribe(DX_JOB_BINDING* jobs[], size_t jobCount);
+
+/// <summary>
+/// Cancel running jobs and release the job bindings.
+/// </summary>
+/// <param name=""></param>
+void dx_jobUnsubscribe(void);
+
+/// <summary>
+/// Cancel a running job, its cleanupHandler is called and the cancellation reported.
+/// </summary>
+/// <param name="jobId"></param>
+/// <returns>false if no job with this id is running</returns>
+bool dx_jobCancel(uint32_t jobId);
+
+DX_DIRECT_METHOD_RESPONSE_CODE dx_jobStartMethodHandler(JSON_Value* json, DX_DIRECT_METHOD_BINDING* directMethodBinding, char** responseMsg);
+DX_DIRECT_METHOD_RESPONSE_CODE dx_jobCancelMethodHandler(JSON_Value* json, DX_DIRECT_METHOD_BINDING* directMethodBinding, char** responseMsg);
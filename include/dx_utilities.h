@@ -11,6 +11,7 @@
 #include <math.h>
 #include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -22,6 +23,23 @@
 #define IN_RANGE(number, low, high) (low <= number && high >= number)
 #define NULL_OR_EMPTY(string) (string == NULL || strlen(string) == 0)
 
+typedef struct {
+	const char* name;	// NULL for an empty slot
+	size_t nameLen;
+	uint32_t hash;
+	void* value;
+} DX_NAME_INDEX_ENTRY;
+
+/// <summary>
+/// Open addressing hash index from names to values, sized once for a known number of names.
+/// Names are not copied and must outlive the index.
+/// </summary>
+typedef struct {
+	DX_NAME_INDEX_ENTRY* entries;
+	size_t capacity;
+	size_t count;
+} DX_NAME_INDEX;
+
 bool dx_isDeviceAuthReady(void);
 bool dx_isNetworkConnected(const char *networkInterface);
 bool dx_isNetworkReady(void);
@@ -41,4 +59,40 @@ char *dx_getCurrentUtc(char *buffer, size_t bufferSize);
 int dx_stringEndsWith(const char *str, const char *suffix);
 int64_t dx_getNowMilliseconds(void);
 void dx_Log_Debug(char *fmt, ...);
-void dx_Log_Debug_Init(const char *buffer, size_t buffer_size);
\ No newline at end of file
+void dx_Log_Debug_Init(const char *buffer, size_t buffer_size);
+
+/// <summary>
+/// FNV-1a hash of a name, used by DX_NAME_INDEX
+/// </summary>
+/// <param name="name"></param>
+/// <param name="nameLen"></param>
+/// <returns></returns>
+uint32_t dx_nameHash(const char *name, size_t nameLen);
+
+/// <summary>
+/// Allocate an empty index for up to maxEntries names
+/// </summary>
+/// <param name="index"></param>
+/// <param name="maxEntries"></param>
+/// <returns></returns>
+bool dx_nameIndexInit(DX_NAME_INDEX *index, size_t maxEntries);
+
+/// <summary>
+/// Add a name, returns false if the name is already present or the index is full
+/// </summary>
+/// <param name="index"></param>
+/// <param name="name"></param>
+/// <param name="value"></param>
+/// <returns></returns>
+bool dx_nameIndexAdd(DX_NAME_INDEX *index, const char *name, void *value);
+
+/// <summary>
+/// Find a name that is not necessarily null terminated, returns NULL if not found
+/// </summary>
+/// <param name="index"></param>
+/// <param name="name"></param>
+/// <param name="nameLen"></param>
+/// <returns></returns>
+void *dx_nameIndexFind(const DX_NAME_INDEX *index, const char *name, size_t nameLen);
+
+void dx_nameIndexFree(DX_NAME_INDEX *index);
@@ -41,6 +41,7 @@ extern "C" {
 typedef struct json_object_t JSON_Object;
 typedef struct json_array_t JSON_Array;
 typedef struct json_value_t JSON_Value;
+typedef struct json_path_t JSON_Path;
 
 enum json_value_type {
     JSONError = -1,
@@ -56,6 +57,14 @@ typedef int JSON_Value_Type;
 enum json_result_t { JSONSuccess = 0, JSONFailure = -1 };
 typedef int JSON_Status;
 
+enum json_filter_result_t { JSONFilterSkip = 0, JSONFilterKeep = 1, JSONFilterDescend = 2 };
+
+/* Selects object members while parsing. name is the raw key (not null terminated, escape sequences
+   unprocessed), depth is 0 for members of the root object. Returns JSONFilterSkip to drop the member
+   without building it, JSONFilterKeep to parse it, or JSONFilterDescend to apply the filter to the
+   members of an object value. */
+typedef int (*JSON_Member_Filter)(const char *name, size_t name_len, size_t depth, void *context);
+
 typedef void *(*JSON_Malloc_Function)(size_t);
 typedef void (*JSON_Free_Function)(void *);
 
@@ -66,15 +75,74 @@ void json_set_allocation_functions(JSON_Malloc_Function malloc_fun, JSON_Free_Fu
 /*  Parses first JSON value in a string, returns NULL in case of error */
 JSON_Value *json_parse_string(const char *string);
 
+/*  Parses first JSON value in the first length bytes of buffer, which need not be null terminated and
+    is never read past length. Returns NULL in case of error */
+JSON_Value *json_parse_buffer(const char *buffer, size_t length);
+
+/*  Parses first JSON value in a string keeping only the object members selected by filter,
+    skipped members are validated but not allocated. Returns NULL in case of error */
+JSON_Value *json_parse_string_filtered(const char *string, JSON_Member_Filter filter, void *context);
+JSON_Value *json_parse_buffer_filtered(const char *buffer, size_t length, JSON_Member_Filter filter,
+                                       void *context); /* bounded as json_parse_buffer */
+
+/*  Parses first JSON value in a string allocating the whole document from an arena of a few large
+    blocks, json_value_free on the returned root releases it at once. Values of the document must not
+    be used after the root is freed. Values and names added to the document later are heap allocated
+    and freed with it. Returns NULL in case of error */
+JSON_Value *json_parse_string_arena(const char *string);
+JSON_Value *json_parse_buffer_arena(const char *buffer, size_t length); /* bounded as json_parse_buffer */
+
+/*  Parses like json_parse_string_arena, but unescapes names and strings in place inside string instead
+    of copying them, the document's names and strings point into it. string is modified even when
+    parsing fails and must outlive the returned root. Returns NULL in case of error */
+JSON_Value *json_parse_string_insitu(char *string);
+
 /*  Parses first JSON value in a string and ignores comments (/ * * / and //),
     returns NULL in case of error */
 JSON_Value *json_parse_string_with_comments(const char *string);
 
-/* Serialization */
+/* Event parsing
+   Reads the first JSON value in string (length bytes, need not be null terminated) and reports it to
+   the handler as it goes, without building a tree or allocating. Callbacks left NULL are skipped, one
+   returning JSONFailure stops the parse. Keys and strings are passed with their length and are not
+   null terminated: those without escape sequences point into string, others are unescaped into
+   scratch and are valid until the callback returns. An escaped string longer than scratch_size, or a
+   number longer than 63 characters that does not fit scratch, fails the parse; scratch may be NULL.
+   Returns JSONFailure on a syntax error or when a callback stops the parse. */
+typedef struct json_sax_handler_t {
+    JSON_Status (*begin_object)(void *context);
+    JSON_Status (*end_object)(void *context);
+    JSON_Status (*begin_array)(void *context);
+    JSON_Status (*end_array)(void *context);
+    JSON_Status (*key)(const char *name, size_t name_len, void *context);
+    JSON_Status (*string)(const char *string, size_t string_len, void *context);
+    JSON_Status (*number)(double number, void *context);
+    JSON_Status (*boolean)(int boolean, void *context);
+    JSON_Status (*null)(void *context);
+} JSON_Sax_Handler;
+
+JSON_Status json_sax_parse(const char *string, size_t length, const JSON_Sax_Handler *handler,
+                           void *context, char *scratch, size_t scratch_size);
+
+/*  Checks that string (length bytes, need not be null terminated) holds exactly one JSON value and
+    nothing but whitespace around it, in a single pass without allocating. Names and strings must be
+    valid UTF-8 with valid escape sequences, and containers nest at most 2048 deep. Numbers are only
+    checked against the JSON grammar, so ones a double can't hold pass. A byte order mark fails. */
+JSON_Status json_validate_syntax(const char *string, size_t length);
+
+/* Serialization
+   Values are written in a single pass: json_serialize_to_string grows its buffer as it goes and the
+   buffer functions write straight into buf, so sizing first is not needed. When buf is too small
+   json_serialize_to_buffer fails with buf holding a truncated, null terminated prefix. */
 size_t json_serialization_size(const JSON_Value *value); /* returns 0 on fail */
 JSON_Status json_serialize_to_buffer(const JSON_Value *value, char *buf, size_t buf_size_in_bytes);
 char *json_serialize_to_string(const JSON_Value *value);
 
+/* Like snprintf, returns the length of the whole serialization without the null character: if it is
+   buf_size_in_bytes or more the output was truncated and length + 1 bytes are needed. buf may be NULL
+   when buf_size_in_bytes is 0. Returns -1 if value cannot be serialized. */
+int json_serialize_to_buffer_n(const JSON_Value *value, char *buf, size_t buf_size_in_bytes);
+
 /* Pretty serialization */
 size_t json_serialization_size_pretty(const JSON_Value *value); /* returns 0 on fail */
 JSON_Status json_serialize_to_buffer_pretty(const JSON_Value *value, char *buf,
@@ -84,6 +152,63 @@ char *json_serialize_to_string_pretty(const JSON_Value *value);
 void json_free_serialized_string(char *string); /* frees string from json_serialize_to_string and
                                                    json_serialize_to_string_pretty */
 
+/* Number formatting
+   Writes the shortest text that reads back to the same number, as the serializers do: 0.1 is written
+   as 0.1, integers below 2^53 as plain digits. json_format_float is shortest for single precision.
+   buf needs JSON_NUMBER_BUF_SIZE chars. Returns the length written before the null terminator, or -1
+   for NaN and infinities, which have no JSON form. */
+#define JSON_NUMBER_BUF_SIZE 32
+
+int json_format_number(double number, char *buf);
+int json_format_float(float number, char *buf);
+
+/* Streaming writer
+   Writes a single JSON value into a growable or caller supplied buffer without building a JSON_Value
+   tree. Strings are escaped as by the serializer. Errors (out of memory or space, a value where a key is
+   expected, nesting deeper than JSON_WRITER_MAX_DEPTH, non finite numbers) are sticky, later calls fail
+   until reset. */
+#define JSON_WRITER_MAX_DEPTH 32
+
+typedef struct json_writer_t {
+    char *buffer;
+    size_t length;
+    size_t capacity;
+    size_t depth;
+    unsigned char levels[JSON_WRITER_MAX_DEPTH]; /* state flags of each open object or array */
+    int failed;
+    int fixed; /* buffer belongs to the caller and never grows */
+} JSON_Writer;
+
+void json_writer_init(JSON_Writer *writer); /* does not allocate, the buffer grows on first write */
+
+/* Writes into buf, which must outlive the writer. Output that does not fit in size bytes, null
+   character included, fails the writer and leaves buf holding the part written before. */
+void json_writer_init_buffer(JSON_Writer *writer, char *buf, size_t size);
+
+void json_writer_reset(JSON_Writer *writer); /* discards the output and keeps the buffer for reuse */
+void json_writer_free(JSON_Writer *writer);
+
+JSON_Status json_writer_begin_object(JSON_Writer *writer);
+JSON_Status json_writer_end_object(JSON_Writer *writer);
+JSON_Status json_writer_begin_array(JSON_Writer *writer);
+JSON_Status json_writer_end_array(JSON_Writer *writer);
+JSON_Status json_writer_key(JSON_Writer *writer, const char *name); /* object member name, next call writes its value */
+JSON_Status json_writer_string(JSON_Writer *writer, const char *string);
+JSON_Status json_writer_string_len(JSON_Writer *writer, const char *string, size_t len); /* may contain '\0' */
+JSON_Status json_writer_number(JSON_Writer *writer, double number);
+JSON_Status json_writer_float(JSON_Writer *writer, float number); /* shortest single precision text, 0.1f as 0.1 */
+JSON_Status json_writer_boolean(JSON_Writer *writer, int boolean);
+JSON_Status json_writer_null(JSON_Writer *writer);
+JSON_Status json_writer_value(JSON_Writer *writer, const JSON_Value *value); /* serializes an existing value */
+
+/* Returns the null terminated output once a complete value has been written without error, otherwise
+   NULL. Owned by the writer and valid until the next write, reset or free. */
+const char *json_writer_get_string(const JSON_Writer *writer, size_t *length);
+
+/* Like json_writer_get_string, but hands the buffer to the caller who frees it with
+   json_free_serialized_string. The writer is left empty. Returns NULL for a writer on a caller's buffer. */
+char *json_writer_detach(JSON_Writer *writer, size_t *length);
+
 /* Comparing */
 int json_value_equals(const JSON_Value *a, const JSON_Value *b);
 
@@ -122,6 +247,24 @@ double json_object_dotget_number(const JSON_Object *object,
 int json_object_dotget_boolean(const JSON_Object *object,
                                const char *name); /* returns -1 on fail */
 
+/* Compiled paths
+   A path looked up on every message can be compiled once, its segments are split and their names
+   hashed up front. json_path_compile takes dot notation and resolves exactly like the dotget
+   functions. json_path_compile_pointer takes an RFC 6901 JSON Pointer ("/d/meta/dtg", "" for the
+   value itself), whose names may contain dots, with "~1" standing for "/" and "~0" for "~"; its
+   segments also index arrays ("/items/0"). Both return NULL on a malformed path or when out of
+   memory, free the result with json_path_free. The getters return like the dotget functions. */
+JSON_Path *json_path_compile(const char *path);
+JSON_Path *json_path_compile_pointer(const char *pointer);
+void json_path_free(JSON_Path *path);
+
+JSON_Value *json_path_get_value(const JSON_Value *value, const JSON_Path *path);
+const char *json_path_get_string(const JSON_Value *value, const JSON_Path *path);
+JSON_Object *json_path_get_object(const JSON_Value *value, const JSON_Path *path);
+JSON_Array *json_path_get_array(const JSON_Value *value, const JSON_Path *path);
+double json_path_get_number(const JSON_Value *value, const JSON_Path *path); /* returns 0 on fail */
+int json_path_get_boolean(const JSON_Value *value, const JSON_Path *path);   /* returns -1 on fail */
+
 /* Functions to get available names */
 size_t json_object_get_count(const JSON_Object *object);
 const char *json_object_get_name(const JSON_Object *object, size_t index);
@@ -38,6 +38,23 @@ static void AvnetSendHelloTelemetry(void);
 static IOTHUBMESSAGE_DISPOSITION_RESULT ReceiveMessageCallback(IOTHUB_MESSAGE_HANDLE, void *);
 static const char *ErrorCodeToString(int iotConnectErrorCode);
 
+// Fields of the IoTConnect hello response collected while the C2D message is parsed
+typedef enum { AVT_FIELD_NONE, AVT_FIELD_D, AVT_FIELD_EC, AVT_FIELD_SID, AVT_FIELD_META, AVT_FIELD_DTG } AVT_HELLO_FIELD;
+
+typedef struct {
+    int depth;            // containers open around the next event
+    bool inD;             // inside the root "d" object
+    bool inMeta;          // inside "d"."meta"
+    AVT_HELLO_FIELD field; // member whose value comes next
+    bool hasD;
+    bool hasEc;
+    int ec;
+    bool hasSid;
+    char sid[DX_AVNET_IOT_CONNECT_SID_LEN + 1];
+    bool hasDtg;
+    char dtg[DX_AVNET_IOT_CONNECT_GUID_LEN + 1];
+} AVT_HELLO_RESPONSE;
+
 static DX_TIMER_BINDING monitorAvnetConnectionTimer = {.name = "monitorAvnetConnectionTimer", .handler = MonitorAvnetConnectionHandler};
 
 static void AvnetReconnectCallback(bool connected) {
@@ -92,6 +109,131 @@ static void MonitorAvnetConnectionHandler(EventLoopTimer *timer)
     }
 }
 
+static JSON_Status HelloBeginObject(void *context)
+{
+    AVT_HELLO_RESPONSE *response = (AVT_HELLO_RESPONSE *)context;
+
+    if (response->depth == 1 && response->field == AVT_FIELD_D) {
+        response->inD = response->hasD = true;
+    } else if (response->depth == 2 && response->inD && response->field == AVT_FIELD_META) {
+        response->inMeta = true;
+    }
+
+    response->depth++;
+    response->field = AVT_FIELD_NONE;
+    return JSONSuccess;
+}
+
+static JSON_Status HelloEndObject(void *context)
+{
+    AVT_HELLO_RESPONSE *response = (AVT_HELLO_RESPONSE *)context;
+
+    response->depth--;
+    if (response->depth == 1) {
+        response->inD = false;
+    } else if (response->depth == 2) {
+        response->inMeta = false;
+    }
+    return JSONSuccess;
+}
+
+static JSON_Status HelloBeginArray(void *context)
+{
+    AVT_HELLO_RESPONSE *response = (AVT_HELLO_RESPONSE *)context;
+
+    response->depth++;
+    response->field = AVT_FIELD_NONE;
+    return JSONSuccess;
+}
+
+static JSON_Status HelloEndArray(void *context)
+{
+    ((AVT_HELLO_RESPONSE *)context)->depth--;
+    return JSONSuccess;
+}
+
+static bool KeyEquals(const char *name, size_t nameLen, const char *key)
+{
+    return nameLen == strlen(key) && memcmp(name, key, nameLen) == 0;
+}
+
+static JSON_Status HelloKey(const char *name, size_t nameLen, void *context)
+{
+    AVT_HELLO_RESPONSE *response = (AVT_HELLO_RESPONSE *)context;
+
+    response->field = AVT_FIELD_NONE;
+
+    if (response->depth == 1 && KeyEquals(name, nameLen, "d")) {
+        response->field = AVT_FIELD_D;
+    } else if (response->depth == 2 && response->inD) {
+        if (KeyEquals(name, nameLen, "ec")) {
+            response->field = AVT_FIELD_EC;
+        } else if (KeyEquals(name, nameLen, "sid")) {
+            response->field = AVT_FIELD_SID;
+        } else if (KeyEquals(name, nameLen, "meta")) {
+            response->field = AVT_FIELD_META;
+        }
+    } else if (response->depth == 3 && response->inMeta && KeyEquals(name, nameLen, "dtg")) {
+        response->field = AVT_FIELD_DTG;
+    }
+    return JSONSuccess;
+}
+
+static JSON_Status HelloString(const char *string, size_t stringLen, void *context)
+{
+    AVT_HELLO_RESPONSE *response = (AVT_HELLO_RESPONSE *)context;
+
+    if (response->field == AVT_FIELD_SID) {
+        stringLen = stringLen < DX_AVNET_IOT_CONNECT_SID_LEN ? stringLen : DX_AVNET_IOT_CONNECT_SID_LEN;
+        memcpy(response->sid, string, stringLen);
+        response->sid[stringLen] = '\0';
+        response->hasSid = true;
+    } else if (response->field == AVT_FIELD_DTG) {
+        stringLen = stringLen < DX_AVNET_IOT_CONNECT_GUID_LEN ? stringLen : DX_AVNET_IOT_CONNECT_GUID_LEN;
+        memcpy(response->dtg, string, stringLen);
+        response->dtg[stringLen] = '\0';
+        response->hasDtg = true;
+    }
+
+    response->field = AVT_FIELD_NONE;
+    return JSONSuccess;
+}
+
+static JSON_Status HelloNumber(double number, void *context)
+{
+    AVT_HELLO_RESPONSE *response = (AVT_HELLO_RESPONSE *)context;
+
+    if (response->field == AVT_FIELD_EC) {
+        response->ec = (int)number;
+        response->hasEc = true;
+    }
+
+    response->field = AVT_FIELD_NONE;
+    return JSONSuccess;
+}
+
+static JSON_Status HelloScalar(void *context)
+{
+    ((AVT_HELLO_RESPONSE *)context)->field = AVT_FIELD_NONE;
+    return JSONSuccess;
+}
+
+static JSON_Status HelloBoolean(int boolean, void *context)
+{
+    (void)boolean;
+    return HelloScalar(context);
+}
+
+static const JSON_Sax_Handler helloResponseHandler = {.begin_object = HelloBeginObject,
+                                                      .end_object = HelloEndObject,
+                                                      .begin_array = HelloBeginArray,
+                                                      .end_array = HelloEndArray,
+                                                      .key = HelloKey,
+                                                      .string = HelloString,
+                                                      .number = HelloNumber,
+                                                      .boolean = HelloBoolean,
+                                                      .null = HelloScalar};
+
 /// <summary>
 ///     Callback function invoked when a C2D message is received from IoT Hub.
 /// </summary>
@@ -104,9 +246,6 @@ static IOTHUBMESSAGE_DISPOSITION_RESULT ReceiveMessageCallback(IOTHUB_MESSAGE_HA
 {
     Log_Debug("[AVT IoTConnect] Received C2D message\n");
 
-    // Use a flag to track if we rx the dtg value
-    bool dtgFlag = false;
-
     const unsigned char *buffer = NULL;
     size_t size = 0;
     if (IoTHubMessage_GetByteArray(message, &buffer, &size) != IOTHUB_MESSAGE_OK) {
@@ -114,17 +253,7 @@ static IOTHUBMESSAGE_DISPOSITION_RESULT ReceiveMessageCallback(IOTHUB_MESSAGE_HA
         return IOTHUBMESSAGE_REJECTED;
     }
 
-    // 'buffer' is not null terminated, make a copy and null terminate it.
-    unsigned char *str_msg = (unsigned char *)malloc(size + 1);
-    if (str_msg == NULL) {
-        Log_Debug("[AVT IoTConnect] Could not allocate buffer for incoming message\n");
-        abort();
-    }
-
-    memcpy(str_msg, buffer, size);
-    str_msg[size] = '\0';
-
-    Log_Debug("[AVT IoTConnect] Received message '%s' from IoT Hub\n", str_msg);
+    Log_Debug("[AVT IoTConnect] Received message '%.*s' from IoT Hub\n", (int)size, buffer);
 
     // Process the message.  We're expecting a specific JSON structure from IoT Connect
     //{
@@ -150,50 +279,55 @@ static IOTHUBMESSAGE_DISPOSITION_RESULT ReceiveMessageCallback(IOTHUB_MESSAGE_HA
     //    }
     //}
     //
-    // The code below will drill into the structure and pull out each piece of data and store it
-    // into variables
+    // The message is parsed in place without building a JSON tree, the handlers above pick out
+    // d.ec, d.sid and d.meta.dtg. They are only applied once the whole message has parsed.
+    AVT_HELLO_RESPONSE response = {0};
+    char stackScratch[DX_AVNET_IOT_CONNECT_METADATA];
+    JSON_Status parseStatus;
+
+    // Escaped strings are unescaped into scratch, no string is longer than the message itself
+    char *scratch = size <= sizeof(stackScratch) ? stackScratch : (char *)malloc(size);
+    if (scratch == NULL) {
+        Log_Debug("[AVT IoTConnect] ERROR: not enough memory to parse the C2D message.\n");
+        return IOTHUBMESSAGE_ABANDONED;
+    }
 
-    // Using the mesage string get a pointer to the rootMessage
-    JSON_Value *rootMessage = NULL;
-    rootMessage = json_parse_string(str_msg);
-    if (rootMessage == NULL) {
-        Log_Debug("[AVT IoTConnect] Cannot parse the string as JSON content.\n");
-        goto cleanup;
+    parseStatus = json_sax_parse((const char *)buffer, size, &helloResponseHandler, &response, scratch, size);
+
+    if (scratch != stackScratch) {
+        free(scratch);
     }
 
-    // Using the rootMessage pointer get a pointer to the rootObject
-    JSON_Object *rootObject = json_value_get_object(rootMessage);
+    if (parseStatus != JSONSuccess) {
+        Log_Debug("[AVT IoTConnect] Cannot parse the string as JSON content.\n");
+        return IOTHUBMESSAGE_ACCEPTED;
+    }
 
-    // Using the root object get a pointer to the d object
-    JSON_Object *dProperties = json_object_dotget_object(rootObject, "d");
-    if (dProperties != NULL) {
+    if (response.hasD) {
 
         // The d properties should have a "ec" (error code) key
-        if (json_object_has_value(dProperties, "ec") != 0) {
-            int ec = (int)json_object_dotget_number(dProperties, "ec");
-            Log_Debug("[AVT IoTConnect] ec: %s\n", ErrorCodeToString(ec));
+        if (response.hasEc) {
+            Log_Debug("[AVT IoTConnect] ec: %s\n", ErrorCodeToString(response.ec));
         }
 
         // The d properties should have a "sid" key
-        if (json_object_has_value(dProperties, "sid") != 0) {
-            strncpy(sidString, (char *)json_object_get_string(dProperties, "sid"), DX_AVNET_IOT_CONNECT_SID_LEN);
+        if (response.hasSid) {
+            size_t sidLength = strnlen(response.sid, DX_AVNET_IOT_CONNECT_SID_LEN);
+            memcpy(sidString, response.sid, sidLength);
+            sidString[sidLength] = '\0';
             Log_Debug("[AVT IoTConnect] sid: %s\n", sidString);
         }
 
-        // The object should contain a "meta" object
-        JSON_Object *metaProperties = json_object_dotget_object(dProperties, "meta");
-        if (metaProperties != NULL) {
-
-            // The meta object should have a "dtg" key
-            if (json_object_has_value(metaProperties, "dtg") != 0) {
-                strncpy(dtgGUID, (char *)json_object_get_string(metaProperties, "dtg"), DX_AVNET_IOT_CONNECT_GUID_LEN);
-                dtgFlag = true;
-                Log_Debug("[AVT IoTConnect] dtg: %s\n", dtgGUID);
-            }
+        // The meta object should have a "dtg" key
+        if (response.hasDtg) {
+            size_t dtgLength = strnlen(response.dtg, DX_AVNET_IOT_CONNECT_GUID_LEN);
+            memcpy(dtgGUID, response.dtg, dtgLength);
+            dtgGUID[dtgLength] = '\0';
+            Log_Debug("[AVT IoTConnect] dtg: %s\n", dtgGUID);
         }
 
         // Check to see if we received all the required data we need to interact with IoTConnect
-        if (dtgFlag) {
+        if (response.hasDtg) {
 
             // Verify that the new dtg is a valid GUID, if not then we just received an empty dtg.
             if (DX_AVNET_IOT_CONNECT_GUID_LEN == strnlen(dtgGUID, DX_AVNET_IOT_CONNECT_GUID_LEN + 1)) {
@@ -211,11 +345,6 @@ static IOTHUBMESSAGE_DISPOSITION_RESULT ReceiveMessageCallback(IOTHUB_MESSAGE_HA
         }
     }
 
-cleanup:
-    // Release the allocated memory.
-    json_value_free(rootMessage);
-    free(str_msg);
-
     return IOTHUBMESSAGE_ACCEPTED;
 }
 
@@ -223,22 +352,25 @@ static void AvnetSendHelloTelemetry(void)
 {
 
     // Send the IoT Connect hello message to inform the platform that we're on-line!
-    JSON_Value *rootValue = json_value_init_object();
-    JSON_Object *rootObject = json_value_get_object(rootValue);
-
-    json_object_dotset_number(rootObject, "mt", 200);
-    json_object_dotset_number(rootObject, "v", 2.0F);
+    char helloMessage[32];
+    size_t helloMessageLength = 0;
+    JSON_Writer writer;
 
-    char *serializedTelemetryUpload = json_serialize_to_string(rootValue);
+    json_writer_init_buffer(&writer, helloMessage, sizeof(helloMessage));
+    json_writer_begin_object(&writer);
+    json_writer_key(&writer, "mt");
+    json_writer_number(&writer, 200);
+    json_writer_key(&writer, "v");
+    json_writer_number(&writer, 2);
+    json_writer_end_object(&writer);
 
-    if (!dx_azurePublish(serializedTelemetryUpload, strnlen(serializedTelemetryUpload, 64), NULL, 0, NULL)) {
+    if (json_writer_get_string(&writer, &helloMessageLength) == NULL ||
+        !dx_azurePublish(helloMessage, helloMessageLength, NULL, 0, NULL)) {
 
         Log_Debug("[AVT IoTConnect] IoTCHello message send error: %s\n", "error");
     }
 
-    Log_Debug("[AVT IoTConnect] TX: %s\n", serializedTelemetryUpload);
-    json_free_serialized_string(serializedTelemetryUpload);
-    json_value_free(rootValue);
+    Log_Debug("[AVT IoTConnect] TX: %s\n", helloMessage);
 }
 
 
@@ -249,11 +381,10 @@ bool dx_avnetJsonSerializePayload(const char *originalJsonMessage, char *modifie
 {
 
     bool result = false;
+    size_t originalJsonMessageLength = originalJsonMessage != NULL ? strlen(originalJsonMessage) : 0;
 
-    // Verify that the incomming JSON is valid
-    JSON_Value *rootProperties = NULL;
-    rootProperties = json_parse_string(originalJsonMessage);
-    if (rootProperties != NULL) {
+    // Verify that the incomming JSON is valid, without building a tree only to free it again
+    if (originalJsonMessage != NULL && json_validate_syntax(originalJsonMessage, originalJsonMessageLength) == JSONSuccess) {
 
         // Define the Json string format for sending telemetry to IoT Connect, note that the
         // actual telemetry data is inserted as the last string argument
@@ -261,7 +392,7 @@ bool dx_avnetJsonSerializePayload(const char *originalJsonMessage, char *modifie
 
         // Determine the largest message size needed.  We'll use this to validate the incoming target
         // buffer is large enough
-        size_t maxModifiedMessageSize = strlen(originalJsonMessage) + DX_AVNET_IOT_CONNECT_METADATA;
+        size_t maxModifiedMessageSize = originalJsonMessageLength + DX_AVNET_IOT_CONNECT_METADATA;
 
         // Verify that the passed in buffer is large enough for the modified message
         if (maxModifiedMessageSize > modifiedBufferSize) {
@@ -269,13 +400,12 @@ bool dx_avnetJsonSerializePayload(const char *originalJsonMessage, char *modifie
                 "\n[AVT IoTConnect] "
                 "ERROR: dx_avnetJsonSerializePayload() modified buffer size can't hold modified "
                 "message\n");
-            Log_Debug("                 Original message size: %d\n", strlen(originalJsonMessage));
+            Log_Debug("                 Original message size: %zu\n", originalJsonMessageLength);
             Log_Debug("Additional IoTConnect message overhead: %d\n", DX_AVNET_IOT_CONNECT_METADATA);
-            Log_Debug("           Required target buffer size: %d\n", maxModifiedMessageSize);
-            Log_Debug("            Actual target buffersize: %d\n\n", modifiedBufferSize);
+            Log_Debug("           Required target buffer size: %zu\n", maxModifiedMessageSize);
+            Log_Debug("            Actual target buffersize: %zu\n\n", modifiedBufferSize);
 
-            result = false;
-            goto cleanup;
+            return false;
         }
 
         // Build up the IoTC message and insert the telemetry JSON
@@ -287,53 +417,40 @@ bool dx_avnetJsonSerializePayload(const char *originalJsonMessage, char *modifie
         Log_Debug("[AVT IoTConnect] ERROR: dx_avnetJsonSerializePayload was passed invalid JSON\n");
     }
 
-cleanup:
-    // Release the allocated memory.
-    json_value_free(rootProperties);
-
     return result;
 }
 
 bool dx_avnetJsonSerialize(char *jsonMessageBuffer, size_t bufferSize, int key_value_pair_count, ...)
 {
-    bool result = false;
-    char *serializedJson = NULL;
+    bool result = true;
     char *keyString = NULL;
     int dataType;
-
-    // Prepare the JSON object for the telemetry data
-    JSON_Value *root_value = json_value_init_object();
-    JSON_Object *root_object = json_value_get_object(root_value);
-
-    // Create a Json_Array
-    JSON_Value *myArrayValue = json_value_init_array();
-    JSON_Array *myArray = json_value_get_array(myArrayValue);
-
-    // Prepare the JSON object for the telemetry data
-    JSON_Value *array_value_object = json_value_init_object();
-    JSON_Object *array_object = json_value_get_object(array_value_object);
-
-    // Allocate a buffer that we used to dynamically create the list key names d.<keyname>
-    char *keyBuffer = (char *)malloc(DX_AVNET_IOT_CONNECT_JSON_BUFFER_SIZE);
-    if (keyBuffer == NULL) {
-        Log_Debug("[AVT IoTConnect] ERROR: not enough memory to send telemetry.");
-        return false;
+    JSON_Writer writer;
+
+    // We need to format the data as shown below, it is written straight into the caller's buffer
+    // "{\"sid\":\"%s\",\"dtg\":\"%s\",\"mt\": 0,\"d\":[{\"d\":<new telemetry "key": value pairs>}]}";
+    json_writer_init_buffer(&writer, jsonMessageBuffer, bufferSize);
+    json_writer_begin_object(&writer);
+    json_writer_key(&writer, "sid");
+    json_writer_string(&writer, sidString);
+    json_writer_key(&writer, "dtg");
+    json_writer_string(&writer, dtgGUID);
+    json_writer_key(&writer, "mt");
+    json_writer_number(&writer, 0);
+    json_writer_key(&writer, "d");
+    json_writer_begin_array(&writer);
+    json_writer_begin_object(&writer);
+    if (key_value_pair_count > 0) {
+        json_writer_key(&writer, "d");
+        json_writer_begin_object(&writer);
     }
 
-    // We need to format the data as shown below
-    // "{\"sid\":\"%s\",\"dtg\":\"%s\",\"mt\": 0,\"dt\": \"%s\",\"d\":[{\"d\":<new telemetry "key": value pairs>}]}";
-
-    serializedJson = NULL;
-    json_object_dotset_string(root_object, "sid", sidString);
-    json_object_dotset_string(root_object, "dtg", dtgGUID);
-    json_object_dotset_number(root_object, "mt", 0);
-
     // Prepare the argument list
     va_list inputList;
     va_start(inputList, key_value_pair_count);
 
     // Consume the data in the argument list and build out the json
-    while (key_value_pair_count--) {
+    for (int i = 0; i < key_value_pair_count && result; i++) {
 
         // Pull the data type from the list
         dataType = va_arg(inputList, int);
@@ -341,51 +458,52 @@ bool dx_avnetJsonSerialize(char *jsonMessageBuffer, size_t bufferSize, int key_v
         // Pull the current "key"
         keyString = va_arg(inputList, char *);
 
-        // "d.<newKey>: <value>"
-        snprintf(keyBuffer, DX_AVNET_IOT_CONNECT_JSON_BUFFER_SIZE, "d.%s", keyString);
+        // "<newKey>: <value>"
         switch (dataType) {
 
             // report current device twin data as reported properties to IoTHub
         case DX_JSON_BOOL:
-            json_object_dotset_boolean(array_object, keyBuffer, va_arg(inputList, int));
+            json_writer_key(&writer, keyString);
+            json_writer_boolean(&writer, va_arg(inputList, int));
             break;
         case DX_JSON_FLOAT:
+            // Promoted to double by the variadic call, written with single precision digits
+            json_writer_key(&writer, keyString);
+            json_writer_float(&writer, (float)va_arg(inputList, double));
+            break;
         case DX_JSON_DOUBLE:
-            json_object_dotset_number(array_object, keyBuffer, va_arg(inputList, double));
+            json_writer_key(&writer, keyString);
+            json_writer_number(&writer, va_arg(inputList, double));
             break;
         case DX_JSON_INT:
-            json_object_dotset_number(array_object, keyBuffer, va_arg(inputList, int));
+            json_writer_key(&writer, keyString);
+            json_writer_number(&writer, va_arg(inputList, int));
             break;
         case DX_JSON_STRING:
-            json_object_dotset_string(array_object, keyBuffer, va_arg(inputList, char *));
+            json_writer_key(&writer, keyString);
+            json_writer_string(&writer, va_arg(inputList, char *));
             break;
         default:
             result = false;
-            goto cleanup;
+            break;
         }
     }
 
     // Clean up the argument list
     va_end(inputList);
 
-    // Add the telemetry data to the Json
-    json_array_append_value(myArray, array_value_object);
-    json_object_dotset_value(root_object, "d", myArrayValue);
-
-    // Serialize the structure
-    serializedJson = json_serialize_to_string(root_value);
-
-    // Copy the new JSON into the buffer the calling routine passed in
-    if (strlen(serializedJson) < bufferSize) {
-        strncpy(jsonMessageBuffer, serializedJson, bufferSize);
-        result = true;
+    if (key_value_pair_count > 0) {
+        json_writer_end_object(&writer);
+    }
+    json_writer_end_object(&writer);
+    json_writer_end_array(&writer);
+    json_writer_end_object(&writer);
+
+    // Any write that did not fit in the buffer fails the writer
+    result = result && json_writer_get_string(&writer, NULL) != NULL;
+    if (!result && bufferSize > 0) {
+        jsonMessageBuffer[0] = '\0';
     }
-
-cleanup:
-    // Clean up
-    json_free_serialized_string(serializedJson);
-    json_value_free(root_value);
-    free(keyBuffer);
 
     return result;
 }
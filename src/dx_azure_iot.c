@@ -27,9 +27,12 @@ static void (*_deviceTwinCallbackHandler)(DEVICE_TWIN_UPDATE_STATE updateState,
                                           void *userContextCallback);
 
 static int (*_directMethodCallbackHandler)(const char *method_name, const unsigned char *payload, size_t payloadSize,
-                                           unsigned char **responsePayload, size_t *responsePayloadSize, void *userContextCallback);
+                                           METHOD_HANDLE methodId, void *userContextCallback);
 
 static void (*_connectionStatusCallback[MAX_CONNECTION_STATUS_CALLBACKS])(bool connected);
+// Library modules are told about connection changes first, without taking an application slot
+static void (*_deviceTwinConnectionCallback)(bool connected);
+static void (*_directMethodConnectionCallback)(bool connected);
 
 MU_DEFINE_ENUM_STRINGS_WITHOUT_INVALID(PROV_DEVICE_RESULT, PROV_DEVICE_RESULT_VALUE);
 MU_DEFINE_ENUM_STRINGS_WITHOUT_INVALID(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_RESULT_VALUE);
@@ -78,12 +81,22 @@ void dx_azureRegisterDeviceTwinCallback(void (*deviceTwinCallbackHandler)(DEVICE
 }
 
 void dx_azureRegisterDirectMethodCallback(int (*directMethodCallbackHandler)(const char *method_name, const unsigned char *payload,
-                                                                             size_t payloadSize, unsigned char **responsePayload,
-                                                                             size_t *responsePayloadSize, void *userContextCallback))
+                                                                             size_t payloadSize, METHOD_HANDLE methodId,
+                                                                             void *userContextCallback))
 {
     _directMethodCallbackHandler = directMethodCallbackHandler;
 }
 
+void dx_azureRegisterDeviceTwinConnectionCallback(void (*connectionStatusCallback)(bool connected))
+{
+    _deviceTwinConnectionCallback = connectionStatusCallback;
+}
+
+void dx_azureRegisterDirectMethodConnectionCallback(void (*connectionStatusCallback)(bool connected))
+{
+    _directMethodConnectionCallback = connectionStatusCallback;
+}
+
 void dx_azureRegisterMessageReceivedNotification(IOTHUBMESSAGE_DISPOSITION_RESULT (*messageReceivedCallback)(IOTHUB_MESSAGE_HANDLE message,
                                                                                                              void *context))
 {
@@ -193,6 +206,14 @@ static void ProcessConnectionStatusCallbacks(bool connection_state) {
     if (connection_state != previous_connection_state) {
         previous_connection_state = connection_state;
 
+        if (_deviceTwinConnectionCallback != NULL) {
+            _deviceTwinConnectionCallback(connection_state);
+        }
+
+        if (_directMethodConnectionCallback != NULL) {
+            _directMethodConnectionCallback(connection_state);
+        }
+
         for (size_t i = 0; i < MAX_CONNECTION_STATUS_CALLBACKS; i++) {
             if (_connectionStatusCallback[i] != NULL) {
                 _connectionStatusCallback[i](connection_state);
@@ -364,14 +385,22 @@ static void HubDeviceTwinCallback(DEVICE_TWIN_UPDATE_STATE updateState, const un
     }
 }
 
+/// <summary>
+///     Inbound direct method callback, the registered handler responds with IoTHubClient_LL_DeviceMethodResponse
+///     either before returning or later from the event loop
+/// </summary>
 static int HubDirectMethodCallback(const char *method_name, const unsigned char *payload, size_t payloadSize,
-                                   unsigned char **responsePayload, size_t *responsePayloadSize, void *userContextCallback)
+                                   METHOD_HANDLE methodId, void *userContextCallback)
 {
+    static const char methodNotFoundResponse[] = "\"Method not found\"";
+
     if (_directMethodCallbackHandler != NULL) {
-        return _directMethodCallbackHandler(method_name, payload, payloadSize, responsePayload, responsePayloadSize, userContextCallback);
-    } else {
-        return -1;
+        return _directMethodCallbackHandler(method_name, payload, payloadSize, methodId, userContextCallback);
     }
+
+    IoTHubClient_LL_DeviceMethodResponse(iothubClientHandle, methodId, (const unsigned char *)methodNotFoundResponse,
+                                         sizeof(methodNotFoundResponse) - 1, 404);
+    return 0;
 }
 
 /// <summary>
@@ -409,7 +438,7 @@ static bool SetupAzureClient()
     iotHubClientAuthenticationState = IoTHubClientAuthenticationState_AuthenticationInitiated;
 
     IoTHubDeviceClient_LL_SetDeviceTwinCallback(iothubClientHandle, HubDeviceTwinCallback, NULL);
-    IoTHubDeviceClient_LL_SetDeviceMethodCallback(iothubClientHandle, HubDirectMethodCallback, NULL);
+    IoTHubClient_LL_SetDeviceMethodCallback_Ex(iothubClientHandle, HubDirectMethodCallback, NULL);
     IoTHubDeviceClient_LL_SetConnectionStatusCallback(iothubClientHandle, HubConnectionStatusCallback, NULL);
     IoTHubDeviceClient_LL_SetMessageCallback(iothubClientHandle, HubMessageReceivedCallback, NULL);
 
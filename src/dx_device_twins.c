@@ -3,6 +3,14 @@
 
 #include "dx_device_twins.h"
 
+#define DX_DEVICE_TWIN_JSON_PATH_MAX 256
+
+typedef struct {
+    char **paths;
+    size_t count;
+    size_t capacity;
+} CHANGED_PATHS;
+
 static bool deviceTwinReportState(DX_DEVICE_TWIN_BINDING *deviceTwinBinding, void *state,
                                   bool deviceTwinPnPAcknowledgment,
                                   DX_DEVICE_TWIN_RESPONSE_CODE statusCode);
@@ -11,16 +19,121 @@ static void deviceTwinClose(DX_DEVICE_TWIN_BINDING *deviceTwinBinding);
 static void deviceTwinOpen(DX_DEVICE_TWIN_BINDING *deviceTwinBinding);
 static void deviceTwinsReportStatusCallback(int result, void *context);
 static void SetDesiredState(JSON_Object *desiredProperties,
-                            DX_DEVICE_TWIN_BINDING *deviceTwinBinding);
+                            DX_DEVICE_TWIN_BINDING *deviceTwinBinding, DEVICE_TWIN_UPDATE_STATE updateState);
+static void ApplyJsonDesiredState(DX_DEVICE_TWIN_BINDING *deviceTwinBinding, const JSON_Value *desiredValue, bool replace);
 static void DeviceTwinCallbackHandler(DEVICE_TWIN_UPDATE_STATE updateState, const unsigned char *payload, size_t payloadSize,
                                       void *userContextCallback);
+static void SetDesiredGroupState(JSON_Object *jsonObject, DX_DEVICE_TWIN_GROUP_BINDING *deviceTwinGroupBinding);
+static void DeviceTwinDispatch(JSON_Object *rootObject, DEVICE_TWIN_UPDATE_STATE updateState);
+static void BuildComponentIndex(void);
+static void FreeComponentIndex(void);
+
+static void deviceTwinDropPending(struct _deviceTwinReportState *reportState);
+static void deviceTwinFreeReportState(DX_DEVICE_TWIN_BINDING *deviceTwinBinding);
+static void ReportFlushHandler(EventLoopTimer *eventLoopTimer);
+static void DeviceTwinConnectionChanged(bool connected);
+
+/// <summary>
+///     Last reported value of a binding and the latest value held back by minIntervalMs
+/// </summary>
+struct _deviceTwinReportState {
+    DX_DEVICE_TWIN_BINDING *binding;
+    char *lastReported;
+    double lastNumber;
+    int64_t lastReportMs;
+    char *pending;
+    double pendingNumber;
+    struct _deviceTwinReportState *nextPending;
+    char *unsent;
+    double unsentNumber;
+};
+
+/// <summary>
+///     Bindings of one IoT Plug and Play component, the root component has no name
+/// </summary>
+typedef struct {
+    const char *name;
+    DX_NAME_INDEX properties; // property name -> slot in bindings of its first binding
+    DX_DEVICE_TWIN_BINDING **bindings;
+    size_t *nextSameName; // per slot, the slot of the next binding of the same property, 0 for none
+    size_t bindingCount;
+} DEVICE_TWIN_COMPONENT;
+
+/// <summary>
+///     Tracks the component being descended into while filtering a twin document
+/// </summary>
+typedef struct {
+    DEVICE_TWIN_COMPONENT *component;
+    size_t componentDepth;
+    size_t rootDepth;
+} DEVICE_TWIN_FILTER_CONTEXT;
 
 static DX_DEVICE_TWIN_BINDING **_deviceTwins = NULL;
 static size_t _deviceTwinCount = 0;
 
+// _twinComponents[0] is the root component, named components are found through _twinComponentIndex
+static DEVICE_TWIN_COMPONENT *_twinComponents = NULL;
+static size_t _twinComponentCount = 0;
+static DX_NAME_INDEX _twinComponentIndex;
+static DX_DEVICE_TWIN_GROUP_BINDING **_deviceTwinGroups = NULL;
+static size_t _deviceTwinGroupCount = 0;
+
+static struct _deviceTwinReportState *_pendingReports = NULL;
+static int64_t _reportFlushDueMs = 0;
+// A reconnect seen while the flush walks _pendingReports resyncs once the walk is done
+static bool _reportFlushRunning = false;
+static bool _resyncDeferred = false;
+static DX_TIMER_BINDING reportFlushTimer = {.name = "reportFlushTimer", .handler = ReportFlushHandler};
+
+// A GetTwinAsync request not answered within this time no longer blocks a new refresh
+#define DX_DEVICE_TWIN_REFRESH_TIMEOUT_MS 30000
+
+static JSON_Value *_twinSnapshot = NULL;
+static char *_twinSnapshotText = NULL; // the snapshot's names and strings point into this buffer
+static int64_t _twinSnapshotMs = 0;
+static bool _twinRefreshInFlight = false;
+static int64_t _twinRefreshRequestedMs = 0;
+// Passed as the GetTwinAsync context, answers to a request that timed out are ignored
+static uintptr_t _twinRefreshGeneration = 0;
+
+// Looked up in every twin update, compiled when the first bindings are subscribed
+static JSON_Path *_desiredPath = NULL;
+static JSON_Path *_versionPath = NULL;
+static JSON_Path *_componentMarkerPath = NULL;
+
+/// <summary>
+///     Compiles the paths looked up in every twin update, once
+/// </summary>
+static void CompileTwinPaths(void)
+{
+    if (_desiredPath == NULL) {
+        _desiredPath = json_path_compile("desired");
+    }
+    if (_versionPath == NULL) {
+        _versionPath = json_path_compile("$version");
+    }
+    if (_componentMarkerPath == NULL) {
+        _componentMarkerPath = json_path_compile("__t");
+    }
+    if (_desiredPath == NULL || _versionPath == NULL || _componentMarkerPath == NULL) {
+        dx_terminate(DX_ExitCode_OpenDeviceTwin);
+    }
+}
+
+static void FreeTwinPaths(void)
+{
+    json_path_free(_desiredPath);
+    _desiredPath = NULL;
+    json_path_free(_versionPath);
+    _versionPath = NULL;
+    json_path_free(_componentMarkerPath);
+    _componentMarkerPath = NULL;
+}
+
 void dx_deviceTwinSubscribe(DX_DEVICE_TWIN_BINDING *deviceTwins[], size_t deviceTwinCount)
 {
     dx_azureRegisterDeviceTwinCallback(DeviceTwinCallbackHandler);
+    dx_azureRegisterDeviceTwinConnectionCallback(DeviceTwinConnectionChanged);
 
     _deviceTwins = deviceTwins;
     _deviceTwinCount = deviceTwinCount;
@@ -28,15 +141,152 @@ void dx_deviceTwinSubscribe(DX_DEVICE_TWIN_BINDING *deviceTwins[], size_t device
     for (int i = 0; i < _deviceTwinCount; i++) {
         deviceTwinOpen(_deviceTwins[i]);
     }
+
+    BuildComponentIndex();
+    CompileTwinPaths();
+}
+
+/// <summary>
+///     Returns the component for a component name, NULL names the root component
+/// </summary>
+static DEVICE_TWIN_COMPONENT *FindComponent(const char *componentName)
+{
+    if (_twinComponents == NULL) {
+        return NULL;
+    }
+    if (componentName == NULL) {
+        return &_twinComponents[0];
+    }
+    return (DEVICE_TWIN_COMPONENT *)dx_nameIndexFind(&_twinComponentIndex, componentName, strlen(componentName));
+}
+
+/// <summary>
+///     Builds the component -> property index used to route desired properties and to
+///     shape component reported properties
+/// </summary>
+static void BuildComponentIndex(void)
+{
+    // Subscribing again rebuilds the index
+    FreeComponentIndex();
+
+    _twinComponents = (DEVICE_TWIN_COMPONENT *)calloc(_deviceTwinCount + 1, sizeof(DEVICE_TWIN_COMPONENT));
+    if (_twinComponents == NULL || !dx_nameIndexInit(&_twinComponentIndex, _deviceTwinCount)) {
+        dx_terminate(DX_ExitCode_OpenDeviceTwin);
+        return;
+    }
+    _twinComponentCount = 1;
+
+    for (size_t i = 0; i < _deviceTwinCount; i++) {
+        DEVICE_TWIN_COMPONENT *component = FindComponent(_deviceTwins[i]->componentName);
+
+        if (component == NULL) {
+            component = &_twinComponents[_twinComponentCount++];
+            component->name = _deviceTwins[i]->componentName;
+            dx_nameIndexAdd(&_twinComponentIndex, component->name, component);
+        }
+        component->bindingCount++;
+    }
+
+    for (size_t c = 0; c < _twinComponentCount; c++) {
+        DEVICE_TWIN_COMPONENT *component = &_twinComponents[c];
+
+        component->bindings = (DX_DEVICE_TWIN_BINDING **)malloc(
+            (component->bindingCount > 0 ? component->bindingCount : 1) * sizeof(DX_DEVICE_TWIN_BINDING *));
+        component->nextSameName =
+            (size_t *)calloc(component->bindingCount > 0 ? component->bindingCount : 1, sizeof(size_t));
+        if (component->bindings == NULL || component->nextSameName == NULL ||
+            !dx_nameIndexInit(&component->properties, component->bindingCount)) {
+            dx_terminate(DX_ExitCode_OpenDeviceTwin);
+            return;
+        }
+        component->bindingCount = 0;
+    }
+
+    for (size_t i = 0; i < _deviceTwinCount; i++) {
+        DEVICE_TWIN_COMPONENT *component = FindComponent(_deviceTwins[i]->componentName);
+        const char *propertyName = _deviceTwins[i]->propertyName;
+        size_t slot = component->bindingCount++;
+        DX_DEVICE_TWIN_BINDING **first =
+            (DX_DEVICE_TWIN_BINDING **)dx_nameIndexFind(&component->properties, propertyName, strlen(propertyName));
+
+        component->bindings[slot] = _deviceTwins[i];
+
+        if (first == NULL) {
+            dx_nameIndexAdd(&component->properties, propertyName, &component->bindings[slot]);
+        } else {
+            // Every binding of a property is updated, later ones are chained behind the first
+            size_t last = (size_t)(first - component->bindings);
+            while (component->nextSameName[last] != 0) {
+                last = component->nextSameName[last];
+            }
+            component->nextSameName[last] = slot;
+        }
+    }
+}
+
+static void FreeComponentIndex(void)
+{
+    for (size_t c = 0; c < _twinComponentCount; c++) {
+        dx_nameIndexFree(&_twinComponents[c].properties);
+        free(_twinComponents[c].bindings);
+        free(_twinComponents[c].nextSameName);
+    }
+
+    free(_twinComponents);
+    _twinComponents = NULL;
+    _twinComponentCount = 0;
+    dx_nameIndexFree(&_twinComponentIndex);
 }
 
 void dx_deviceTwinUnsubscribe(void)
 {
     dx_azureRegisterDeviceTwinCallback(NULL);
+    dx_azureRegisterDeviceTwinConnectionCallback(NULL);
 
     for (int i = 0; i < _deviceTwinCount; i++) {
         deviceTwinClose(_deviceTwins[i]);
     }
+
+    FreeComponentIndex();
+    FreeTwinPaths();
+
+    dx_timerStop(&reportFlushTimer);
+    _reportFlushDueMs = 0;
+
+    _deviceTwinGroups = NULL;
+    _deviceTwinGroupCount = 0;
+
+    _twinRefreshInFlight = false;
+    if (_twinSnapshot != NULL) {
+        json_value_free(_twinSnapshot);
+        _twinSnapshot = NULL;
+    }
+    free(_twinSnapshotText);
+    _twinSnapshotText = NULL;
+    _twinSnapshotMs = 0;
+}
+
+void dx_deviceTwinGroupSubscribe(DX_DEVICE_TWIN_GROUP_BINDING *deviceTwinGroups[], size_t deviceTwinGroupCount)
+{
+    for (size_t i = 0; i < deviceTwinGroupCount; i++) {
+        for (size_t f = 0; f < deviceTwinGroups[i]->fieldCount; f++) {
+            DX_DEVICE_TWIN_GROUP_FIELD *field = &deviceTwinGroups[i]->fields[f];
+
+            if (field->twinType == DX_TYPE_UNKNOWN || field->twinType == DX_DEVICE_TWIN_JSON ||
+                field->offset + field->size > deviceTwinGroups[i]->groupSize) {
+                Log_Debug("Device Twin group '%s' field '%s' has an invalid type or offset.\n",
+                          deviceTwinGroups[i]->groupName, field->propertyName);
+                dx_terminate(DX_ExitCode_OpenDeviceTwin);
+            }
+            field->updated = false;
+        }
+    }
+
+    _deviceTwinGroups = deviceTwinGroups;
+    _deviceTwinGroupCount = deviceTwinGroupCount;
+
+    CompileTwinPaths();
+    dx_azureRegisterDeviceTwinCallback(DeviceTwinCallbackHandler);
 }
 
 static void deviceTwinOpen(DX_DEVICE_TWIN_BINDING *deviceTwinBinding)
@@ -45,7 +295,8 @@ static void deviceTwinOpen(DX_DEVICE_TWIN_BINDING *deviceTwinBinding)
         Log_Debug(
             "\n\nDevice Twin '%s' missing type information.\nInclude .twinType option in "
             "DX_DEVICE_TWIN_BINDING definition.\nExample .twinType=DX_DEVICE_TWIN_BOOL. Valid types "
-            "include DX_DEVICE_TWIN_BOOL, DX_DEVICE_TWIN_INT, DX_DEVICE_TWIN_FLOAT, DX_DEVICE_TWIN_STRING.\n\n",
+            "include DX_DEVICE_TWIN_BOOL, DX_DEVICE_TWIN_INT, DX_DEVICE_TWIN_FLOAT, DX_DEVICE_TWIN_STRING, "
+            "DX_DEVICE_TWIN_JSON.\n\n",
             deviceTwinBinding->propertyName);
         dx_terminate(DX_ExitCode_OpenDeviceTwin);
     }
@@ -75,19 +326,95 @@ static void deviceTwinOpen(DX_DEVICE_TWIN_BINDING *deviceTwinBinding)
     case DX_DEVICE_TWIN_STRING:
         // Note no memory is allocated for string twin type as size is unknown
         break;
+    case DX_DEVICE_TWIN_JSON:
+        // The applied JSON_Value is created from the first desired update
+        deviceTwinBinding->propertyValue = NULL;
+        break;
     default:
         break;
     }
+
+    deviceTwinBinding->changedPaths = NULL;
+    deviceTwinBinding->changedPathCount = 0;
 }
 
 static void deviceTwinClose(DX_DEVICE_TWIN_BINDING *deviceTwinBinding)
 {
+    deviceTwinFreeReportState(deviceTwinBinding);
+
     if (deviceTwinBinding->propertyValue != NULL) {
-        free(deviceTwinBinding->propertyValue);
+        if (deviceTwinBinding->twinType == DX_DEVICE_TWIN_JSON) {
+            json_value_free((JSON_Value *)deviceTwinBinding->propertyValue);
+        } else {
+            free(deviceTwinBinding->propertyValue);
+        }
         deviceTwinBinding->propertyValue = NULL;
     }
 }
 
+static bool IsBoundPropertyName(const char *name, size_t nameLen)
+{
+    if (_twinComponents != NULL && dx_nameIndexFind(&_twinComponents[0].properties, name, nameLen) != NULL) {
+        return true;
+    }
+
+    for (size_t i = 0; i < _deviceTwinGroupCount; i++) {
+        for (size_t f = 0; f < _deviceTwinGroups[i]->fieldCount; f++) {
+            if (strncmp(_deviceTwinGroups[i]->fields[f].propertyName, name, nameLen) == 0 &&
+                _deviceTwinGroups[i]->fields[f].propertyName[nameLen] == 0x00) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+/// <summary>
+///     Selects the members of a twin document to build. A complete twin nests the desired
+///     properties under "desired", a partial update is the desired patch itself. Components
+///     are descended into and only their bound properties are kept.
+/// </summary>
+static int DeviceTwinMemberFilter(const char *name, size_t nameLen, size_t depth, void *context)
+{
+    DEVICE_TWIN_FILTER_CONTEXT *filterContext = (DEVICE_TWIN_FILTER_CONTEXT *)context;
+    DEVICE_TWIN_COMPONENT *component = NULL;
+
+    if (filterContext->component != NULL && depth < filterContext->componentDepth) {
+        filterContext->component = NULL;
+    }
+
+    if (filterContext->component != NULL) {
+        if ((nameLen == 3 && strncmp(name, "__t", nameLen) == 0) ||
+            dx_nameIndexFind(&filterContext->component->properties, name, nameLen) != NULL) {
+            return JSONFilterKeep;
+        }
+        return JSONFilterSkip;
+    }
+
+    if (depth == 0 && nameLen == 7 && strncmp(name, "desired", nameLen) == 0) {
+        filterContext->rootDepth = 1;
+        return JSONFilterDescend;
+    }
+
+    if (depth != filterContext->rootDepth) {
+        return JSONFilterSkip;
+    }
+
+    if ((nameLen == 8 && strncmp(name, "$version", nameLen) == 0) || IsBoundPropertyName(name, nameLen)) {
+        return JSONFilterKeep;
+    }
+
+    if (_twinComponents != NULL &&
+        (component = (DEVICE_TWIN_COMPONENT *)dx_nameIndexFind(&_twinComponentIndex, name, nameLen)) != NULL) {
+        filterContext->component = component;
+        filterContext->componentDepth = depth + 1;
+        return JSONFilterDescend;
+    }
+
+    return JSONFilterSkip;
+}
+
 /// <summary>
 ///     Callback invoked when a Device Twin update is received from IoT Hub.
 /// </summary>
@@ -99,18 +426,11 @@ static void DeviceTwinCallbackHandler(DEVICE_TWIN_UPDATE_STATE updateState,
 {
     JSON_Value *root_value = NULL;
     JSON_Object *root_object = NULL;
+    DEVICE_TWIN_FILTER_CONTEXT filterContext = {.component = NULL, .componentDepth = 0, .rootDepth = 0};
 
-    char *payLoadString = (char *)malloc(payloadSize + 1);
-    if (payLoadString == NULL) {
-        goto cleanup;
-    }
-
-    memset(payLoadString, 0x00, payloadSize + 1);
-
-    memcpy(payLoadString, payload, payloadSize);
-    payLoadString[payloadSize] = 0; // null terminate string
-
-    root_value = json_parse_string(payLoadString);
+    // Only the bound properties are built, reported properties and metadata are skipped.
+    // The payload is parsed where the SDK left it, it is not null terminated.
+    root_value = json_parse_buffer_filtered((const char *)payload, payloadSize, DeviceTwinMemberFilter, &filterContext);
     if (root_value == NULL) {
         goto cleanup;
     }
@@ -120,41 +440,160 @@ static void DeviceTwinCallbackHandler(DEVICE_TWIN_UPDATE_STATE updateState,
         goto cleanup;
     }
 
-    JSON_Object *desiredProperties = json_object_dotget_object(root_object, "desired");
+    DeviceTwinDispatch(root_object, updateState);
+
+cleanup:
+    // Release the allocated memory.
+    if (root_value != NULL) {
+        json_value_free(root_value);
+    }
+}
+
+/// <summary>
+///     Applies the properties of one component object to the component's bindings
+/// </summary>
+static void DispatchComponent(DEVICE_TWIN_COMPONENT *component, JSON_Object *jsonObject, JSON_Object *desiredProperties,
+                              DEVICE_TWIN_UPDATE_STATE updateState)
+{
+    JSON_Value *versionValue = json_path_get_value(json_object_get_wrapping_value(desiredProperties), _versionPath);
+    bool hasVersion = json_value_get_type(versionValue) == JSONNumber;
+    int version = hasVersion ? (int)json_value_get_number(versionValue) : 0;
+
+    for (size_t i = 0; i < json_object_get_count(jsonObject); i++) {
+        const char *name = json_object_get_name(jsonObject, i);
+        DX_DEVICE_TWIN_BINDING **binding =
+            (DX_DEVICE_TWIN_BINDING **)dx_nameIndexFind(&component->properties, name, strlen(name));
+
+        while (binding != NULL) {
+            size_t next = component->nextSameName[binding - component->bindings];
+
+            if (hasVersion) {
+                (*binding)->propertyVersion = version;
+            }
+            SetDesiredState(jsonObject, *binding, updateState);
+            binding = next != 0 ? &component->bindings[next] : NULL;
+        }
+    }
+}
+
+/// <summary>
+///     Applies the desired properties of a twin document or desired patch to the bindings.
+///     Members marked "__t":"c" are IoT Plug and Play components and route to the component's bindings.
+/// </summary>
+static void DeviceTwinDispatch(JSON_Object *rootObject, DEVICE_TWIN_UPDATE_STATE updateState)
+{
+    JSON_Object *desiredProperties = json_path_get_object(json_object_get_wrapping_value(rootObject), _desiredPath);
     if (desiredProperties == NULL) {
-        desiredProperties = root_object;
+        desiredProperties = rootObject;
     }
 
-    for (int i = 0; i < _deviceTwinCount; i++) {
-        JSON_Value *jsonValue =
-            json_object_get_value(desiredProperties, _deviceTwins[i]->propertyName);
-        if (jsonValue != NULL) {
-            SetDesiredState(desiredProperties, _deviceTwins[i]);
+    if (_twinComponents != NULL) {
+        DispatchComponent(&_twinComponents[0], desiredProperties, desiredProperties, updateState);
+
+        for (size_t i = 0; _twinComponentCount > 1 && i < json_object_get_count(desiredProperties); i++) {
+            const char *name = json_object_get_name(desiredProperties, i);
+            JSON_Value *member = json_object_get_value_at(desiredProperties, i);
+            const char *marker = json_path_get_string(member, _componentMarkerPath);
+            DEVICE_TWIN_COMPONENT *component = NULL;
+
+            if (marker != NULL && strcmp(marker, "c") == 0 &&
+                (component = (DEVICE_TWIN_COMPONENT *)dx_nameIndexFind(&_twinComponentIndex, name, strlen(name))) !=
+                    NULL) {
+                DispatchComponent(component, json_value_get_object(member), desiredProperties, updateState);
+            }
         }
     }
 
-cleanup:
-    // Release the allocated memory.
-    if (root_value != NULL) {
-        json_value_free(root_value);
+    for (int i = 0; i < _deviceTwinGroupCount; i++) {
+        SetDesiredGroupState(desiredProperties, _deviceTwinGroups[i]);
+    }
+}
+
+/// <summary>
+///     GetTwinAsync completion, caches the full twin document and dispatches its desired properties
+/// </summary>
+static void DeviceTwinRefreshCallback(DEVICE_TWIN_UPDATE_STATE updateState, const unsigned char *payload,
+                                      size_t payloadSize, void *userContextCallback)
+{
+    JSON_Value *root_value = NULL;
+
+    if (!_twinRefreshInFlight || (uintptr_t)userContextCallback != _twinRefreshGeneration) {
+        // Unsubscribed while the request was outstanding, or a late answer to a request that timed out
+        return;
+    }
+    _twinRefreshInFlight = false;
+
+    char *payLoadString = (char *)malloc(payloadSize + 1);
+    if (payLoadString == NULL) {
+        return;
     }
 
-    if (payLoadString != NULL) {
+    memcpy(payLoadString, payload, payloadSize);
+    payLoadString[payloadSize] = 0; // null terminate string
+
+    // The snapshot is kept until the next refresh, held in a few arena blocks rather than one allocation per value.
+    // Names and strings are unescaped in place, so the payload copy is kept with it.
+    root_value = json_parse_string_insitu(payLoadString);
+
+    if (json_value_get_object(root_value) == NULL) {
+        json_value_free(root_value);
         free(payLoadString);
-        payLoadString = NULL;
+        return;
+    }
+
+    if (_twinSnapshot != NULL) {
+        json_value_free(_twinSnapshot);
+    }
+    free(_twinSnapshotText);
+    _twinSnapshot = root_value;
+    _twinSnapshotText = payLoadString;
+    _twinSnapshotMs = dx_getNowMilliseconds();
+
+    DeviceTwinDispatch(json_value_get_object(_twinSnapshot), DEVICE_TWIN_UPDATE_COMPLETE);
+}
+
+bool dx_deviceTwinRefresh(void)
+{
+    if (_twinRefreshInFlight &&
+        dx_getNowMilliseconds() - _twinRefreshRequestedMs < DX_DEVICE_TWIN_REFRESH_TIMEOUT_MS) {
+        // Served by the outstanding request
+        return true;
+    }
+
+    if (!dx_isAzureConnected()) {
+        return false;
+    }
+
+    if (IoTHubDeviceClient_LL_GetTwinAsync(dx_azureClientHandleGet(), DeviceTwinRefreshCallback,
+                                           (void *)(_twinRefreshGeneration + 1)) != IOTHUB_CLIENT_OK) {
+#if DX_LOGGING_ENABLED
+        Log_Debug("ERROR: failed to request the device twin.\n");
+#endif
+        return false;
+    }
+
+    _twinRefreshGeneration++;
+    _twinRefreshInFlight = true;
+    _twinRefreshRequestedMs = dx_getNowMilliseconds();
+
+    return true;
+}
+
+const JSON_Value *dx_deviceTwinGetSnapshot(int64_t *snapshotTimeMs)
+{
+    if (snapshotTimeMs != NULL) {
+        *snapshotTimeMs = _twinSnapshotMs;
     }
+    return _twinSnapshot;
 }
 
 /// <summary>
 ///     Checks to see if the device twin propertyName(name) is found in the json object. If yes,
 ///     then act upon the request
 /// </summary>
-static void SetDesiredState(JSON_Object *jsonObject, DX_DEVICE_TWIN_BINDING *deviceTwinBinding)
+static void SetDesiredState(JSON_Object *jsonObject, DX_DEVICE_TWIN_BINDING *deviceTwinBinding,
+                            DEVICE_TWIN_UPDATE_STATE updateState)
 {
-    if (json_object_has_value_of_type(jsonObject, "$version", JSONNumber)) {
-        deviceTwinBinding->propertyVersion = (int)json_object_get_number(jsonObject, "$version");
-    }
-
     switch (deviceTwinBinding->twinType) {
     case DX_DEVICE_TWIN_INT:
         if (json_object_has_value_of_type(jsonObject, deviceTwinBinding->propertyName,
@@ -220,141 +659,558 @@ static void SetDesiredState(JSON_Object *jsonObject, DX_DEVICE_TWIN_BINDING *dev
             deviceTwinBinding->propertyValue = NULL;
         }
         break;
+    case DX_DEVICE_TWIN_JSON:
+        // A complete twin carries the whole desired value, a partial update is a merge patch
+        ApplyJsonDesiredState(deviceTwinBinding,
+                              json_object_get_value(jsonObject, deviceTwinBinding->propertyName),
+                              updateState == DEVICE_TWIN_UPDATE_COMPLETE);
+        break;
     default:
         break;
     }
 }
 
 /// <summary>
-///     Sends device twin desire state IoT Plug and Play acknowledgement
-/// </summary>
-bool dx_deviceTwinAckDesiredValue(DX_DEVICE_TWIN_BINDING *deviceTwinBinding, void *state,
-                                  DX_DEVICE_TWIN_RESPONSE_CODE statusCode)
-{
-    return deviceTwinReportState(deviceTwinBinding, state, true, statusCode);
-}
-
-/// <summary>
-///     device twin report state to Azure IoT Hub
+///     Applies the group fields found in the desired properties to a scratch copy of the group
+///     value, then commits them together and calls the group handler once
 /// </summary>
-bool dx_deviceTwinReportValue(DX_DEVICE_TWIN_BINDING *deviceTwinBinding, void *state)
+static void SetDesiredGroupState(JSON_Object *jsonObject, DX_DEVICE_TWIN_GROUP_BINDING *deviceTwinGroupBinding)
 {
-    return deviceTwinReportState(deviceTwinBinding, state, false, DX_DEVICE_TWIN_RESPONSE_COMPLETED);
-}
+    bool updated = false;
+    char *scratch = NULL;
 
-/// <summary>
-///   Supports device twin report state and device twin ack desired state request
-/// </summary>
-static bool deviceTwinReportState(DX_DEVICE_TWIN_BINDING *deviceTwinBinding, void *state,
-                                  bool deviceTwinPnPAcknowledgment,
-                                  DX_DEVICE_TWIN_RESPONSE_CODE statusCode)
-{
-    int len = 0;
-    size_t reportLen = 10; // initialize to 10 chars to allow for JSON and NULL termination. This is
-                           // generous by a couple of bytes
-    bool result = false;
+    for (size_t f = 0; f < deviceTwinGroupBinding->fieldCount; f++) {
+        DX_DEVICE_TWIN_GROUP_FIELD *field = &deviceTwinGroupBinding->fields[f];
+        field->updated = false;
 
-    if (deviceTwinBinding == NULL) {
-        return false;
+        if (json_object_has_value(jsonObject, field->propertyName)) {
+            updated = true;
+        }
     }
 
-    if (!dx_isAzureConnected()) {
-        return false;
+    if (!updated || (scratch = (char *)malloc(deviceTwinGroupBinding->groupSize)) == NULL) {
+        return;
     }
 
-    reportLen +=
-        strlen(deviceTwinBinding->propertyName); // allow for twin property name in JSON response
+    memcpy(scratch, deviceTwinGroupBinding->groupValue, deviceTwinGroupBinding->groupSize);
+    updated = false;
 
-    if (deviceTwinBinding->twinType == DX_DEVICE_TWIN_STRING) {
-        reportLen += strlen((char *)state);
-    } else {
-        reportLen += 40; // allow 40 chars for Int, float, double, and boolean serialization
-    }
+    for (size_t f = 0; f < deviceTwinGroupBinding->fieldCount; f++) {
+        DX_DEVICE_TWIN_GROUP_FIELD *field = &deviceTwinGroupBinding->fields[f];
+        void *target = scratch + field->offset;
+        const char *string = NULL;
 
-    // to allow for device twin acknowledgement data
-    if (deviceTwinPnPAcknowledgment) {
-        reportLen += 40;
-    }
+        switch (field->twinType) {
+        case DX_DEVICE_TWIN_INT:
+            if (json_object_has_value_of_type(jsonObject, field->propertyName, JSONNumber)) {
+                *(int *)target = (int)json_object_get_number(jsonObject, field->propertyName);
+                field->updated = true;
+            }
+            break;
+        case DX_DEVICE_TWIN_FLOAT:
+            if (json_object_has_value_of_type(jsonObject, field->propertyName, JSONNumber)) {
+                *(float *)target = (float)json_object_get_number(jsonObject, field->propertyName);
+                field->updated = true;
+            }
+            break;
+        case DX_DEVICE_TWIN_DOUBLE:
+            if (json_object_has_value_of_type(jsonObject, field->propertyName, JSONNumber)) {
+                *(double *)target = json_object_get_number(jsonObject, field->propertyName);
+                field->updated = true;
+            }
+            break;
+        case DX_DEVICE_TWIN_BOOL:
+            if (json_object_has_value_of_type(jsonObject, field->propertyName, JSONBoolean)) {
+                *(bool *)target = (bool)json_object_get_boolean(jsonObject, field->propertyName);
+                field->updated = true;
+            }
+            break;
+        case DX_DEVICE_TWIN_STRING:
+            // Strings that do not fit the member are rejected rather than truncated
+            if ((string = json_object_get_string(jsonObject, field->propertyName)) != NULL &&
+                strlen(string) < field->size) {
+                memcpy(target, string, strlen(string) + 1);
+                field->updated = true;
+            }
+            break;
+        default:
+            break;
+        }
 
-    char *reportedPropertiesString = (char *)malloc(reportLen);
-    if (reportedPropertiesString == NULL) {
-        return false;
+        updated |= field->updated;
     }
 
-    memset(reportedPropertiesString, 0, reportLen);
-
-    switch (deviceTwinBinding->twinType) {
-    case DX_DEVICE_TWIN_INT:
-        *(int *)deviceTwinBinding->propertyValue = *(int *)state;
+    if (updated) {
+        memcpy(deviceTwinGroupBinding->groupValue, scratch, deviceTwinGroupBinding->groupSize);
 
-        if (deviceTwinPnPAcknowledgment) {
-            len = snprintf(reportedPropertiesString, reportLen,
-                           "{\"%s\":{\"value\":%d, \"ac\":%d, \"av\":%d}}",
-                           deviceTwinBinding->propertyName, (*(int *)deviceTwinBinding->propertyValue),
-                           (int)statusCode, deviceTwinBinding->propertyVersion);
-        } else {
-            len = snprintf(reportedPropertiesString, reportLen, "{\"%s\":%d}",
-                           deviceTwinBinding->propertyName, (*(int *)deviceTwinBinding->propertyValue));
+        JSON_Value *versionValue = json_path_get_value(json_object_get_wrapping_value(jsonObject), _versionPath);
+        if (json_value_get_type(versionValue) == JSONNumber) {
+            deviceTwinGroupBinding->propertyVersion = (int)json_value_get_number(versionValue);
         }
-        break;
-    case DX_DEVICE_TWIN_FLOAT:
-        *(float *)deviceTwinBinding->propertyValue = *(float *)state;
 
-        if (deviceTwinPnPAcknowledgment) {
-            len =
-                snprintf(reportedPropertiesString, reportLen,
-                         "{\"%s\":{\"value\":%f, \"ac\":%d, \"av\":%d}}",
-                         deviceTwinBinding->propertyName, (*(float *)deviceTwinBinding->propertyValue),
-                         (int)statusCode, deviceTwinBinding->propertyVersion);
-        } else {
-            len =
-                snprintf(reportedPropertiesString, reportLen, "{\"%s\":%f}",
-                         deviceTwinBinding->propertyName, (*(float *)deviceTwinBinding->propertyValue));
+        if (deviceTwinGroupBinding->handler != NULL) {
+            deviceTwinGroupBinding->handler(deviceTwinGroupBinding);
         }
-        break;
-    case DX_DEVICE_TWIN_DOUBLE:
-        *(double *)deviceTwinBinding->propertyValue = *(double *)state;
+    }
 
-        if (deviceTwinPnPAcknowledgment) {
-            len =
-                snprintf(reportedPropertiesString, reportLen,
-                         "{\"%s\":{\"value\":%lf, \"ac\":%d, \"av\":%d}}",
-                         deviceTwinBinding->propertyName, (*(double *)deviceTwinBinding->propertyValue),
-                         (int)statusCode, deviceTwinBinding->propertyVersion);
-        } else {
-            len = snprintf(reportedPropertiesString, reportLen, "{\"%s\":%lf}",
-                           deviceTwinBinding->propertyName,
-                           (*(double *)deviceTwinBinding->propertyValue));
+    free(scratch);
+}
+
+static void AddChangedPath(CHANGED_PATHS *changed, const char *path)
+{
+    if (changed->count == changed->capacity) {
+        size_t newCapacity = changed->capacity == 0 ? 8 : changed->capacity * 2;
+        char **newPaths = (char **)realloc(changed->paths, newCapacity * sizeof(char *));
+        if (newPaths == NULL) {
+            return;
         }
-        break;
-    case DX_DEVICE_TWIN_BOOL:
-        *(bool *)deviceTwinBinding->propertyValue = *(bool *)state;
+        changed->paths = newPaths;
+        changed->capacity = newCapacity;
+    }
+
+    if ((changed->paths[changed->count] = strdup(path)) != NULL) {
+        changed->count++;
+    }
+}
+
+static void FreeChangedPaths(CHANGED_PATHS *changed)
+{
+    for (size_t i = 0; i < changed->count; i++) {
+        free(changed->paths[i]);
+    }
+    free(changed->paths);
+    changed->paths = NULL;
+    changed->count = changed->capacity = 0;
+}
+
+/// <summary>
+///     Appends a path segment, returns the new path length or 0 if the path buffer is full
+/// </summary>
+static size_t AppendPathSegment(char *path, size_t pathLen, const char *format, const char *name, size_t index)
+{
+    int len = name != NULL ? snprintf(path + pathLen, DX_DEVICE_TWIN_JSON_PATH_MAX - pathLen, format, name)
+                           : snprintf(path + pathLen, DX_DEVICE_TWIN_JSON_PATH_MAX - pathLen, format, index);
+
+    if (len < 0 || (size_t)len >= DX_DEVICE_TWIN_JSON_PATH_MAX - pathLen) {
+        path[pathLen] = 0x00;
+        return 0;
+    }
+    return pathLen + (size_t)len;
+}
+
+/// <summary>
+///     Exact comparison at every depth, json_value_equals compares numbers with an epsilon
+/// </summary>
+static bool JsonValuesEqual(const JSON_Value *a, const JSON_Value *b)
+{
+    JSON_Value_Type type = json_value_get_type(a);
+    const JSON_Array *arrayA, *arrayB;
+    const JSON_Object *objectA, *objectB;
+
+    if (type != json_value_get_type(b)) {
+        return false;
+    }
 
-        if (deviceTwinPnPAcknowledgment) {
-            len = snprintf(reportedPropertiesString, reportLen,
-                           "{\"%s\":{\"value\":%s, \"ac\":%d, \"av\":%d}}",
-                           deviceTwinBinding->propertyName,
-                           (*(bool *)deviceTwinBinding->propertyValue ? "true" : "false"),
-                           (int)statusCode, deviceTwinBinding->propertyVersion);
+    switch (type) {
+    case JSONNumber:
+        return json_value_get_number(a) == json_value_get_number(b);
+    case JSONString:
+        return strcmp(json_value_get_string(a), json_value_get_string(b)) == 0;
+    case JSONBoolean:
+        return json_value_get_boolean(a) == json_value_get_boolean(b);
+    case JSONArray:
+        arrayA = json_value_get_array(a);
+        arrayB = json_value_get_array(b);
+        if (json_array_get_count(arrayA) != json_array_get_count(arrayB)) {
+            return false;
+        }
+        for (size_t i = 0; i < json_array_get_count(arrayA); i++) {
+            if (!JsonValuesEqual(json_array_get_value(arrayA, i), json_array_get_value(arrayB, i))) {
+                return false;
+            }
+        }
+        return true;
+    case JSONObject:
+        objectA = json_value_get_object(a);
+        objectB = json_value_get_object(b);
+        if (json_object_get_count(objectA) != json_object_get_count(objectB)) {
+            return false;
+        }
+        for (size_t i = 0; i < json_object_get_count(objectA); i++) {
+            if (!JsonValuesEqual(json_object_get_value_at(objectA, i),
+                                 json_object_get_value(objectB, json_object_get_name(objectA, i)))) {
+                return false;
+            }
+        }
+        return true;
+    default:
+        // null, and JSONError for a missing value
+        return true;
+    }
+}
+
+/// <summary>
+///     Nulls in a desired patch delete members, they are never stored
+/// </summary>
+static void RemoveNullMembers(JSON_Value *value)
+{
+    JSON_Object *object = json_value_get_object(value);
+
+    for (size_t i = json_object_get_count(object); i > 0; i--) {
+        JSON_Value *member = json_object_get_value_at(object, i - 1);
+
+        if (json_value_get_type(member) == JSONNull) {
+            json_object_remove(object, json_object_get_name(object, i - 1));
         } else {
-            len = snprintf(reportedPropertiesString, reportLen, "{\"%s\":%s}",
-                           deviceTwinBinding->propertyName,
-                           (*(bool *)deviceTwinBinding->propertyValue ? "true" : "false"));
+            RemoveNullMembers(member);
         }
-        break;
+    }
+}
+
+static void DiffJsonArrays(const JSON_Array *applied, const JSON_Array *desired, char *path, size_t pathLen,
+                           CHANGED_PATHS *changed)
+{
+    size_t count = json_array_get_count(desired);
+
+    if (json_array_get_count(applied) != count) {
+        AddChangedPath(changed, path);
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (!JsonValuesEqual(json_array_get_value(applied, i), json_array_get_value(desired, i))) {
+            // path still holds the array path when the index does not fit
+            AppendPathSegment(path, pathLen, "[%zu]", NULL, i);
+            AddChangedPath(changed, path);
+            path[pathLen] = 0x00;
+        }
+    }
+}
+
+/// <summary>
+///     Applies desired to the applied object and records the sub-paths that changed.
+///     When replace is set desired is the complete value and members it lacks are removed,
+///     otherwise desired is a merge patch.
+/// </summary>
+static void MergeDesiredObject(JSON_Object *applied, const JSON_Object *desired, bool replace, char *path,
+                               size_t pathLen, CHANGED_PATHS *changed)
+{
+    const char *name;
+    JSON_Value *appliedMember, *desiredMember, *copy;
+    size_t len;
+
+    if (replace) {
+        // Walk backwards as json_object_remove moves the last member into the removed slot
+        for (size_t i = json_object_get_count(applied); i > 0; i--) {
+            name = json_object_get_name(applied, i - 1);
+            if (json_object_get_value(desired, name) == NULL) {
+                AppendPathSegment(path, pathLen, pathLen == 0 ? "%s" : ".%s", name, 0);
+                AddChangedPath(changed, path);
+                path[pathLen] = 0x00;
+                json_object_remove(applied, name);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < json_object_get_count(desired); i++) {
+        name = json_object_get_name(desired, i);
+        desiredMember = json_object_get_value_at(desired, i);
+        appliedMember = json_object_get_value(applied, name);
+
+        // When the member name does not fit, path holds the parent and the member is applied as a whole
+        len = AppendPathSegment(path, pathLen, pathLen == 0 ? "%s" : ".%s", name, 0);
+
+        if (json_value_get_type(desiredMember) == JSONNull) {
+            if (appliedMember != NULL) {
+                json_object_remove(applied, name);
+                AddChangedPath(changed, path);
+            }
+        } else if (len != 0 && json_value_get_type(desiredMember) == JSONObject &&
+                   json_value_get_type(appliedMember) == JSONObject) {
+            MergeDesiredObject(json_value_get_object(appliedMember), json_value_get_object(desiredMember), replace,
+                               path, len, changed);
+        } else if (!JsonValuesEqual(appliedMember, desiredMember)) {
+            if (len != 0 && json_value_get_type(desiredMember) == JSONArray &&
+                json_value_get_type(appliedMember) == JSONArray) {
+                DiffJsonArrays(json_value_get_array(appliedMember), json_value_get_array(desiredMember), path, len,
+                               changed);
+            } else {
+                AddChangedPath(changed, path);
+            }
+
+            if ((copy = json_value_deep_copy(desiredMember)) != NULL) {
+                RemoveNullMembers(copy);
+                if (json_object_set_value(applied, name, copy) != JSONSuccess) {
+                    json_value_free(copy);
+                }
+            }
+        }
+
+        path[pathLen] = 0x00;
+    }
+}
+
+/// <summary>
+///     Applies a DX_DEVICE_TWIN_JSON desired value against the previously applied value and calls the
+///     handler with the sub-paths that changed. The applied value is kept in propertyValue.
+/// </summary>
+static void ApplyJsonDesiredState(DX_DEVICE_TWIN_BINDING *deviceTwinBinding, const JSON_Value *desiredValue, bool replace)
+{
+    JSON_Value *appliedValue = (JSON_Value *)deviceTwinBinding->propertyValue;
+    CHANGED_PATHS changed = {NULL, 0, 0};
+    char path[DX_DEVICE_TWIN_JSON_PATH_MAX] = {0};
+
+    if (desiredValue == NULL) {
+        return;
+    }
+
+    if (json_value_get_type(appliedValue) == JSONObject && json_value_get_type(desiredValue) == JSONObject) {
+        MergeDesiredObject(json_value_get_object(appliedValue), json_value_get_object(desiredValue), replace, path, 0,
+                           &changed);
+    } else if (!JsonValuesEqual(appliedValue, desiredValue)) {
+        JSON_Value *copy = json_value_deep_copy(desiredValue);
+        if (copy == NULL) {
+            Log_Debug("ERROR: Device Twin '%s' could not copy the desired value.\n", deviceTwinBinding->propertyName);
+            return;
+        }
+        RemoveNullMembers(copy);
+
+        if (appliedValue != NULL) {
+            json_value_free(appliedValue);
+        }
+        deviceTwinBinding->propertyValue = copy;
+        AddChangedPath(&changed, "");
+    }
+
+    deviceTwinBinding->propertyUpdated = true;
+    deviceTwinBinding->changedPaths = (const char **)changed.paths;
+    deviceTwinBinding->changedPathCount = changed.count;
+
+    if (deviceTwinBinding->handler != NULL) {
+        deviceTwinBinding->handler(deviceTwinBinding);
+    }
+
+    deviceTwinBinding->changedPaths = NULL;
+    deviceTwinBinding->changedPathCount = 0;
+    FreeChangedPaths(&changed);
+}
+
+/// <summary>
+///     Sends device twin desire state IoT Plug and Play acknowledgement
+/// </summary>
+bool dx_deviceTwinAckDesiredValue(DX_DEVICE_TWIN_BINDING *deviceTwinBinding, void *state,
+                                  DX_DEVICE_TWIN_RESPONSE_CODE statusCode)
+{
+    return deviceTwinReportState(deviceTwinBinding, state, true, statusCode);
+}
+
+/// <summary>
+///     Writes the shortest text that reads back to the same float or double, returns the number of characters
+///     written as snprintf does, -1 for NaN and infinities
+/// </summary>
+static int deviceTwinFormatNumber(char *buffer, size_t bufferLen, const void *value, bool isFloat)
+{
+    char number[JSON_NUMBER_BUF_SIZE];
+    int len = isFloat ? json_format_float(*(const float *)value, number) : json_format_number(*(const double *)value, number);
+
+    return len < 0 ? -1 : snprintf(buffer, bufferLen, "%s", number);
+}
+
+/// <summary>
+///     Serializes a group field value, returns the number of characters written as snprintf does
+///     or -1 if the value does not fit
+/// </summary>
+static int deviceTwinGroupFieldSerialize(DX_DEVICE_TWIN_GROUP_BINDING *deviceTwinGroupBinding,
+                                         DX_DEVICE_TWIN_GROUP_FIELD *field, char *buffer, size_t bufferLen)
+{
+    const char *value = (const char *)deviceTwinGroupBinding->groupValue + field->offset;
+    JSON_Writer writer;
+    size_t written = 0;
+
+    switch (field->twinType) {
+    case DX_DEVICE_TWIN_INT:
+        return snprintf(buffer, bufferLen, "%d", *(const int *)value);
+    case DX_DEVICE_TWIN_FLOAT:
+        return deviceTwinFormatNumber(buffer, bufferLen, value, true);
+    case DX_DEVICE_TWIN_DOUBLE:
+        return deviceTwinFormatNumber(buffer, bufferLen, value, false);
+    case DX_DEVICE_TWIN_BOOL:
+        return snprintf(buffer, bufferLen, "%s", *(const bool *)value ? "true" : "false");
     case DX_DEVICE_TWIN_STRING:
-        deviceTwinBinding->propertyValue = NULL;
+        // Escaped like any JSON string, the field may fill its buffer without a null character
+        json_writer_init_buffer(&writer, buffer, bufferLen);
+        json_writer_string_len(&writer, value, strnlen(value, field->size));
+        return json_writer_get_string(&writer, &written) != NULL ? (int)written : -1;
+    default:
+        return -1;
+    }
+}
 
-        if (deviceTwinPnPAcknowledgment) {
-            len = snprintf(reportedPropertiesString, reportLen,
-                           "{\"%s\":{\"value\":\"%s\", \"ac\":%d, \"av\":%d}}",
-                           deviceTwinBinding->propertyName, (char *)state, (int)statusCode,
-                           deviceTwinBinding->propertyVersion);
-        } else {
-            len = snprintf(reportedPropertiesString, reportLen, "{\"%s\":\"%s\"}",
-                           deviceTwinBinding->propertyName, (char *)state);
+bool dx_deviceTwinGroupAckDesiredValue(DX_DEVICE_TWIN_GROUP_BINDING *deviceTwinGroupBinding,
+                                       DX_DEVICE_TWIN_RESPONSE_CODE statusCode)
+{
+    char *reportedPropertiesString = NULL;
+    size_t reportLen = 3;
+    size_t offset = 0;
+    bool result = false;
+    int len;
+
+    if (deviceTwinGroupBinding == NULL || !dx_isAzureConnected()) {
+        return false;
+    }
+
+    // size the combined acknowledgement, 40 chars for numbers plus the ack fields, strings may
+    // escape every character as \u00XX
+    for (size_t f = 0; f < deviceTwinGroupBinding->fieldCount; f++) {
+        DX_DEVICE_TWIN_GROUP_FIELD *field = &deviceTwinGroupBinding->fields[f];
+        if (field->updated) {
+            reportLen += strlen(field->propertyName) + 80 +
+                         (field->twinType == DX_DEVICE_TWIN_STRING ? 6 * field->size : 0);
+        }
+    }
+
+    if (reportLen == 3 || (reportedPropertiesString = (char *)malloc(reportLen)) == NULL) {
+        return false;
+    }
+
+    reportedPropertiesString[offset++] = '{';
+
+    for (size_t f = 0; f < deviceTwinGroupBinding->fieldCount; f++) {
+        DX_DEVICE_TWIN_GROUP_FIELD *field = &deviceTwinGroupBinding->fields[f];
+
+        if (!field->updated) {
+            continue;
+        }
+
+        len = snprintf(reportedPropertiesString + offset, reportLen - offset, "%s\"%s\":{\"value\":",
+                       offset > 1 ? "," : "", field->propertyName);
+        if (len < 0 || (size_t)len >= reportLen - offset) {
+            goto cleanup;
+        }
+        offset += (size_t)len;
+
+        len = deviceTwinGroupFieldSerialize(deviceTwinGroupBinding, field, reportedPropertiesString + offset,
+                                            reportLen - offset);
+        if (len < 0 || (size_t)len >= reportLen - offset) {
+            goto cleanup;
+        }
+        offset += (size_t)len;
+
+        len = snprintf(reportedPropertiesString + offset, reportLen - offset, ", \"ac\":%d, \"av\":%d}",
+                       (int)statusCode, deviceTwinGroupBinding->propertyVersion);
+        if (len < 0 || (size_t)len >= reportLen - offset) {
+            goto cleanup;
         }
+        offset += (size_t)len;
+    }
+
+    if (offset + 2 > reportLen) {
+        goto cleanup;
+    }
+    reportedPropertiesString[offset++] = '}';
+    reportedPropertiesString[offset] = 0x00;
+
+    result = deviceTwinUpdateReportedState(reportedPropertiesString);
+
+cleanup:
+    free(reportedPropertiesString);
 
+    return result;
+}
+
+bool dx_deviceTwinReportValue(DX_DEVICE_TWIN_BINDING *deviceTwinBinding, void *state)
+{
+    return deviceTwinReportState(deviceTwinBinding, state, false, DX_DEVICE_TWIN_RESPONSE_COMPLETED);
+}
+
+/// <summary>
+///     Serializes a JSON twin value into a malloc'd string. Written in a single pass unless it outgrows the
+///     first buffer, then once more into a buffer of the size reported.
+/// </summary>
+static char *deviceTwinSerializeJson(const JSON_Value *state)
+{
+    size_t valueLen = 256;
+    char *value = NULL, *larger = NULL;
+    int len = -1;
+
+    if ((value = (char *)malloc(valueLen)) == NULL) {
+        return NULL;
+    }
+
+    if ((len = json_serialize_to_buffer_n(state, value, valueLen)) >= 0 && (size_t)len >= valueLen) {
+        valueLen = (size_t)len + 1;
+        if ((larger = (char *)realloc(value, valueLen)) == NULL) {
+            free(value);
+            return NULL;
+        }
+        value = larger;
+        len = json_serialize_to_buffer_n(state, value, valueLen);
+    }
+
+    if (len < 0 || (size_t)len >= valueLen) {
+        free(value);
+        return NULL;
+    }
+
+    return value;
+}
+
+/// <summary>
+///     Serializes the state of a device twin as a JSON value and updates the binding's propertyValue.
+///     Returns a malloc'd string, numeric is set for types that support a deadband.
+/// </summary>
+static char *deviceTwinSerializeValue(DX_DEVICE_TWIN_BINDING *deviceTwinBinding, void *state, double *number,
+                                      bool *numeric)
+{
+    size_t valueLen = 40; // allow 40 chars for Int, float, double, and boolean serialization
+    char *value = NULL;
+    JSON_Writer writer;
+    size_t written = 0;
+    int len = -1;
+
+    *numeric = false;
+
+    if (deviceTwinBinding->twinType == DX_DEVICE_TWIN_STRING) {
+        // quotes, every character may be escaped as \u00XX
+        valueLen = 6 * strlen((char *)state) + 3;
+    } else if (deviceTwinBinding->twinType == DX_DEVICE_TWIN_JSON) {
+        // state is a JSON_Value, the applied desired value in propertyValue is left untouched
+        return deviceTwinSerializeJson((const JSON_Value *)state);
+    }
+
+    if ((value = (char *)malloc(valueLen)) == NULL) {
+        return NULL;
+    }
+
+    switch (deviceTwinBinding->twinType) {
+    case DX_DEVICE_TWIN_INT:
+        *(int *)deviceTwinBinding->propertyValue = *(int *)state;
+        *number = *(int *)state;
+        *numeric = true;
+        len = snprintf(value, valueLen, "%d", *(int *)state);
+        break;
+    case DX_DEVICE_TWIN_FLOAT:
+        *(float *)deviceTwinBinding->propertyValue = *(float *)state;
+        *number = *(float *)state;
+        *numeric = true;
+        len = deviceTwinFormatNumber(value, valueLen, state, true);
+        break;
+    case DX_DEVICE_TWIN_DOUBLE:
+        *(double *)deviceTwinBinding->propertyValue = *(double *)state;
+        *number = *(double *)state;
+        *numeric = true;
+        len = deviceTwinFormatNumber(value, valueLen, state, false);
+        break;
+    case DX_DEVICE_TWIN_BOOL:
+        *(bool *)deviceTwinBinding->propertyValue = *(bool *)state;
+        len = snprintf(value, valueLen, "%s", *(bool *)state ? "true" : "false");
+        break;
+    case DX_DEVICE_TWIN_STRING:
+        deviceTwinBinding->propertyValue = NULL;
+        // Escaped, the value is pasted as is into single and combined reported properties patches
+        json_writer_init_buffer(&writer, value, valueLen);
+        json_writer_string(&writer, (char *)state);
+        len = json_writer_get_string(&writer, &written) != NULL ? (int)written : -1;
         break;
     case DX_TYPE_UNKNOWN:
         Log_Debug("Device Twin Type Unknown");
@@ -363,18 +1219,451 @@ static bool deviceTwinReportState(DX_DEVICE_TWIN_BINDING *deviceTwinBinding, voi
         break;
     }
 
-    if (len > 0) {
-        result = deviceTwinUpdateReportedState(reportedPropertiesString);
+    if (len < 0 || (size_t)len >= valueLen) {
+        free(value);
+        return NULL;
     }
 
-    if (reportedPropertiesString != NULL) {
-        free(reportedPropertiesString);
-        reportedPropertiesString = NULL;
+    return value;
+}
+
+/// <summary>
+///     Wraps a serialized value as a reported properties patch and sends it
+/// </summary>
+static bool deviceTwinSendValue(DX_DEVICE_TWIN_BINDING *deviceTwinBinding, const char *value,
+                                bool deviceTwinPnPAcknowledgment, DX_DEVICE_TWIN_RESPONSE_CODE statusCode)
+{
+    // allow for JSON, twin property name, value and NULL termination
+    size_t reportLen = 10 + strlen(deviceTwinBinding->propertyName) + strlen(value);
+    const char *componentName = deviceTwinBinding->componentName;
+    bool result = false;
+    int len;
+
+    // to allow for device twin acknowledgement data
+    if (deviceTwinPnPAcknowledgment) {
+        reportLen += 40;
     }
 
+    // to allow for the component wrapper {"component":{"__t":"c",...}}
+    if (componentName != NULL) {
+        reportLen += strlen(componentName) + 16;
+    }
+
+    char *reportedPropertiesString = (char *)malloc(reportLen);
+    if (reportedPropertiesString == NULL) {
+        return false;
+    }
+
+    if (deviceTwinPnPAcknowledgment) {
+        len = snprintf(reportedPropertiesString, reportLen,
+                       "{%s%s%s\"%s\":{\"value\":%s, \"ac\":%d, \"av\":%d}%s}", componentName ? "\"" : "",
+                       componentName ? componentName : "", componentName ? "\":{\"__t\":\"c\"," : "",
+                       deviceTwinBinding->propertyName, value, (int)statusCode, deviceTwinBinding->propertyVersion,
+                       componentName ? "}" : "");
+    } else {
+        len = snprintf(reportedPropertiesString, reportLen, "{%s%s%s\"%s\":%s%s}", componentName ? "\"" : "",
+                       componentName ? componentName : "", componentName ? "\":{\"__t\":\"c\"," : "",
+                       deviceTwinBinding->propertyName, value, componentName ? "}" : "");
+    }
+
+    if (len > 0 && (size_t)len < reportLen) {
+        result = deviceTwinUpdateReportedState(reportedPropertiesString);
+    }
+
+    free(reportedPropertiesString);
+
     return result;
 }
 
+static struct _deviceTwinReportState *deviceTwinGetReportState(DX_DEVICE_TWIN_BINDING *deviceTwinBinding)
+{
+    if (deviceTwinBinding->reportState == NULL) {
+        deviceTwinBinding->reportState =
+            (struct _deviceTwinReportState *)calloc(1, sizeof(struct _deviceTwinReportState));
+        if (deviceTwinBinding->reportState != NULL) {
+            deviceTwinBinding->reportState->binding = deviceTwinBinding;
+        }
+    }
+    return deviceTwinBinding->reportState;
+}
+
+static void deviceTwinFreeReportState(DX_DEVICE_TWIN_BINDING *deviceTwinBinding)
+{
+    struct _deviceTwinReportState *reportState = deviceTwinBinding->reportState;
+
+    if (reportState == NULL) {
+        return;
+    }
+
+    deviceTwinDropPending(reportState);
+    free(reportState->lastReported);
+    free(reportState->unsent);
+    free(reportState);
+    deviceTwinBinding->reportState = NULL;
+}
+
+/// <summary>
+///     Removes a held back report from the pending list, the caller owns the returned value
+/// </summary>
+static char *deviceTwinUnlinkPending(struct _deviceTwinReportState *reportState)
+{
+    struct _deviceTwinReportState **link = &_pendingReports;
+    char *pending = reportState->pending;
+
+    if (pending == NULL) {
+        return NULL;
+    }
+
+    while (*link != NULL && *link != reportState) {
+        link = &(*link)->nextPending;
+    }
+    if (*link != NULL) {
+        *link = reportState->nextPending;
+    }
+
+    reportState->nextPending = NULL;
+    reportState->pending = NULL;
+
+    return pending;
+}
+
+static void deviceTwinDropPending(struct _deviceTwinReportState *reportState)
+{
+    free(deviceTwinUnlinkPending(reportState));
+}
+
+static void deviceTwinScheduleFlush(int64_t dueMs)
+{
+    int64_t now = dx_getNowMilliseconds();
+
+    if (reportFlushTimer.eventLoopTimer == NULL && !dx_timerStart(&reportFlushTimer)) {
+        return;
+    }
+
+    if (_reportFlushDueMs == 0 || dueMs < _reportFlushDueMs) {
+        int64_t delayMs = dueMs > now ? dueMs - now : 1;
+        _reportFlushDueMs = dueMs;
+        dx_timerOneShotSet(&reportFlushTimer,
+                           &(struct timespec){(time_t)(delayMs / 1000), (long)(delayMs % 1000) * ONE_MS});
+    }
+}
+
+/// <summary>
+///     Records a sent value as the last reported value, takes ownership of value
+/// </summary>
+static void deviceTwinRecordReported(struct _deviceTwinReportState *reportState, char *value, double number)
+{
+    free(reportState->lastReported);
+    reportState->lastReported = value;
+    reportState->lastNumber = number;
+    reportState->lastReportMs = dx_getNowMilliseconds();
+
+    free(reportState->unsent);
+    reportState->unsent = NULL;
+}
+
+/// <summary>
+///     Keeps a value that could not be sent for the resync on reconnect, takes ownership of value
+/// </summary>
+static void deviceTwinHoldUnsent(struct _deviceTwinReportState *reportState, char *value, double number)
+{
+    free(reportState->unsent);
+    reportState->unsent = value;
+    reportState->unsentNumber = number;
+}
+
+/// <summary>
+///     Returns the value a binding should resync, folding a held back value into the unsent value.
+///     NULL when the cloud already holds the latest value.
+/// </summary>
+static const char *deviceTwinResyncValue(DX_DEVICE_TWIN_BINDING *deviceTwinBinding)
+{
+    struct _deviceTwinReportState *reportState = deviceTwinBinding->reportState;
+
+    if (reportState == NULL) {
+        return NULL;
+    }
+
+    if (reportState->pending != NULL) {
+        // The held back value is the latest, fold it into the resync
+        double pendingNumber = reportState->pendingNumber;
+        deviceTwinHoldUnsent(reportState, deviceTwinUnlinkPending(reportState), pendingNumber);
+    }
+
+    if (reportState->unsent != NULL && reportState->lastReported != NULL &&
+        strcmp(reportState->unsent, reportState->lastReported) == 0) {
+        free(reportState->unsent);
+        reportState->unsent = NULL;
+    }
+
+    return reportState->unsent;
+}
+
+/// <summary>
+///     On reconnect sends the values reported while offline, or held back by minIntervalMs,
+///     that differ from the last reported value as a single reported properties patch.
+///     Component properties are nested in their component object.
+/// </summary>
+static void DeviceTwinConnectionChanged(bool connected)
+{
+    char *reportedPropertiesString = NULL;
+    size_t reportLen = 3;
+    size_t offset = 0;
+    bool componentOpen = false;
+    int len;
+
+    if (!connected || _twinComponents == NULL) {
+        return;
+    }
+
+    if (_reportFlushRunning) {
+        _resyncDeferred = true;
+        return;
+    }
+
+    for (size_t c = 0; c < _twinComponentCount; c++) {
+        bool componentDirty = false;
+
+        for (size_t i = 0; i < _twinComponents[c].bindingCount; i++) {
+            DX_DEVICE_TWIN_BINDING *deviceTwinBinding = _twinComponents[c].bindings[i];
+            const char *value = deviceTwinResyncValue(deviceTwinBinding);
+
+            if (value != NULL) {
+                reportLen += strlen(deviceTwinBinding->propertyName) + strlen(value) + 4;
+                componentDirty = true;
+            }
+        }
+
+        if (componentDirty && _twinComponents[c].name != NULL) {
+            reportLen += strlen(_twinComponents[c].name) + 16;
+        }
+    }
+
+    if (reportLen == 3 || (reportedPropertiesString = (char *)malloc(reportLen)) == NULL) {
+        return;
+    }
+
+    reportedPropertiesString[offset++] = '{';
+
+    for (size_t c = 0; c < _twinComponentCount; c++) {
+        for (size_t i = 0; i < _twinComponents[c].bindingCount; i++) {
+            DX_DEVICE_TWIN_BINDING *deviceTwinBinding = _twinComponents[c].bindings[i];
+
+            if (deviceTwinBinding->reportState == NULL || deviceTwinBinding->reportState->unsent == NULL) {
+                continue;
+            }
+
+            if (_twinComponents[c].name != NULL && !componentOpen) {
+                len = snprintf(reportedPropertiesString + offset, reportLen - offset, "%s\"%s\":{\"__t\":\"c\"",
+                               offset > 1 ? "," : "", _twinComponents[c].name);
+                if (len < 0 || (size_t)len >= reportLen - offset) {
+                    goto cleanup;
+                }
+                offset += (size_t)len;
+                componentOpen = true;
+            }
+
+            len = snprintf(reportedPropertiesString + offset, reportLen - offset, "%s\"%s\":%s",
+                           offset > 1 ? "," : "", deviceTwinBinding->propertyName,
+                           deviceTwinBinding->reportState->unsent);
+            if (len < 0 || (size_t)len >= reportLen - offset) {
+                goto cleanup;
+            }
+            offset += (size_t)len;
+        }
+
+        if (componentOpen) {
+            reportedPropertiesString[offset++] = '}';
+            componentOpen = false;
+        }
+    }
+
+    reportedPropertiesString[offset++] = '}';
+    reportedPropertiesString[offset] = 0x00;
+
+    if (deviceTwinUpdateReportedState(reportedPropertiesString)) {
+        for (size_t i = 0; i < _deviceTwinCount; i++) {
+            struct _deviceTwinReportState *reportState = _deviceTwins[i]->reportState;
+
+            if (reportState != NULL && reportState->unsent != NULL) {
+                char *value = reportState->unsent;
+                reportState->unsent = NULL;
+                deviceTwinRecordReported(reportState, value, reportState->unsentNumber);
+            }
+        }
+    }
+
+cleanup:
+    free(reportedPropertiesString);
+}
+
+/// <summary>
+///     Sends the latest held back values whose minimum report interval has expired
+/// </summary>
+static void ReportFlushHandler(EventLoopTimer *eventLoopTimer)
+{
+    struct _deviceTwinReportState **link = &_pendingReports;
+    int64_t now = dx_getNowMilliseconds();
+    int64_t nextDueMs = 0;
+
+    if (ConsumeEventLoopTimerEvent(eventLoopTimer) != 0) {
+        dx_terminate(DX_ExitCode_ConsumeEventLoopTimeEvent);
+        return;
+    }
+
+    _reportFlushDueMs = 0;
+
+    // Held back reports are folded into the resync when the connection comes back
+    if (!dx_isAzureConnected()) {
+        return;
+    }
+
+    _reportFlushRunning = true;
+
+    while (*link != NULL) {
+        struct _deviceTwinReportState *reportState = *link;
+        int64_t dueMs = reportState->lastReportMs + reportState->binding->reportOptions.minIntervalMs;
+
+        if (now >= dueMs) {
+            if (deviceTwinSendValue(reportState->binding, reportState->pending, false, DX_DEVICE_TWIN_RESPONSE_COMPLETED)) {
+                *link = reportState->nextPending;
+                reportState->nextPending = NULL;
+                deviceTwinRecordReported(reportState, reportState->pending, reportState->pendingNumber);
+                reportState->pending = NULL;
+                continue;
+            }
+            // Retry once the interval has passed again
+            dueMs = now + reportState->binding->reportOptions.minIntervalMs;
+        }
+
+        if (nextDueMs == 0 || dueMs < nextDueMs) {
+            nextDueMs = dueMs;
+        }
+        link = &reportState->nextPending;
+    }
+
+    _reportFlushRunning = false;
+
+    if (_resyncDeferred) {
+        _resyncDeferred = false;
+        DeviceTwinConnectionChanged(true);
+    }
+
+    if (_pendingReports != NULL && nextDueMs != 0) {
+        deviceTwinScheduleFlush(nextDueMs);
+    }
+}
+
+/// <summary>
+///     Applies the binding's report options. Returns true when the value was handled without
+///     sending it now, either dropped as redundant or held back until the minimum interval expires.
+/// </summary>
+static bool deviceTwinSuppressReport(struct _deviceTwinReportState *reportState, char *value, double number,
+                                     bool numeric)
+{
+    DX_DEVICE_TWIN_REPORT_OPTIONS *options = &reportState->binding->reportOptions;
+
+    // After an acknowledgement there is no last value to compare with, the interval still applies
+    if (reportState->lastReported != NULL &&
+        ((options->onlyIfChanged && strcmp(value, reportState->lastReported) == 0) ||
+         (numeric && options->deadbandAbsolute > 0 &&
+          fabs(number - reportState->lastNumber) < options->deadbandAbsolute) ||
+         (numeric && options->deadbandRelative > 0 &&
+          fabs(number - reportState->lastNumber) < options->deadbandRelative * fabs(reportState->lastNumber)))) {
+        // The cloud already holds this value, an older held back value is now stale too
+        deviceTwinDropPending(reportState);
+        free(value);
+        return true;
+    }
+
+    if (options->minIntervalMs > 0 && reportState->lastReportMs != 0 &&
+        dx_getNowMilliseconds() - reportState->lastReportMs < options->minIntervalMs) {
+        if (reportState->pending == NULL) {
+            reportState->nextPending = _pendingReports;
+            _pendingReports = reportState;
+        } else {
+            free(reportState->pending);
+        }
+        reportState->pending = value;
+        reportState->pendingNumber = number;
+        deviceTwinScheduleFlush(reportState->lastReportMs + options->minIntervalMs);
+        return true;
+    }
+
+    return false;
+}
+
+/// <summary>
+///   Supports device twin report state and device twin ack desired state request
+/// </summary>
+static bool deviceTwinReportState(DX_DEVICE_TWIN_BINDING *deviceTwinBinding, void *state,
+                                  bool deviceTwinPnPAcknowledgment,
+                                  DX_DEVICE_TWIN_RESPONSE_CODE statusCode)
+{
+    struct _deviceTwinReportState *reportState = NULL;
+    double number = 0;
+    bool numeric = false;
+    bool result = false;
+    char *value = NULL;
+
+    if (deviceTwinBinding == NULL) {
+        return false;
+    }
+
+    if ((value = deviceTwinSerializeValue(deviceTwinBinding, state, &number, &numeric)) == NULL) {
+        return false;
+    }
+
+    reportState = deviceTwinGetReportState(deviceTwinBinding);
+
+    if (!dx_isAzureConnected()) {
+        // Reported values are resynced when the connection is restored, acknowledgements are not
+        if (reportState != NULL && !deviceTwinPnPAcknowledgment) {
+            deviceTwinDropPending(reportState);
+            deviceTwinHoldUnsent(reportState, value, number);
+        } else {
+            free(value);
+        }
+        return false;
+    }
+
+    if (reportState == NULL) {
+        result = deviceTwinSendValue(deviceTwinBinding, value, deviceTwinPnPAcknowledgment, statusCode);
+        free(value);
+        return result;
+    }
+
+    if (deviceTwinPnPAcknowledgment) {
+        // Acknowledgements are always sent and change the shape of the reported property
+        result = deviceTwinSendValue(deviceTwinBinding, value, true, statusCode);
+        if (result) {
+            deviceTwinDropPending(reportState);
+            free(reportState->lastReported);
+            reportState->lastReported = NULL;
+            free(reportState->unsent);
+            reportState->unsent = NULL;
+            reportState->lastReportMs = dx_getNowMilliseconds();
+        }
+        free(value);
+        return result;
+    }
+
+    if (deviceTwinSuppressReport(reportState, value, number, numeric)) {
+        return true;
+    }
+
+    deviceTwinDropPending(reportState);
+
+    if (!deviceTwinSendValue(deviceTwinBinding, value, false, DX_DEVICE_TWIN_RESPONSE_COMPLETED)) {
+        deviceTwinHoldUnsent(reportState, value, number);
+        return false;
+    }
+
+    deviceTwinRecordReported(reportState, value, number);
+
+    return true;
+}
+
 static bool deviceTwinUpdateReportedState(char *reportedPropertiesString)
 {
     if (IoTHubDeviceClient_LL_SendReportedState(
@@ -4,131 +4,423 @@
 #include "dx_direct_methods.h"
 
 static int DirectMethodCallbackHandler(const char *method_name, const unsigned char *payload, size_t payloadSize,
-                                       unsigned char **responsePayload, size_t *responsePayloadSize, void *userContextCallback);
+                                       METHOD_HANDLE methodId, void *userContextCallback);
+static void MethodTimeoutHandler(EventLoopTimer *eventLoopTimer);
+static void DirectMethodConnectionChanged(bool connected);
+static void ReleasePendingMethod(size_t slot);
+
+// Response buffers up to this size are kept for the next call
+#define DIRECT_METHOD_BUFFER_RETAIN 1024
+
+/// <summary>
+///     Commands of one IoT Plug and Play component, the root component has no name
+/// </summary>
+typedef struct {
+    const char *name;
+    DX_NAME_INDEX commands;
+} DIRECT_METHOD_COMPONENT;
+
+/// <summary>
+///     An asynchronous method call waiting for dx_directMethodResponse
+/// </summary>
+typedef struct {
+    METHOD_HANDLE methodId;
+    int64_t deadlineMs;
+    uint16_t generation;
+    bool inUse;
+} PENDING_METHOD;
 
 static DX_DIRECT_METHOD_BINDING **_directMethods;
 static size_t _directMethodCount;
 
-void dx_directMethodSubscribe(DX_DIRECT_METHOD_BINDING *directMethods[], size_t directMethodCount)
+static PENDING_METHOD _pendingMethods[DX_DIRECT_METHOD_MAX_PENDING];
+static DX_TIMER_BINDING methodTimeoutTimer = {.name = "methodTimeoutTimer", .handler = MethodTimeoutHandler};
+
+// _methodComponents[0] is the root component, named components are found through _methodComponentIndex
+static DIRECT_METHOD_COMPONENT *_methodComponents = NULL;
+static size_t _methodComponentCount = 0;
+static DX_NAME_INDEX _methodComponentIndex;
+
+// Response payload, written by jsonHandler or from a response message
+static JSON_Writer _response;
+static bool _responseBusy = false;
+
+static DIRECT_METHOD_COMPONENT *FindComponent(const char *componentName, size_t componentNameLen)
 {
-    dx_azureRegisterDirectMethodCallback(DirectMethodCallbackHandler);
+    if (componentName == NULL) {
+        return &_methodComponents[0];
+    }
+    return (DIRECT_METHOD_COMPONENT *)dx_nameIndexFind(&_methodComponentIndex, componentName, componentNameLen);
+}
+
+static void FreeComponentIndex(void)
+{
+    for (size_t c = 0; c < _methodComponentCount; c++) {
+        dx_nameIndexFree(&_methodComponents[c].commands);
+    }
+    free(_methodComponents);
+    _methodComponents = NULL;
+    _methodComponentCount = 0;
+    dx_nameIndexFree(&_methodComponentIndex);
+}
 
+void dx_directMethodSubscribe(DX_DIRECT_METHOD_BINDING *directMethods[], size_t directMethodCount)
+{
     _directMethods = directMethods;
     _directMethodCount = directMethodCount;
+
+    // Subscribing again rebuilds the index
+    FreeComponentIndex();
+
+    // Each component's index is sized for every binding, command counts per component are small
+    _methodComponents = (DIRECT_METHOD_COMPONENT *)calloc(directMethodCount + 1, sizeof(DIRECT_METHOD_COMPONENT));
+    if (_methodComponents == NULL || !dx_nameIndexInit(&_methodComponentIndex, directMethodCount) ||
+        !dx_nameIndexInit(&_methodComponents[0].commands, directMethodCount)) {
+        dx_terminate(DX_ExitCode_OpenDirectMethod);
+        return;
+    }
+    _methodComponentCount = 1;
+
+    for (size_t i = 0; i < directMethodCount; i++) {
+        const char *componentName = directMethods[i]->componentName;
+        DIRECT_METHOD_COMPONENT *component =
+            FindComponent(componentName, componentName != NULL ? strlen(componentName) : 0);
+
+        if (component == NULL) {
+            component = &_methodComponents[_methodComponentCount++];
+            component->name = componentName;
+            if (!dx_nameIndexInit(&component->commands, directMethodCount)) {
+                dx_terminate(DX_ExitCode_OpenDirectMethod);
+                return;
+            }
+            dx_nameIndexAdd(&_methodComponentIndex, componentName, component);
+        }
+
+        // A method call has a single response, so as before only the first binding of a name is invoked
+        if (!dx_nameIndexAdd(&component->commands, directMethods[i]->methodName, directMethods[i])) {
+            Log_Debug("ERROR: Direct method '%s' is bound more than once, binding %zu is never invoked.\n",
+                      directMethods[i]->methodName, i);
+        }
+    }
+
+    dx_azureRegisterDirectMethodCallback(DirectMethodCallbackHandler);
+    dx_azureRegisterDirectMethodConnectionCallback(DirectMethodConnectionChanged);
 }
 
 void dx_directMethodUnsubscribe(void)
 {
     dx_azureRegisterDirectMethodCallback(NULL);
+    dx_azureRegisterDirectMethodConnectionCallback(NULL);
+    dx_timerStop(&methodTimeoutTimer);
+
+    for (size_t i = 0; i < DX_DIRECT_METHOD_MAX_PENDING; i++) {
+        if (_pendingMethods[i].inUse) {
+            ReleasePendingMethod(i);
+        }
+    }
+
+    json_writer_free(&_response);
+
+    FreeComponentIndex();
 
     _directMethods = NULL;
     _directMethodCount = 0;
 }
 
+/// <summary>
+///     Finds the binding for a method name, "component*command" names a component command
+/// </summary>
+static DX_DIRECT_METHOD_BINDING *FindDirectMethod(const char *method_name)
+{
+    const char *separator = strchr(method_name, '*');
+    DIRECT_METHOD_COMPONENT *component = NULL;
+
+    if (_methodComponents == NULL) {
+        return NULL;
+    }
+
+    if (separator == NULL) {
+        component = FindComponent(NULL, 0);
+    } else {
+        component = FindComponent(method_name, (size_t)(separator - method_name));
+        method_name = separator + 1;
+    }
+
+    if (component == NULL) {
+        return NULL;
+    }
+
+    return (DX_DIRECT_METHOD_BINDING *)dx_nameIndexFind(&component->commands, method_name, strlen(method_name));
+}
+
+static bool SendMethodResponse(METHOD_HANDLE methodId, int statusCode, const char *responsePayload,
+                               size_t responsePayloadSize)
+{
+    return IoTHubClient_LL_DeviceMethodResponse(dx_azureClientHandleGet(), methodId,
+                                                (const unsigned char *)responsePayload, responsePayloadSize,
+                                                statusCode) == IOTHUB_CLIENT_OK;
+}
+
+/// <summary>
+///     Sends a response message as a JSON string
+/// </summary>
+static bool SendMethodResponseMessage(METHOD_HANDLE methodId, int statusCode, const char *responseMessage)
+{
+    static const char memoryFailedResponse[] = "\"Memory Allocation failed\"";
+    JSON_Writer localResponse;
+    JSON_Writer *response = &_response;
+    const char *responsePayload = NULL;
+    size_t responsePayloadSize = 0;
+    bool result = false;
+
+    // Called from a jsonHandler while it is writing its own response
+    if (_responseBusy) {
+        json_writer_init(&localResponse);
+        response = &localResponse;
+    }
+
+    json_writer_reset(response);
+    json_writer_string(response, responseMessage);
+
+    if ((responsePayload = json_writer_get_string(response, &responsePayloadSize)) == NULL) {
+        responsePayload = memoryFailedResponse;
+        responsePayloadSize = sizeof(memoryFailedResponse) - 1;
+    }
+
+    result = SendMethodResponse(methodId, statusCode, responsePayload, responsePayloadSize);
+
+    if (response == &localResponse) {
+        json_writer_free(&localResponse);
+    }
+
+    return result;
+}
+
+/// <summary>
+///     Keeps the response buffer for the next call unless a large payload grew it
+/// </summary>
+static void TrimMethodBuffers(void)
+{
+    if (_response.capacity > DIRECT_METHOD_BUFFER_RETAIN) {
+        json_writer_free(&_response);
+    }
+}
+
+static const char *ResponseMessage(DX_DIRECT_METHOD_RESPONSE_CODE responseCode, const char *responseMsg)
+{
+    if (responseMsg != NULL && strlen(responseMsg) > 0 &&
+        (responseCode == DX_METHOD_SUCCEEDED || responseCode == DX_METHOD_FAILED)) {
+        return responseMsg;
+    }
+
+    switch (responseCode) {
+    case DX_METHOD_SUCCEEDED: // 200
+        return "Method Succeeded";
+    case DX_METHOD_FAILED: // 500
+        return "Method Error";
+    case DX_METHOD_TIMEOUT: // 504
+        return "Method timed out";
+    default:
+        return "Method not found";
+    }
+}
+
+static DX_DIRECT_METHOD_TOKEN PendingToken(size_t slot)
+{
+    return ((DX_DIRECT_METHOD_TOKEN)_pendingMethods[slot].generation << 16) | (DX_DIRECT_METHOD_TOKEN)slot;
+}
+
+/// <summary>
+///     Arms the timeout timer for the earliest pending deadline
+/// </summary>
+static void ScheduleMethodTimeout(void)
+{
+    int64_t now = dx_getNowMilliseconds();
+    int64_t earliest = 0;
+
+    for (size_t i = 0; i < DX_DIRECT_METHOD_MAX_PENDING; i++) {
+        if (_pendingMethods[i].inUse && (earliest == 0 || _pendingMethods[i].deadlineMs < earliest)) {
+            earliest = _pendingMethods[i].deadlineMs;
+        }
+    }
+
+    if (earliest == 0) {
+        return;
+    }
+
+    if (methodTimeoutTimer.eventLoopTimer == NULL && !dx_timerStart(&methodTimeoutTimer)) {
+        return;
+    }
+
+    int64_t delayMs = earliest > now ? earliest - now : 1;
+    dx_timerOneShotSet(&methodTimeoutTimer,
+                       &(struct timespec){(time_t)(delayMs / 1000), (long)(delayMs % 1000) * ONE_MS});
+}
+
+static void ReleasePendingMethod(size_t slot)
+{
+    _pendingMethods[slot].inUse = false;
+    _pendingMethods[slot].methodId = NULL;
+    _pendingMethods[slot].generation++;
+}
+
+/// <summary>
+///     Answers pending calls whose timeout has expired
+/// </summary>
+static void MethodTimeoutHandler(EventLoopTimer *eventLoopTimer)
+{
+    int64_t now = dx_getNowMilliseconds();
+
+    if (ConsumeEventLoopTimerEvent(eventLoopTimer) != 0) {
+        dx_terminate(DX_ExitCode_ConsumeEventLoopTimeEvent);
+        return;
+    }
+
+    for (size_t i = 0; i < DX_DIRECT_METHOD_MAX_PENDING; i++) {
+        if (_pendingMethods[i].inUse && _pendingMethods[i].deadlineMs <= now) {
+            SendMethodResponseMessage(_pendingMethods[i].methodId, DX_METHOD_TIMEOUT,
+                                      ResponseMessage(DX_METHOD_TIMEOUT, NULL));
+            ReleasePendingMethod(i);
+        }
+    }
+
+    ScheduleMethodTimeout();
+}
+
+/// <summary>
+///     Method handles do not survive the client being recreated, forget calls pending at disconnect
+/// </summary>
+static void DirectMethodConnectionChanged(bool connected)
+{
+    if (connected) {
+        return;
+    }
+
+    for (size_t i = 0; i < DX_DIRECT_METHOD_MAX_PENDING; i++) {
+        if (_pendingMethods[i].inUse) {
+            ReleasePendingMethod(i);
+        }
+    }
+}
+
+bool dx_directMethodResponse(DX_DIRECT_METHOD_TOKEN token, DX_DIRECT_METHOD_RESPONSE_CODE responseCode,
+                             const char *responseMsg)
+{
+    size_t slot = token & 0xFFFF;
+    bool result = false;
+
+    if (slot >= DX_DIRECT_METHOD_MAX_PENDING || !_pendingMethods[slot].inUse ||
+        _pendingMethods[slot].generation != (uint16_t)(token >> 16) || responseCode == DX_METHOD_PENDING) {
+        return false;
+    }
+
+    result = SendMethodResponseMessage(_pendingMethods[slot].methodId, (int)responseCode,
+                                       ResponseMessage(responseCode, responseMsg));
+    ReleasePendingMethod(slot);
+
+    return result;
+}
+
 /*
 This implementation of Direct Methods expects a JSON Payload Object
 */
-static int DirectMethodCallbackHandler(const char *method_name, const unsigned char *payload,
-                                          size_t payloadSize, unsigned char **responsePayload,
-                                          size_t *responsePayloadSize, void *userContextCallback)
+static int DirectMethodCallbackHandler(const char *method_name, const unsigned char *payload, size_t payloadSize,
+                                       METHOD_HANDLE methodId, void *userContextCallback)
 {
-    const char *methodSucceededMsg = "Method Succeeded";
-    const char *methodNotFoundMsg = "Method not found";
-    const char *methodErrorMsg = "Method Error";
-    const char *mallocFailedMsg = "Memory Allocation failed";
-    const char *invalidJsonMsg = "Invalid JSON";
-
     DX_DIRECT_METHOD_RESPONSE_CODE responseCode = DX_METHOD_NOT_FOUND;
-    char *responseMsg = NULL;
-
     DX_DIRECT_METHOD_BINDING *directMethodBinding = NULL;
-
-    const char *responseMessage = methodNotFoundMsg;
-    int result = DX_METHOD_NOT_FOUND;
-    size_t responseMessageLength;
-
+    const char *responseMessage = NULL;
+    const char *responsePayload = NULL;
+    size_t responsePayloadSize = 0;
     JSON_Value *root_value = NULL;
+    char *responseMsg = NULL;
+    bool responded = false;
+    size_t slot = DX_DIRECT_METHOD_MAX_PENDING;
 
-    // Prepare the payload for the response. This is a heap allocated null terminated string.
-    // The Azure IoT Hub SDK is responsible of freeing it.
-    *responsePayload = NULL;  // Response payload content.
-    *responsePayloadSize = 0; // Response payload content size.
+    // Unknown methods are rejected before the payload is parsed
+    directMethodBinding = FindDirectMethod(method_name);
+    if (directMethodBinding == NULL || (directMethodBinding->handler == NULL && directMethodBinding->jsonHandler == NULL &&
+                                        directMethodBinding->asyncHandler == NULL)) {
+        goto cleanup;
+    }
 
-    char *payLoadString = (char *)malloc(payloadSize + 1);
-    if (payLoadString == NULL) {
-        responseMessage = mallocFailedMsg;
-        result = DX_METHOD_FAILED;
+    // Parsed straight from the SDK's payload, which is not null terminated
+    root_value = json_parse_buffer_arena((const char *)payload, payloadSize);
+    if (root_value == NULL) {
+        responseMessage = "Invalid JSON";
+        responseCode = DX_METHOD_FAILED;
         goto cleanup;
     }
 
-    memset(payLoadString, 0x00, payloadSize + 1);
+    if (directMethodBinding->asyncHandler == NULL && directMethodBinding->jsonHandler != NULL) {
+        json_writer_reset(&_response);
+        _responseBusy = true;
+        responseCode = directMethodBinding->jsonHandler(root_value, directMethodBinding, &_response);
+        _responseBusy = false;
 
-    memcpy(payLoadString, payload, payloadSize);
-    payLoadString[payloadSize] = 0; // null terminate string
+        if (responseCode == DX_METHOD_PENDING) {
+            Log_Debug("ERROR: Direct method '%s' returned DX_METHOD_PENDING without an asyncHandler.\n",
+                      directMethodBinding->methodName);
+            responseCode = DX_METHOD_FAILED;
+        }
 
-    root_value = json_parse_string(payLoadString);
-    if (root_value == NULL) {
-        responseMessage = invalidJsonMsg;
-        result = DX_METHOD_FAILED;
+        if ((responsePayload = json_writer_get_string(&_response, &responsePayloadSize)) != NULL) {
+            SendMethodResponse(methodId, (int)responseCode, responsePayload, responsePayloadSize);
+            responded = true;
+        }
         goto cleanup;
     }
 
-    // loop through array of DirectMethodBindings looking for a matching method name
-    for (int i = 0; i < _directMethodCount; i++) {
-        if (strcmp(method_name, _directMethods[i]->methodName) == 0) {
-            directMethodBinding = _directMethods[i];
-            break;
+    if (directMethodBinding->asyncHandler == NULL) {
+        responseCode = directMethodBinding->handler(root_value, directMethodBinding, &responseMsg);
+        if (responseCode == DX_METHOD_PENDING) {
+            Log_Debug("ERROR: Direct method '%s' returned DX_METHOD_PENDING without an asyncHandler.\n",
+                      directMethodBinding->methodName);
+            responseCode = DX_METHOD_FAILED;
         }
+        goto cleanup;
     }
 
-    if (directMethodBinding != NULL &&
-        directMethodBinding->handler != NULL) { // was a DX_DIRECT_METHOD_BINDING found
-
-        responseCode = directMethodBinding->handler(root_value, directMethodBinding, &responseMsg);
+    for (slot = 0; slot < DX_DIRECT_METHOD_MAX_PENDING && _pendingMethods[slot].inUse; slot++) {
+    }
 
-        result = (int)responseCode;
-
-        switch (responseCode) {
-        case DX_METHOD_SUCCEEDED: // 200
-            responseMessage =
-                responseMsg == NULL || strlen(responseMsg) == 0 ? methodSucceededMsg : responseMsg;
-            break;
-        case DX_METHOD_FAILED: // 500
-            responseMessage =
-                responseMsg == NULL || strlen(responseMsg) == 0 ? methodErrorMsg : responseMsg;
-            break;
-        case DX_METHOD_NOT_FOUND:
-            break;
-        }
+    if (slot == DX_DIRECT_METHOD_MAX_PENDING) {
+        responseMessage = "Too many pending methods";
+        responseCode = DX_METHOD_FAILED;
+        goto cleanup;
     }
 
-cleanup:
+    // Reserve the slot so the handler may complete the call before returning
+    _pendingMethods[slot].inUse = true;
+    _pendingMethods[slot].methodId = methodId;
+    _pendingMethods[slot].deadlineMs =
+        dx_getNowMilliseconds() + 1000 * (int64_t)(directMethodBinding->timeoutSeconds > 0
+                                                       ? directMethodBinding->timeoutSeconds
+                                                       : DX_DIRECT_METHOD_DEFAULT_TIMEOUT_SECONDS);
 
-    // Prepare the payload for the response.
-    // The Azure IoT Hub SDK is responsible of freeing it.
-    responseMessageLength = strlen(responseMessage);
-    *responsePayloadSize =
-        responseMessageLength + 2; // add two as going to wrap the message with quotes for JSON
+    responseCode = directMethodBinding->asyncHandler(root_value, directMethodBinding, PendingToken(slot), &responseMsg);
 
-    *responsePayload = (unsigned char *)malloc(*responsePayloadSize);
-    if (*responsePayload != NULL) {
-        memset(*responsePayload, 0x00, *responsePayloadSize);
+    if (responseCode == DX_METHOD_PENDING) {
+        ScheduleMethodTimeout();
+        goto cleanup;
+    }
 
-        // response message needs to be wrapped in quotes as it is part of the JSON payload object
-        memcpy(*responsePayload, "\"", 1);
-        memcpy(*responsePayload + 1, responseMessage, responseMessageLength);
-        memcpy(*responsePayload + responseMessageLength + 1, "\"", 1);
-    } else {
-        *responsePayloadSize = 0;
+    if (!_pendingMethods[slot].inUse || _pendingMethods[slot].methodId != methodId) {
+        // Completed through dx_directMethodResponse before returning
+        responded = true;
+        goto cleanup;
     }
 
-    if (root_value != NULL) {
-        json_value_free(root_value);
+    ReleasePendingMethod(slot);
+
+cleanup:
+    if (!responded && responseCode != DX_METHOD_PENDING) {
+        SendMethodResponseMessage(methodId, (int)responseCode,
+                                  responseMessage != NULL ? responseMessage : ResponseMessage(responseCode, responseMsg));
     }
 
-    if (payLoadString != NULL) {
-        free(payLoadString);
-        payLoadString = NULL;
+    if (root_value != NULL) {
+        json_value_free(root_value);
     }
 
     if (responseMsg != NULL) { // there was memory allocated for a response message so free it now
@@ -136,5 +428,7 @@ cleanup:
         responseMsg = NULL;
     }
 
-    return result;
-}
\ No newline at end of file
+    TrimMethodBuffers();
+
+    return 0;
+}
@@ -0,0 +1,364 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include "dx_jobs.h"
+
+static void JobSliceHandler(EventLoopTimer *eventLoopTimer);
+
+static DX_JOB_BINDING **_jobBindings = NULL;
+static size_t _jobBindingCount = 0;
+
+static DX_JOB _jobs[DX_JOB_MAX_RUNNING];
+// Seeded on the first subscribe, 0 until then
+static uint32_t _nextJobId = 0;
+static DX_TIMER_BINDING jobSliceTimer = {.name = "jobSliceTimer", .handler = JobSliceHandler};
+
+static const char *JobStateName(DX_JOB_STATE state)
+{
+    switch (state) {
+    case DX_JOB_RUNNING:
+        return "running";
+    case DX_JOB_SUCCEEDED:
+        return "succeeded";
+    case DX_JOB_FAILED:
+        return "failed";
+    default:
+        return "cancelled";
+    }
+}
+
+/// <summary>
+///     Limits the finished jobs kept in a binding's report. Jobs beyond the history are set to null, which removes
+///     them from the twin, and the null markers are dropped once a history's worth of later jobs has ended.
+/// </summary>
+static void TrimReportHistory(JSON_Object *report)
+{
+    const char *oldestFinished = NULL, *oldestRemoved = NULL;
+    unsigned long oldestFinishedId = 0, oldestRemovedId = 0;
+    size_t finished = 0, removed = 0;
+
+    // Object members are not kept in insertion order, job ids are
+    for (size_t i = 0; i < json_object_get_count(report); i++) {
+        const char *name = json_object_get_name(report, i);
+        JSON_Value *entry = json_object_get_value_at(report, i);
+        unsigned long id = strtoul(name, NULL, 10);
+
+        if (json_type(entry) == JSONNull) {
+            removed++;
+            if (oldestRemoved == NULL || id < oldestRemovedId) {
+                oldestRemoved = name;
+                oldestRemovedId = id;
+            }
+        } else if (strcmp(json_object_get_string(json_object(entry), "state"), JobStateName(DX_JOB_RUNNING)) != 0) {
+            finished++;
+            if (oldestFinished == NULL || id < oldestFinishedId) {
+                oldestFinished = name;
+                oldestFinishedId = id;
+            }
+        }
+    }
+
+    if (finished > DX_JOB_REPORT_HISTORY) {
+        json_object_set_null(report, oldestFinished);
+        removed++;
+    }
+
+    if (removed > DX_JOB_REPORT_HISTORY && oldestRemoved != NULL) {
+        json_object_remove(report, oldestRemoved);
+    }
+}
+
+/// <summary>
+///     Updates the job's entry in its binding's report and reports the whole report, so a report held back by
+///     the twin binding's reportOptions never loses another job's state
+/// </summary>
+static void ReportJob(DX_JOB *job)
+{
+    DX_JOB_BINDING *jobBinding = job->binding;
+    JSON_Value *entry = NULL;
+    char jobId[12];
+
+    job->reportedProgress = job->progress;
+
+    if (jobBinding->report == NULL || (entry = json_value_init_object()) == NULL) {
+        return;
+    }
+
+    json_object_set_string(json_object(entry), "name", jobBinding->jobName);
+    json_object_set_string(json_object(entry), "state", JobStateName(job->state));
+    json_object_set_number(json_object(entry), "progress", job->progress);
+
+    if (job->state != DX_JOB_RUNNING && job->result != NULL &&
+        json_object_set_value(json_object(entry), "result", job->result) == JSONSuccess) {
+        job->result = NULL;
+    }
+
+    snprintf(jobId, sizeof(jobId), "%u", job->jobId);
+    if (json_object_set_value(json_object(jobBinding->report), jobId, entry) != JSONSuccess) {
+        json_value_free(entry);
+        return;
+    }
+
+    if (job->state != DX_JOB_RUNNING) {
+        TrimReportHistory(json_object(jobBinding->report));
+    }
+
+    if (jobBinding->reportBinding != NULL) {
+        dx_deviceTwinReportValue(jobBinding->reportBinding, jobBinding->report);
+    }
+}
+
+static void EndJob(DX_JOB *job, DX_JOB_STATE state)
+{
+    job->state = state;
+    if (state == DX_JOB_SUCCEEDED) {
+        job->progress = 100;
+    }
+
+    ReportJob(job);
+
+    if (job->binding->cleanupHandler != NULL) {
+        job->binding->cleanupHandler(job);
+    }
+
+    if (job->result != NULL) {
+        json_value_free(job->result);
+    }
+
+    job->binding->runningCount--;
+    memset(job, 0, sizeof(DX_JOB));
+}
+
+static int SliceIntervalMs(DX_JOB_BINDING *jobBinding)
+{
+    return jobBinding->sliceIntervalMs > 0 ? jobBinding->sliceIntervalMs : DX_JOB_DEFAULT_SLICE_INTERVAL_MS;
+}
+
+/// <summary>
+///     Arms the slice timer for the earliest running job
+/// </summary>
+static void ScheduleJobSlice(void)
+{
+    int64_t now = dx_getNowMilliseconds();
+    int64_t earliest = 0;
+    bool running = false;
+
+    for (size_t i = 0; i < DX_JOB_MAX_RUNNING; i++) {
+        if (_jobs[i].inUse && (!running || _jobs[i].nextSliceMs < earliest)) {
+            earliest = _jobs[i].nextSliceMs;
+            running = true;
+        }
+    }
+
+    if (!running) {
+        return;
+    }
+
+    if (jobSliceTimer.eventLoopTimer == NULL && !dx_timerStart(&jobSliceTimer)) {
+        return;
+    }
+
+    // A zero delay would disarm the timer
+    int64_t delayMs = earliest > now ? earliest - now : 1;
+    dx_timerOneShotSet(&jobSliceTimer, &(struct timespec){(time_t)(delayMs / 1000), (long)(delayMs % 1000) * ONE_MS});
+}
+
+/// <summary>
+///     Runs one slice of each job that is due
+/// </summary>
+static void JobSliceHandler(EventLoopTimer *eventLoopTimer)
+{
+    int64_t now = dx_getNowMilliseconds();
+
+    if (ConsumeEventLoopTimerEvent(eventLoopTimer) != 0) {
+        dx_terminate(DX_ExitCode_ConsumeEventLoopTimeEvent);
+        return;
+    }
+
+    for (size_t i = 0; i < DX_JOB_MAX_RUNNING; i++) {
+        DX_JOB *job = &_jobs[i];
+
+        if (!job->inUse || job->nextSliceMs > now) {
+            continue;
+        }
+
+        DX_JOB_STEP_RESULT result = job->binding->stepHandler(job);
+
+        // The step handler may have cancelled the job
+        if (!job->inUse) {
+            continue;
+        }
+
+        switch (result) {
+        case DX_JOB_STEP_CONTINUE:
+            job->progress = job->progress < 0 ? 0 : job->progress > 99 ? 99 : job->progress;
+            job->nextSliceMs = now + SliceIntervalMs(job->binding);
+            if (job->progress != job->reportedProgress) {
+                ReportJob(job);
+            }
+            break;
+        case DX_JOB_STEP_DONE:
+            EndJob(job, DX_JOB_SUCCEEDED);
+            break;
+        default:
+            EndJob(job, DX_JOB_FAILED);
+            break;
+        }
+    }
+
+    ScheduleJobSlice();
+}
+
+void dx_jobSubscribe(DX_JOB_BINDING *jobs[], size_t jobCount)
+{
+    _jobBindings = jobs;
+    _jobBindingCount = jobCount;
+
+    // Entries of earlier boots stay in the reported twin, so ids continue from the clock rather than restarting at 1
+    if (_nextJobId == 0) {
+        _nextJobId = (uint32_t)time(NULL);
+        if (_nextJobId == 0) {
+            _nextJobId = 1;
+        }
+    }
+
+    for (size_t i = 0; i < jobCount; i++) {
+        jobs[i]->runningCount = 0;
+        if (jobs[i]->report != NULL) {
+            json_value_free(jobs[i]->report);
+        }
+        if ((jobs[i]->report = json_value_init_object()) == NULL) {
+            dx_terminate(DX_ExitCode_OpenJob);
+            return;
+        }
+
+        if (jobs[i]->reportBinding != NULL && jobs[i]->reportBinding->twinType != DX_DEVICE_TWIN_JSON) {
+            Log_Debug("Job '%s' report binding is not DX_DEVICE_TWIN_JSON, progress is not reported.\n",
+                      jobs[i]->jobName);
+            jobs[i]->reportBinding = NULL;
+        }
+    }
+}
+
+void dx_jobUnsubscribe(void)
+{
+    for (size_t i = 0; i < DX_JOB_MAX_RUNNING; i++) {
+        if (_jobs[i].inUse) {
+            EndJob(&_jobs[i], DX_JOB_CANCELLED);
+        }
+    }
+
+    dx_timerStop(&jobSliceTimer);
+
+    for (size_t i = 0; i < _jobBindingCount; i++) {
+        if (_jobBindings[i]->report != NULL) {
+            json_value_free(_jobBindings[i]->report);
+            _jobBindings[i]->report = NULL;
+        }
+    }
+
+    _jobBindings = NULL;
+    _jobBindingCount = 0;
+}
+
+bool dx_jobCancel(uint32_t jobId)
+{
+    for (size_t i = 0; i < DX_JOB_MAX_RUNNING; i++) {
+        if (_jobs[i].inUse && _jobs[i].jobId == jobId) {
+            EndJob(&_jobs[i], DX_JOB_CANCELLED);
+            ScheduleJobSlice();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static char *JobResponseMessage(const char *format, uint32_t value)
+{
+    char *responseMsg = (char *)malloc(64);
+    if (responseMsg != NULL) {
+        snprintf(responseMsg, 64, format, value);
+    }
+    return responseMsg;
+}
+
+DX_DIRECT_METHOD_RESPONSE_CODE dx_jobStartMethodHandler(JSON_Value *json, DX_DIRECT_METHOD_BINDING *directMethodBinding,
+                                                        char **responseMsg)
+{
+    DX_JOB_BINDING *jobBinding = (DX_JOB_BINDING *)directMethodBinding->context;
+    DX_JOB *job = NULL;
+    int maxRunning = 0;
+
+    if (jobBinding == NULL || jobBinding->stepHandler == NULL || _jobBindings == NULL) {
+        return DX_METHOD_FAILED;
+    }
+
+    maxRunning = jobBinding->maxRunning > 0 ? jobBinding->maxRunning : 1;
+
+    for (size_t i = 0; i < DX_JOB_MAX_RUNNING && job == NULL; i++) {
+        if (!_jobs[i].inUse) {
+            job = &_jobs[i];
+        }
+    }
+
+    if (job == NULL || jobBinding->runningCount >= maxRunning) {
+        *responseMsg = JobResponseMessage("Job limit of %u reached",
+                                          job == NULL ? DX_JOB_MAX_RUNNING : (uint32_t)maxRunning);
+        return DX_METHOD_FAILED;
+    }
+
+    job->jobId = _nextJobId++;
+    if (_nextJobId == 0) {
+        _nextJobId = 1;
+    }
+    job->binding = jobBinding;
+    job->state = DX_JOB_RUNNING;
+    job->reportedProgress = -1;
+    job->nextSliceMs = dx_getNowMilliseconds();
+    job->inUse = true;
+
+    if (jobBinding->startHandler != NULL && !jobBinding->startHandler(job, json)) {
+        if (jobBinding->cleanupHandler != NULL) {
+            jobBinding->cleanupHandler(job);
+        }
+        if (job->result != NULL) {
+            json_value_free(job->result);
+        }
+        memset(job, 0, sizeof(DX_JOB));
+        return DX_METHOD_FAILED;
+    }
+
+    jobBinding->runningCount++;
+    ReportJob(job);
+    ScheduleJobSlice();
+
+    *responseMsg = JobResponseMessage("%u", job->jobId);
+
+    return DX_METHOD_SUCCEEDED;
+}
+
+DX_DIRECT_METHOD_RESPONSE_CODE dx_jobCancelMethodHandler(JSON_Value *json, DX_DIRECT_METHOD_BINDING *directMethodBinding,
+                                                         char **responseMsg)
+{
+    (void)directMethodBinding;
+
+    JSON_Object *jsonObject = json_value_get_object(json);
+    if (jsonObject == NULL || !json_object_has_value_of_type(jsonObject, "jobId", JSONNumber)) {
+        return DX_METHOD_FAILED;
+    }
+
+    double requestedId = json_object_get_number(jsonObject, "jobId");
+    if (!(requestedId >= 1 && requestedId <= UINT32_MAX) || requestedId != floor(requestedId)) {
+        return DX_METHOD_FAILED;
+    }
+
+    uint32_t jobId = (uint32_t)requestedId;
+
+    if (!dx_jobCancel(jobId)) {
+        *responseMsg = JobResponseMessage("Job %u is not running", jobId);
+        return DX_METHOD_FAILED;
+    }
+
+    return DX_METHOD_SUCCEEDED;
+}
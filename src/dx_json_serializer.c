@@ -2,37 +2,46 @@
 
 bool dx_jsonSerialize(char *buffer, size_t buffer_size, int key_value_pair_count, ...)
 {
-    JSON_Value *root_value = json_value_init_object();
-    JSON_Object *root_object = json_value_get_object(root_value);
-
-    char *json_string = NULL;
+    JSON_Writer writer;
     char *key = NULL;
     bool result = false;
 
     va_list valist;
     va_start(valist, key_value_pair_count);
 
+    // The members are written straight into the caller's buffer, no JSON tree is built
+    json_writer_init_buffer(&writer, buffer, buffer_size);
+    json_writer_begin_object(&writer);
+
     while (key_value_pair_count--) {
         DX_JSON_TYPE type = va_arg(valist, int);
         key = va_arg(valist, char *);
 
         switch (type) {
         case DX_JSON_INT:
-            json_object_set_number(root_object, key, va_arg(valist, int));
+            json_writer_key(&writer, key);
+            json_writer_number(&writer, va_arg(valist, int));
             break;
 
             // floats are cast to doubles for valists
         case DX_JSON_FLOAT:
+            // Promoted to double by the variadic call, written with single precision digits
+            json_writer_key(&writer, key);
+            json_writer_float(&writer, (float)va_arg(valist, double));
+            break;
         case DX_JSON_DOUBLE:
-            json_object_set_number(root_object, key, va_arg(valist, double));
+            json_writer_key(&writer, key);
+            json_writer_number(&writer, va_arg(valist, double));
             break;
 
         case DX_JSON_STRING:
-            json_object_set_string(root_object, key, va_arg(valist, char *));
+            json_writer_key(&writer, key);
+            json_writer_string(&writer, va_arg(valist, char *));
             break;
 
         case DX_JSON_BOOL:
-            json_object_set_boolean(root_object, key, va_arg(valist, int));
+            json_writer_key(&writer, key);
+            json_writer_boolean(&writer, va_arg(valist, int));
             break;
 
         default:
@@ -41,15 +50,12 @@ bool dx_jsonSerialize(char *buffer, size_t buffer_size, int key_value_pair_count
     }
     va_end(valist);
 
-    json_string = json_serialize_to_string(root_value);
-
-    if (strlen(json_string) < buffer_size) {
-        strncpy(buffer, json_string, buffer_size);
-        result = true;
+    // Fails if the JSON did not fit in the buffer
+    json_writer_end_object(&writer);
+    result = json_writer_get_string(&writer, NULL) != NULL;
+    if (!result && buffer_size > 0) {
+        buffer[0] = '\0';
     }
 
-    json_free_serialized_string(json_string);
-    json_value_free(root_value);
-
     return result;
 }
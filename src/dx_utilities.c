@@ -157,3 +157,85 @@ void dx_Log_Debug(char *fmt, ...)
     va_end(args);
     Log_Debug(_log_debug_buffer);
 }
+
+uint32_t dx_nameHash(const char *name, size_t nameLen)
+{
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < nameLen; i++) {
+        hash ^= (uint8_t)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+bool dx_nameIndexInit(DX_NAME_INDEX *index, size_t maxEntries)
+{
+    size_t capacity = 8;
+
+    // keep the load factor at or below one half
+    while (capacity < maxEntries * 2) {
+        capacity *= 2;
+    }
+
+    index->entries = (DX_NAME_INDEX_ENTRY *)calloc(capacity, sizeof(DX_NAME_INDEX_ENTRY));
+    index->capacity = index->entries != NULL ? capacity : 0;
+    index->count = 0;
+
+    return index->entries != NULL;
+}
+
+bool dx_nameIndexAdd(DX_NAME_INDEX *index, const char *name, void *value)
+{
+    size_t nameLen = strlen(name);
+    uint32_t hash = dx_nameHash(name, nameLen);
+
+    if (index->entries == NULL || (index->count + 1) * 2 > index->capacity) {
+        return false;
+    }
+
+    for (size_t slot = hash & (index->capacity - 1);; slot = (slot + 1) & (index->capacity - 1)) {
+        DX_NAME_INDEX_ENTRY *entry = &index->entries[slot];
+
+        if (entry->name == NULL) {
+            entry->name = name;
+            entry->nameLen = nameLen;
+            entry->hash = hash;
+            entry->value = value;
+            index->count++;
+            return true;
+        }
+        if (entry->hash == hash && entry->nameLen == nameLen && memcmp(entry->name, name, nameLen) == 0) {
+            return false;
+        }
+    }
+}
+
+void *dx_nameIndexFind(const DX_NAME_INDEX *index, const char *name, size_t nameLen)
+{
+    uint32_t hash;
+
+    if (index->entries == NULL || index->count == 0) {
+        return NULL;
+    }
+
+    hash = dx_nameHash(name, nameLen);
+
+    for (size_t slot = hash & (index->capacity - 1);; slot = (slot + 1) & (index->capacity - 1)) {
+        const DX_NAME_INDEX_ENTRY *entry = &index->entries[slot];
+
+        if (entry->name == NULL) {
+            return NULL;
+        }
+        if (entry->hash == hash && entry->nameLen == nameLen && memcmp(entry->name, name, nameLen) == 0) {
+            return entry->value;
+        }
+    }
+}
+
+void dx_nameIndexFree(DX_NAME_INDEX *index)
+{
+    free(index->entries);
+    index->entries = NULL;
+    index->capacity = index->count = 0;
+}
@@ -41,26 +41,54 @@
 #include <ctype.h>
 #include <math.h>
 #include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+
+/* String scanners: SSE2 where available, NEON only when built with -DPARSON_USE_NEON, otherwise
+   the portable word at a time scanners, which are also what ARM builds use by default */
+#if defined(__GNUC__) && defined(__SSE2__)
+#include <emmintrin.h>
+#define PARSON_SSE2
+#elif defined(PARSON_USE_NEON) && defined(__GNUC__) && (defined(__ARM_NEON) || defined(__ARM_NEON__)) && \
+    defined(__ORDER_LITTLE_ENDIAN__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#include <arm_neon.h>
+#define PARSON_NEON
+#endif
 
 /* Apparently sscanf is not implemented in some "standard" libraries, so don't use it, if you
  * don't have to. */
 #define sscanf THINK_TWICE_ABOUT_USING_SSCANF
 
-#define STARTING_CAPACITY 16
+#define STARTING_CAPACITY 4 /* of objects and arrays, most are small and parsed ones are trimmed anyway */
+#define SINK_STARTING_CAPACITY 64
+#define OBJECT_INDEX_THRESHOLD 8 /* larger objects are looked up through a hash index */
+#define VALUE_INLINE_STRING_MAX 6 /* longest string kept inside its value */
 #define MAX_NESTING 2048
 
-#define FLOAT_FORMAT "%1.17g" /* do not increase precision without incresing NUM_BUF_SIZE */
-/* double printed with "%1.17g" shouldn't be longer than 25 bytes so let's use 64 */
+/* number tokens longer than this are copied to the heap for strtod, see also JSON_NUMBER_BUF_SIZE */
 #define NUM_BUF_SIZE 64
 
 #define SIZEOF_TOKEN(a) (sizeof(a) - 1)
 #define SKIP_CHAR(str) ((*str)++)
-#define SKIP_WHITESPACES(str)                 \
-    while (isspace((unsigned char)(**str))) { \
-        SKIP_CHAR(str);                       \
+/* the parser never reads at or past parson_parse_end, where it sees a null */
+#define CURRENT_CHAR(str) (*(str) < parson_parse_end ? **(str) : '\0')
+#define SKIP_WHITESPACES(str)                          \
+    while (isspace((unsigned char)CURRENT_CHAR(str))) { \
+        SKIP_CHAR(str);                                \
     }
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
 
+#if defined(__GNUC__)
+#define PARSON_THREAD_LOCAL __thread
+#else
+#define PARSON_THREAD_LOCAL
+#endif
+
+#define ARENA_ALIGNMENT 8
+#define ARENA_ALIGN(size) (((size) + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1))
+#define ARENA_MIN_CHUNK_SIZE 512
+#define ARENA_SPARE_CHUNK_MAX 4096 /* largest chunk kept for the next arena */
+
 #undef malloc
 #undef free
 
@@ -79,16 +107,30 @@ typedef union json_value_value {
     int null;
 } JSON_Value_Value;
 
+typedef struct json_arena_t JSON_Arena;
+
+/* The type tag and short strings fill what would otherwise be padding after the payload */
 struct json_value_t {
     JSON_Value *parent;
-    JSON_Value_Type type;
+    JSON_Arena *arena; /* NULL for heap allocated values */
     JSON_Value_Value value;
+    signed char type; /* JSON_Value_Type */
+    char short_string[VALUE_INLINE_STRING_MAX + 1]; /* value.string points here for short strings */
 };
 
+/* A member, name and value sit next to each other so lookups touch one cache line per member */
+typedef struct json_object_entry_t {
+    char *name;
+    JSON_Value *value;
+    unsigned int name_length; /* names are limited to UINT_MAX bytes */
+    unsigned int name_hash;
+} JSON_Object_Entry;
+
 struct json_object_t {
     JSON_Value *wrapping_value;
-    char **names;
-    JSON_Value **values;
+    JSON_Object_Entry *entries;
+    size_t *index; /* hash index of objects over OBJECT_INDEX_THRESHOLD members, NULL otherwise */
+    size_t index_capacity;
     size_t count;
     size_t capacity;
 };
@@ -100,20 +142,93 @@ struct json_array_t {
     size_t capacity;
 };
 
+typedef struct json_path_segment_t {
+    const char *name; /* unescaped, points into the path's block */
+    size_t name_length;
+    unsigned int name_hash;
+    int is_index; /* the name is an array index, JSON Pointers only */
+    size_t index;
+} JSON_Path_Segment;
+
+/* A compiled path is one block: the path, its segments, then the text of their names */
+struct json_path_t {
+    JSON_Path_Segment *segments;
+    size_t count;
+};
+
+/* Serializer output. A growable sink reallocates as it fills, a fixed one keeps counting what does not
+   fit so the caller learns the size needed */
+typedef struct json_sink_t {
+    char *buffer;
+    size_t length; /* of the whole output, past capacity when a fixed sink overflowed */
+    size_t capacity;
+    int growable;
+    int failed; /* out of memory */
+} JSON_Sink;
+
+/* Arena documents are bump allocated from a list of chunks, the arena itself lives at the start of
+   its first chunk */
+typedef struct json_arena_chunk_t {
+    struct json_arena_chunk_t *next;
+    size_t size; /* usable bytes after the header */
+    size_t used;
+} JSON_Arena_Chunk;
+
+struct json_arena_t {
+    JSON_Arena_Chunk *chunks; /* allocations are served from the head */
+    JSON_Value *root;
+    int has_foreign; /* heap allocated names, arrays or values were added after parsing */
+    char *text; /* caller's buffer names and strings point into, in place parses only */
+    size_t text_size;
+};
+
+#define ARENA_CHUNK_HEADER_SIZE ARENA_ALIGN(sizeof(JSON_Arena_Chunk))
+
+static PARSON_THREAD_LOCAL JSON_Arena *parson_arena = NULL; /* arena of the document being parsed */
+static PARSON_THREAD_LOCAL const char *parson_parse_end = NULL; /* end of the text being parsed */
+static PARSON_THREAD_LOCAL JSON_Arena_Chunk *parson_spare_chunk = NULL; /* kept from the last freed arena */
+
 /* Various */
 static void remove_comments(char *string, const char *start_token, const char *end_token);
 static char *parson_strndup(const char *string, size_t n);
 static char *parson_strdup(const char *string);
+static void *parson_alloc(size_t size);
+static void parson_release(const JSON_Arena *arena, void *ptr);
+
+/* Arena */
+static JSON_Arena *arena_new(size_t size);
+static void *arena_alloc(JSON_Arena *arena, size_t size);
+static int arena_owns(const JSON_Arena *arena, const void *ptr);
+static void arena_note_foreign(const JSON_Value *container);
+static void arena_free_foreign(JSON_Arena *arena, JSON_Value *value);
+static void arena_destroy(JSON_Arena *arena);
 static int hex_char_to_int(char c);
 static int parse_utf16_hex(const char *string, unsigned int *result);
 static int num_bytes_in_utf8_sequence(unsigned char c);
 static int verify_utf8_sequence(const unsigned char *string, int *len);
 static int is_valid_utf8(const char *string, size_t string_len);
+static const char *scan_string(const char *ptr, const char *end, char stop);
+static const char *scan_ascii(const char *ptr, const char *end);
 static int is_decimal(const char *string, size_t length);
 
+/* JSON Path */
+static JSON_Path *json_path_alloc(size_t count, size_t text_size);
+static void json_path_set_segment(JSON_Path_Segment *segment, const char *name, size_t name_len);
+
 /* JSON Object */
 static JSON_Object *json_object_init(JSON_Value *wrapping_value);
 static JSON_Status json_object_add(JSON_Object *object, const char *name, JSON_Value *value);
+static JSON_Status json_object_add_owned(JSON_Object *object, char *name, JSON_Value *value);
+static JSON_Status json_object_append(JSON_Object *object, char *name, size_t name_len,
+                                      JSON_Value *value);
+static unsigned int hash_name(const char *name, size_t name_len);
+static void json_object_index_build(JSON_Object *object);
+static void json_object_index_insert(JSON_Object *object, size_t position);
+static size_t json_object_index_cell(const JSON_Object *object, size_t position);
+static void json_object_index_remove(JSON_Object *object, size_t position);
+static size_t json_object_find(const JSON_Object *object, const char *name, size_t name_len);
+static size_t json_object_find_hashed(const JSON_Object *object, const char *name, size_t name_len,
+                                      unsigned int hash);
 static JSON_Status json_object_addn(JSON_Object *object, const char *name, size_t name_len,
                                     JSON_Value *value);
 static JSON_Status json_object_resize(JSON_Object *object, size_t new_capacity);
@@ -132,11 +247,15 @@ static JSON_Status json_array_resize(JSON_Array *array, size_t new_capacity);
 static void json_array_free(JSON_Array *array);
 
 /* JSON Value */
+static JSON_Value *value_alloc(JSON_Value_Type type);
+static void value_release(JSON_Value *value);
 static JSON_Value *json_value_init_string_no_copy(char *string);
+static JSON_Value *json_value_init_string_copy(const char *string, size_t len);
 
 /* Parser */
 static JSON_Status skip_quotes(const char **string);
 static int parse_utf16(const char **unprocessed, char **processed);
+static char *unescape_string(const char *input, size_t len, char *output);
 static char *process_string(const char *input, size_t len);
 static char *get_quoted_string(const char **string);
 static JSON_Value *parse_object_value(const char **string, size_t nesting);
@@ -146,18 +265,37 @@ static JSON_Value *parse_boolean_value(const char **string);
 static JSON_Value *parse_number_value(const char **string);
 static JSON_Value *parse_null_value(const char **string);
 static JSON_Value *parse_value(const char **string, size_t nesting);
+static JSON_Value *parse_object_value_filtered(const char **string, size_t nesting, size_t depth,
+                                               JSON_Member_Filter filter, void *context);
+static JSON_Status skip_value(const char **string, size_t nesting);
+static JSON_Value *parse_document_arena(const char *string, size_t len, char *text);
+static JSON_Status sax_parse_string(const char **string, const char *end, char *scratch,
+                                    size_t scratch_size, const char **output, size_t *output_len);
+static JSON_Status sax_parse_number(const char **string, const char *end, char *scratch,
+                                    size_t scratch_size, double *number);
+static JSON_Status validate_string(const char **string, const char *end);
+static JSON_Status validate_number(const char **string, const char *end);
+static JSON_Status parse_literal(const char **string, const char *end, const char *token,
+                                 size_t token_len);
+static JSON_Status parse_number(const char **string, double *number);
+static JSON_Status parse_number_fast(const char **string, const char *end, double *number);
 
 /* Serialization */
-static int json_serialize_to_buffer_r(const JSON_Value *value, char *buf, int level, int is_pretty,
-                                      char *num_buf);
-static int json_serialize_string(const char *string, char *buf);
-static int append_indent(char *buf, int level);
-static int append_string(char *buf, const char *string);
+static int sink_reserve(JSON_Sink *sink, size_t len);
+static void sink_append(JSON_Sink *sink, const char *string, size_t len);
+static void sink_terminate(JSON_Sink *sink);
+static void sink_init(JSON_Sink *sink, char *buffer, size_t capacity, int growable);
+static JSON_Status serialize_value(JSON_Sink *sink, const JSON_Value *value, int level, int is_pretty);
+static void serialize_string(JSON_Sink *sink, const char *string, size_t len);
+static JSON_Status serialize_number(JSON_Sink *sink, double number);
+static void serialize_indent(JSON_Sink *sink, int level);
+static int serialize_to_buffer(const JSON_Value *value, char *buf, size_t buf_size, int is_pretty);
+static char *serialize_to_string(const JSON_Value *value, int is_pretty);
 
 /* Various */
 static char *parson_strndup(const char *string, size_t n)
 {
-    char *output_string = (char *)parson_malloc(n + 1);
+    char *output_string = (char *)parson_alloc(n + 1);
     if (!output_string) {
         return NULL;
     }
@@ -171,6 +309,170 @@ static char *parson_strdup(const char *string)
     return parson_strndup(string, strlen(string));
 }
 
+/* Allocates document storage, from the arena while an arena document is being parsed */
+static void *parson_alloc(size_t size)
+{
+    return parson_arena != NULL ? arena_alloc(parson_arena, size) : parson_malloc(size);
+}
+
+/* Frees document storage, storage owned by the arena is released with it */
+static void parson_release(const JSON_Arena *arena, void *ptr)
+{
+    if (ptr == NULL || (arena != NULL && arena_owns(arena, ptr))) {
+        return;
+    }
+    parson_free(ptr);
+}
+
+/* Arena */
+static JSON_Arena_Chunk *arena_chunk_new(size_t size)
+{
+    JSON_Arena_Chunk *chunk = NULL;
+    if (parson_spare_chunk != NULL && parson_spare_chunk->size >= size) {
+        chunk = parson_spare_chunk;
+        parson_spare_chunk = NULL;
+    } else {
+        chunk = (JSON_Arena_Chunk *)parson_malloc(ARENA_CHUNK_HEADER_SIZE + size);
+        if (chunk == NULL) {
+            return NULL;
+        }
+        chunk->size = size;
+    }
+    chunk->next = NULL;
+    chunk->used = 0;
+    return chunk;
+}
+
+static JSON_Arena *arena_new(size_t size)
+{
+    JSON_Arena *arena = NULL;
+    JSON_Arena_Chunk *chunk = arena_chunk_new(MAX(size, ARENA_MIN_CHUNK_SIZE) + ARENA_ALIGN(sizeof(JSON_Arena)));
+    if (chunk == NULL) {
+        return NULL;
+    }
+    arena = (JSON_Arena *)((char *)chunk + ARENA_CHUNK_HEADER_SIZE);
+    chunk->used = ARENA_ALIGN(sizeof(JSON_Arena));
+    arena->chunks = chunk;
+    arena->root = NULL;
+    arena->has_foreign = 0;
+    arena->text = NULL;
+    arena->text_size = 0;
+    return arena;
+}
+
+static void *arena_alloc(JSON_Arena *arena, size_t size)
+{
+    JSON_Arena_Chunk *chunk = arena->chunks;
+    size = ARENA_ALIGN(size);
+    if (chunk->size - chunk->used < size) {
+        if (size > chunk->size / 2) {
+            /* a large block gets a chunk of its own behind the head, which keeps serving small ones */
+            chunk = arena_chunk_new(size);
+            if (chunk == NULL) {
+                return NULL;
+            }
+            chunk->next = arena->chunks->next;
+            arena->chunks->next = chunk;
+        } else {
+            chunk = arena_chunk_new(chunk->size * 2);
+            if (chunk == NULL) {
+                return NULL;
+            }
+            chunk->next = arena->chunks;
+            arena->chunks = chunk;
+        }
+    }
+    chunk->used += size;
+    return (char *)chunk + ARENA_CHUNK_HEADER_SIZE + chunk->used - size;
+}
+
+static int arena_owns(const JSON_Arena *arena, const void *ptr)
+{
+    const JSON_Arena_Chunk *chunk = NULL;
+    const char *data = NULL;
+    if (arena->text != NULL && (const char *)ptr >= arena->text && (const char *)ptr < arena->text + arena->text_size) {
+        return 1;
+    }
+    for (chunk = arena->chunks; chunk != NULL; chunk = chunk->next) {
+        data = (const char *)chunk + ARENA_CHUNK_HEADER_SIZE;
+        if ((const char *)ptr >= data && (const char *)ptr < data + chunk->used) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Called when a container gains a member, outside parsing its storage comes from the heap */
+static void arena_note_foreign(const JSON_Value *container)
+{
+    if (container != NULL && container->arena != NULL && container->arena != parson_arena) {
+        container->arena->has_foreign = 1;
+    }
+}
+
+/* Frees the heap allocated parts of an arena value */
+static void arena_free_foreign(JSON_Arena *arena, JSON_Value *value)
+{
+    JSON_Object *object = NULL;
+    JSON_Array *array = NULL;
+    size_t i = 0;
+    switch (value->type) {
+    case JSONObject:
+        object = value->value.object;
+        for (i = 0; i < object->count; i++) {
+            parson_release(arena, object->entries[i].name);
+            if (object->entries[i].value->arena == arena) {
+                arena_free_foreign(arena, object->entries[i].value);
+            } else {
+                json_value_free(object->entries[i].value);
+            }
+        }
+        parson_release(arena, object->entries);
+        parson_release(arena, object->index);
+        object->count = 0;
+        object->capacity = 0;
+        object->entries = NULL;
+        object->index = NULL;
+        object->index_capacity = 0;
+        break;
+    case JSONArray:
+        array = value->value.array;
+        for (i = 0; i < array->count; i++) {
+            if (array->items[i]->arena == arena) {
+                arena_free_foreign(arena, array->items[i]);
+            } else {
+                json_value_free(array->items[i]);
+            }
+        }
+        parson_release(arena, array->items);
+        array->count = 0;
+        array->capacity = 0;
+        array->items = NULL;
+        break;
+    default:
+        break;
+    }
+}
+
+/* Frees the arena's chunks, keeping one small chunk for the next arena parsed on this thread */
+static void arena_destroy(JSON_Arena *arena)
+{
+    JSON_Arena_Chunk *chunk = arena->chunks, *next = NULL;
+    while (chunk != NULL) {
+        next = chunk->next;
+        if (parson_spare_chunk == NULL && chunk->size <= ARENA_SPARE_CHUNK_MAX) {
+            parson_spare_chunk = chunk;
+        } else if (parson_spare_chunk != NULL && chunk->size > parson_spare_chunk->size &&
+                   chunk->size <= ARENA_SPARE_CHUNK_MAX) {
+            parson_free(parson_spare_chunk);
+            parson_spare_chunk = chunk;
+        } else {
+            parson_free(chunk);
+        }
+        chunk = next;
+    }
+}
+
 static int hex_char_to_int(char c)
 {
     if (c >= '0' && c <= '9') {
@@ -257,11 +559,114 @@ static int verify_utf8_sequence(const unsigned char *string, int *len)
     return 1;
 }
 
+/* String scanning kernels, 16 bytes at a time with SSE2 or NEON and a word at a time otherwise. They
+   only load whole chunks before end and finish byte by byte */
+#define SWAR_ONES ((uint64_t)0x0101010101010101ULL)
+#define SWAR_HIGHS ((uint64_t)0x8080808080808080ULL)
+#define SWAR_HAS_ZERO(x) (((x)-SWAR_ONES) & ~(x)&SWAR_HIGHS)
+#define SWAR_HAS_LESS(x, n) (((x)-SWAR_ONES * (n)) & ~(x)&SWAR_HIGHS) /* any byte below n <= 128 */
+
+/* Returns the first quote, backslash, control character or stop character in [ptr, end), or end. The
+   parser passes a quote again for stop, the serializer '/' which it escapes as well */
+static const char *scan_string(const char *ptr, const char *end, char stop)
+{
+#if defined(PARSON_SSE2)
+    const __m128i quote = _mm_set1_epi8('\"'), backslash = _mm_set1_epi8('\\'), other = _mm_set1_epi8(stop);
+    const __m128i sign = _mm_set1_epi8((char)0x80), control = _mm_set1_epi8((char)(0x20 ^ 0x80));
+    __m128i chunk, hits;
+    int mask = 0;
+    while (end - ptr >= 16) {
+        chunk = _mm_loadu_si128((const __m128i *)ptr);
+        /* flipping the sign bit turns the unsigned compare against 0x20 into a signed one */
+        hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+                            _mm_or_si128(_mm_cmpeq_epi8(chunk, other),
+                                         _mm_cmplt_epi8(_mm_xor_si128(chunk, sign), control)));
+        mask = _mm_movemask_epi8(hits);
+        if (mask != 0) {
+            return ptr + __builtin_ctz((unsigned int)mask);
+        }
+        ptr += 16;
+    }
+#elif defined(PARSON_NEON)
+    const uint8x16_t quote = vdupq_n_u8('\"'), backslash = vdupq_n_u8('\\'), other = vdupq_n_u8((uint8_t)stop);
+    const uint8x16_t control = vdupq_n_u8(0x20);
+    uint8x16_t chunk, hits;
+    uint64_t mask = 0;
+    while (end - ptr >= 16) {
+        chunk = vld1q_u8((const uint8_t *)ptr);
+        hits = vorrq_u8(vorrq_u8(vceqq_u8(chunk, quote), vceqq_u8(chunk, backslash)),
+                        vorrq_u8(vceqq_u8(chunk, other), vcltq_u8(chunk, control)));
+        /* ARMv7 has no horizontal reductions, narrowing leaves a nibble per byte */
+        mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(hits), 4)), 0);
+        if (mask != 0) {
+            return ptr + (__builtin_ctzll(mask) >> 2);
+        }
+        ptr += 16;
+    }
+#else
+    uint64_t word = 0;
+    while (end - ptr >= 8) {
+        memcpy(&word, ptr, sizeof(word));
+        if (SWAR_HAS_ZERO(word ^ (SWAR_ONES * '\"')) || SWAR_HAS_ZERO(word ^ (SWAR_ONES * '\\')) ||
+            SWAR_HAS_ZERO(word ^ (SWAR_ONES * (unsigned char)stop)) || SWAR_HAS_LESS(word, 0x20)) {
+            break;
+        }
+        ptr += 8;
+    }
+#endif
+    while (ptr < end && *ptr != '\"' && *ptr != '\\' && *ptr != stop && (unsigned char)*ptr >= 0x20) {
+        ptr++;
+    }
+    return ptr;
+}
+
+/* Returns the first non ASCII character in [ptr, end), or end */
+static const char *scan_ascii(const char *ptr, const char *end)
+{
+#if defined(PARSON_SSE2)
+    int mask = 0;
+    while (end - ptr >= 16) {
+        mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)ptr));
+        if (mask != 0) {
+            return ptr + __builtin_ctz((unsigned int)mask);
+        }
+        ptr += 16;
+    }
+#elif defined(PARSON_NEON)
+    uint8x16_t chunk;
+    while (end - ptr >= 16) {
+        chunk = vld1q_u8((const uint8_t *)ptr);
+        if (vget_lane_u64(vreinterpret_u64_u8(vorr_u8(vget_low_u8(chunk), vget_high_u8(chunk))), 0) &
+            SWAR_HIGHS) {
+            break;
+        }
+        ptr += 16;
+    }
+#else
+    uint64_t word = 0;
+    while (end - ptr >= 8) {
+        memcpy(&word, ptr, sizeof(word));
+        if (word & SWAR_HIGHS) {
+            break;
+        }
+        ptr += 8;
+    }
+#endif
+    while (ptr < end && (unsigned char)*ptr < 0x80) {
+        ptr++;
+    }
+    return ptr;
+}
+
 static int is_valid_utf8(const char *string, size_t string_len)
 {
     int len = 0;
     const char *string_end = string + string_len;
     while (string < string_end) {
+        string = scan_ascii(string, string_end);
+        if (string == string_end) {
+            break;
+        }
         if (!verify_utf8_sequence((const unsigned char *)string, &len)) {
             return 0;
         }
@@ -325,13 +730,14 @@ static void remove_comments(char *string, const char *start_token, const char *e
 /* JSON Object */
 static JSON_Object *json_object_init(JSON_Value *wrapping_value)
 {
-    JSON_Object *new_obj = (JSON_Object *)parson_malloc(sizeof(JSON_Object));
+    JSON_Object *new_obj = (JSON_Object *)parson_alloc(sizeof(JSON_Object));
     if (new_obj == NULL) {
         return NULL;
     }
     new_obj->wrapping_value = wrapping_value;
-    new_obj->names = (char **)NULL;
-    new_obj->values = (JSON_Value **)NULL;
+    new_obj->entries = NULL;
+    new_obj->index = NULL;
+    new_obj->index_capacity = 0;
     new_obj->capacity = 0;
     new_obj->count = 0;
     return new_obj;
@@ -348,11 +754,41 @@ static JSON_Status json_object_add(JSON_Object *object, const char *name, JSON_V
 static JSON_Status json_object_addn(JSON_Object *object, const char *name, size_t name_len,
                                     JSON_Value *value)
 {
-    size_t index = 0;
+    char *name_copy = NULL;
     if (object == NULL || name == NULL || value == NULL) {
         return JSONFailure;
     }
-    if (json_object_getn_value(object, name, name_len) != NULL) {
+    if (json_object_find(object, name, name_len) != object->count) {
+        return JSONFailure;
+    }
+    name_copy = parson_strndup(name, name_len);
+    if (name_copy == NULL) {
+        return JSONFailure;
+    }
+    if (json_object_append(object, name_copy, name_len, value) == JSONFailure) {
+        parson_release(parson_arena, name_copy);
+        return JSONFailure;
+    }
+    arena_note_foreign(object->wrapping_value);
+    return JSONSuccess;
+}
+
+/* Adds a member the parser has already copied the name of, name must come from parson_alloc */
+static JSON_Status json_object_add_owned(JSON_Object *object, char *name, JSON_Value *value)
+{
+    size_t name_len = strlen(name);
+    if (json_object_find(object, name, name_len) != object->count) {
+        return JSONFailure;
+    }
+    return json_object_append(object, name, name_len, value);
+}
+
+/* Appends a member known not to exist, taking ownership of name */
+static JSON_Status json_object_append(JSON_Object *object, char *name, size_t name_len,
+                                      JSON_Value *value)
+{
+    size_t position = object->count;
+    if (name_len > UINT_MAX) {
         return JSONFailure;
     }
     if (object->count >= object->capacity) {
@@ -361,86 +797,193 @@ static JSON_Status json_object_addn(JSON_Object *object, const char *name, size_
             return JSONFailure;
         }
     }
-    index = object->count;
-    object->names[index] = parson_strndup(name, name_len);
-    if (object->names[index] == NULL) {
-        return JSONFailure;
-    }
     value->parent = json_object_get_wrapping_value(object);
-    object->values[index] = value;
+    object->entries[position].name = name;
+    object->entries[position].value = value;
+    object->entries[position].name_length = (unsigned int)name_len;
+    object->entries[position].name_hash = hash_name(name, name_len);
     object->count++;
+    if (object->index != NULL && object->count * 2 <= object->index_capacity) {
+        json_object_index_insert(object, position);
+    } else if (object->count > OBJECT_INDEX_THRESHOLD) {
+        json_object_index_build(object);
+    }
     return JSONSuccess;
 }
 
 static JSON_Status json_object_resize(JSON_Object *object, size_t new_capacity)
 {
-    char **temp_names = NULL;
-    JSON_Value **temp_values = NULL;
+    JSON_Object_Entry *temp_entries = NULL;
 
-    if ((object->names == NULL && object->values != NULL) ||
-        (object->names != NULL && object->values == NULL) || new_capacity == 0) {
+    if (new_capacity == 0 || new_capacity < object->count) {
         return JSONFailure; /* Shouldn't happen */
     }
-    temp_names = (char **)parson_malloc(new_capacity * sizeof(char *));
-    if (temp_names == NULL) {
-        return JSONFailure;
-    }
-    temp_values = (JSON_Value **)parson_malloc(new_capacity * sizeof(JSON_Value *));
-    if (temp_values == NULL) {
-        parson_free(temp_names);
+    temp_entries = (JSON_Object_Entry *)parson_alloc(new_capacity * sizeof(JSON_Object_Entry));
+    if (temp_entries == NULL) {
         return JSONFailure;
     }
-    if (object->names != NULL && object->values != NULL && object->count > 0) {
-        memcpy(temp_names, object->names, object->count * sizeof(char *));
-        memcpy(temp_values, object->values, object->count * sizeof(JSON_Value *));
+    if (object->entries != NULL && object->count > 0) {
+        memcpy(temp_entries, object->entries, object->count * sizeof(JSON_Object_Entry));
     }
-    parson_free(object->names);
-    parson_free(object->values);
-    object->names = temp_names;
-    object->values = temp_values;
+    parson_release(object->wrapping_value->arena, object->entries);
+    object->entries = temp_entries;
     object->capacity = new_capacity;
     return JSONSuccess;
 }
 
-static JSON_Value *json_object_getn_value(const JSON_Object *object, const char *name,
-                                          size_t name_len)
+/* FNV-1a */
+static unsigned int hash_name(const char *name, size_t name_len)
 {
-    size_t i, name_length;
-    for (i = 0; i < json_object_get_count(object); i++) {
-        name_length = strlen(object->names[i]);
-        if (name_length != name_len) {
-            continue;
+    unsigned int hash = 2166136261u;
+    size_t i = 0;
+    for (i = 0; i < name_len; i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* Rebuilds the index at no more than a quarter full. Without an index lookups scan the members, so
+   running out of memory here only costs speed */
+static void json_object_index_build(JSON_Object *object)
+{
+    size_t capacity = 16, i = 0;
+    size_t *index = NULL;
+    while (capacity < object->count * 4) {
+        capacity *= 2;
+    }
+    index = (size_t *)parson_alloc(capacity * sizeof(size_t));
+    parson_release(object->wrapping_value->arena, object->index);
+    object->index = index;
+    object->index_capacity = index != NULL ? capacity : 0;
+    if (index == NULL) {
+        return;
+    }
+    memset(index, 0, capacity * sizeof(size_t));
+    for (i = 0; i < object->count; i++) {
+        json_object_index_insert(object, i);
+    }
+}
+
+/* Cells hold member position + 1, 0 marks an empty cell. Collisions probe linearly */
+static void json_object_index_insert(JSON_Object *object, size_t position)
+{
+    size_t mask = object->index_capacity - 1;
+    size_t cell = object->entries[position].name_hash & mask;
+    while (object->index[cell] != 0) {
+        cell = (cell + 1) & mask;
+    }
+    object->index[cell] = position + 1;
+}
+
+static size_t json_object_index_cell(const JSON_Object *object, size_t position)
+{
+    size_t mask = object->index_capacity - 1;
+    size_t cell = object->entries[position].name_hash & mask;
+    while (object->index[cell] != position + 1) {
+        cell = (cell + 1) & mask;
+    }
+    return cell;
+}
+
+/* Empties the cell of a member and shifts back the cells probed past it */
+static void json_object_index_remove(JSON_Object *object, size_t position)
+{
+    size_t mask = object->index_capacity - 1;
+    size_t cell = json_object_index_cell(object, position);
+    size_t next = (cell + 1) & mask, home = 0;
+    while (object->index[next] != 0) {
+        home = object->entries[object->index[next] - 1].name_hash & mask;
+        /* the member at next may fill the hole unless its home lies cyclically in (cell, next] */
+        if (((next - home) & mask) >= ((next - cell) & mask)) {
+            object->index[cell] = object->index[next];
+            cell = next;
+        }
+        next = (next + 1) & mask;
+    }
+    object->index[cell] = 0;
+}
+
+/* Returns the position of a member, or the member count if there is none */
+static size_t json_object_find(const JSON_Object *object, const char *name, size_t name_len)
+{
+    size_t i = 0;
+    const JSON_Object_Entry *entry = NULL;
+    if (object->index != NULL) {
+        return json_object_find_hashed(object, name, name_len, hash_name(name, name_len));
+    }
+    for (i = 0; i < object->count; i++) {
+        entry = &object->entries[i];
+        if (entry->name_length == name_len && memcmp(entry->name, name, name_len) == 0) {
+            return i;
         }
-        if (strncmp(object->names[i], name, name_len) == 0) {
-            return object->values[i];
+    }
+    return object->count;
+}
+
+/* Finds a member whose name's hash is already known, as it is for compiled paths */
+static size_t json_object_find_hashed(const JSON_Object *object, const char *name, size_t name_len,
+                                      unsigned int hash)
+{
+    size_t i = 0, mask = 0, cell = 0;
+    const JSON_Object_Entry *entry = NULL;
+    if (object->index != NULL) {
+        mask = object->index_capacity - 1;
+        for (cell = hash & mask; object->index[cell] != 0; cell = (cell + 1) & mask) {
+            entry = &object->entries[object->index[cell] - 1];
+            if (entry->name_hash == hash && entry->name_length == name_len && memcmp(entry->name, name, name_len) == 0) {
+                return object->index[cell] - 1;
+            }
         }
+        return object->count;
     }
-    return NULL;
+    for (i = 0; i < object->count; i++) {
+        entry = &object->entries[i];
+        if (entry->name_hash == hash && entry->name_length == name_len && memcmp(entry->name, name, name_len) == 0) {
+            return i;
+        }
+    }
+    return object->count;
+}
+
+static JSON_Value *json_object_getn_value(const JSON_Object *object, const char *name,
+                                          size_t name_len)
+{
+    size_t position = 0;
+    if (object == NULL) {
+        return NULL;
+    }
+    position = json_object_find(object, name, name_len);
+    return position < object->count ? object->entries[position].value : NULL;
 }
 
 static JSON_Status json_object_remove_internal(JSON_Object *object, const char *name,
                                                int free_value)
 {
     size_t i = 0, last_item_index = 0;
-    if (object == NULL || json_object_get_value(object, name) == NULL) {
+    if (object == NULL || name == NULL) {
         return JSONFailure;
     }
-    last_item_index = json_object_get_count(object) - 1;
-    for (i = 0; i < json_object_get_count(object); i++) {
-        if (strcmp(object->names[i], name) == 0) {
-            parson_free(object->names[i]);
-            if (free_value) {
-                json_value_free(object->values[i]);
-            }
-            if (i != last_item_index) { /* Replace key value pair with one from the end */
-                object->names[i] = object->names[last_item_index];
-                object->values[i] = object->values[last_item_index];
-            }
-            object->count -= 1;
-            return JSONSuccess;
+    i = json_object_find(object, name, strlen(name));
+    if (i == object->count) {
+        return JSONFailure;
+    }
+    last_item_index = object->count - 1;
+    parson_release(object->wrapping_value->arena, object->entries[i].name);
+    if (free_value) {
+        json_value_free(object->entries[i].value);
+    }
+    if (object->index != NULL) {
+        json_object_index_remove(object, i);
+        if (i != last_item_index) {
+            object->index[json_object_index_cell(object, last_item_index)] = i + 1;
         }
     }
-    return JSONFailure; /* No execution path should end here */
+    if (i != last_item_index) { /* Replace key value pair with one from the end */
+        object->entries[i] = object->entries[last_item_index];
+    }
+    object->count -= 1;
+    return JSONSuccess;
 }
 
 static JSON_Status json_object_dotremove_internal(JSON_Object *object, const char *name,
@@ -464,18 +1007,18 @@ static void json_object_free(JSON_Object *object)
 {
     size_t i;
     for (i = 0; i < object->count; i++) {
-        parson_free(object->names[i]);
-        json_value_free(object->values[i]);
+        parson_free(object->entries[i].name);
+        json_value_free(object->entries[i].value);
     }
-    parson_free(object->names);
-    parson_free(object->values);
+    parson_free(object->entries);
+    parson_free(object->index);
     parson_free(object);
 }
 
 /* JSON Array */
 static JSON_Array *json_array_init(JSON_Value *wrapping_value)
 {
-    JSON_Array *new_array = (JSON_Array *)parson_malloc(sizeof(JSON_Array));
+    JSON_Array *new_array = (JSON_Array *)parson_alloc(sizeof(JSON_Array));
     if (new_array == NULL) {
         return NULL;
     }
@@ -497,6 +1040,7 @@ static JSON_Status json_array_add(JSON_Array *array, JSON_Value *value)
     value->parent = json_array_get_wrapping_value(array);
     array->items[array->count] = value;
     array->count++;
+    arena_note_foreign(array->wrapping_value);
     return JSONSuccess;
 }
 
@@ -506,14 +1050,14 @@ static JSON_Status json_array_resize(JSON_Array *array, size_t new_capacity)
     if (new_capacity == 0) {
         return JSONFailure;
     }
-    new_items = (JSON_Value **)parson_malloc(new_capacity * sizeof(JSON_Value *));
+    new_items = (JSON_Value **)parson_alloc(new_capacity * sizeof(JSON_Value *));
     if (new_items == NULL) {
         return JSONFailure;
     }
     if (array->items != NULL && array->count > 0) {
         memcpy(new_items, array->items, array->count * sizeof(JSON_Value *));
     }
-    parson_free(array->items);
+    parson_release(array->wrapping_value->arena, array->items);
     array->items = new_items;
     array->capacity = new_capacity;
     return JSONSuccess;
@@ -530,31 +1074,79 @@ static void json_array_free(JSON_Array *array)
 }
 
 /* JSON Value */
+/* Allocates a value with no parent */
+static JSON_Value *value_alloc(JSON_Value_Type type)
+{
+    JSON_Value *new_value = (JSON_Value *)parson_alloc(sizeof(JSON_Value));
+    if (new_value == NULL) {
+        return NULL;
+    }
+    new_value->parent = NULL;
+    new_value->arena = parson_arena;
+    new_value->type = (signed char)type;
+    return new_value;
+}
+
+/* Frees a value whose payload is already released, arena values go with their arena */
+static void value_release(JSON_Value *value)
+{
+    if (value->arena == NULL) {
+        parson_free(value);
+    }
+}
+
 static JSON_Value *json_value_init_string_no_copy(char *string)
 {
-    JSON_Value *new_value = (JSON_Value *)parson_malloc(sizeof(JSON_Value));
+    JSON_Value *new_value = value_alloc(JSONString);
     if (!new_value) {
         return NULL;
     }
-    new_value->parent = NULL;
-    new_value->type = JSONString;
     new_value->value.string = string;
     return new_value;
 }
 
+/* Copies len bytes of string into a new value, short strings are kept in the value itself */
+static JSON_Value *json_value_init_string_copy(const char *string, size_t len)
+{
+    JSON_Value *new_value = NULL;
+    char *copy = NULL;
+    if (len <= VALUE_INLINE_STRING_MAX) {
+        new_value = value_alloc(JSONString);
+        if (new_value == NULL) {
+            return NULL;
+        }
+        memcpy(new_value->short_string, string, len);
+        new_value->short_string[len] = '\0';
+        new_value->value.string = new_value->short_string;
+        return new_value;
+    }
+    copy = parson_strndup(string, len);
+    if (copy == NULL) {
+        return NULL;
+    }
+    new_value = json_value_init_string_no_copy(copy);
+    if (new_value == NULL) {
+        parson_release(parson_arena, copy);
+    }
+    return new_value;
+}
+
 /* Parser */
 static JSON_Status skip_quotes(const char **string)
 {
-    if (**string != '\"') {
+    if (CURRENT_CHAR(string) != '\"') {
         return JSONFailure;
     }
     SKIP_CHAR(string);
-    while (**string != '\"') {
-        if (**string == '\0') {
+    for (;;) {
+        *string = scan_string(*string, parson_parse_end, '\"'); /* control characters are rejected later */
+        if (CURRENT_CHAR(string) == '\"') {
+            break;
+        } else if (CURRENT_CHAR(string) == '\0') {
             return JSONFailure;
-        } else if (**string == '\\') {
+        } else if (CURRENT_CHAR(string) == '\\') {
             SKIP_CHAR(string);
-            if (**string == '\0') {
+            if (CURRENT_CHAR(string) == '\0') {
                 return JSONFailure;
             }
         }
@@ -613,20 +1205,24 @@ static int parse_utf16(const char **unprocessed, char **processed)
     return JSONSuccess;
 }
 
-/* Copies and processes passed string up to supplied length.
+/* Writes the processed string to output, which may be input itself since escape sequences are never
+shorter than the characters they stand for. Returns the end of the output, where a null is written.
 Example: "\u006Corem ipsum" -> lorem ipsum */
-static char *process_string(const char *input, size_t len)
+static char *unescape_string(const char *input, size_t len, char *output)
 {
-    const char *input_ptr = input;
-    size_t initial_size = (len + 1) * sizeof(char);
-    size_t final_size = 0;
-    char *output = NULL, *output_ptr = NULL, *resized_output = NULL;
-    output = (char *)parson_malloc(initial_size);
-    if (output == NULL) {
-        goto error;
-    }
-    output_ptr = output;
-    while ((*input_ptr != '\0') && (size_t)(input_ptr - input) < len) {
+    const char *input_ptr = input, *input_end = input + len, *run_end = NULL;
+    char *output_ptr = output;
+    unsigned int cp = 0;
+    while (input_ptr < input_end) {
+        run_end = scan_string(input_ptr, input_end, '\"');
+        if (output_ptr != input_ptr) {
+            memmove(output_ptr, input_ptr, (size_t)(run_end - input_ptr));
+        }
+        output_ptr += run_end - input_ptr;
+        input_ptr = run_end;
+        if (input_ptr == input_end || *input_ptr == '\0') {
+            break;
+        }
         if (*input_ptr == '\\') {
             input_ptr++;
             switch (*input_ptr) {
@@ -655,16 +1251,19 @@ static char *process_string(const char *input, size_t len)
                 *output_ptr = '\t';
                 break;
             case 'u':
-                if (parse_utf16(&input_ptr, &output_ptr) == JSONFailure) {
-                    goto error;
+                /* the string may not be followed by a null, parse_utf16 must not read past its end */
+                if ((size_t)(input + len - input_ptr) < 5 || !parse_utf16_hex(input_ptr + 1, &cp) ||
+                    (cp >= 0xD800 && cp <= 0xDBFF && (size_t)(input + len - input_ptr) < 11) ||
+                    parse_utf16(&input_ptr, &output_ptr) == JSONFailure) {
+                    return NULL;
                 }
                 break;
             default:
-                goto error;
+                return NULL;
             }
         } else if ((unsigned char)*input_ptr < 0x20) {
-            goto error; /* 0x00-0x19 are invalid characters for json string
-                           (http://www.ietf.org/rfc/rfc4627.txt) */
+            return NULL; /* 0x00-0x19 are invalid characters for json string
+                            (http://www.ietf.org/rfc/rfc4627.txt) */
         } else {
             *output_ptr = *input_ptr;
         }
@@ -672,9 +1271,28 @@ static char *process_string(const char *input, size_t len)
         input_ptr++;
     }
     *output_ptr = '\0';
-    /* resize to new length */
-    final_size = (size_t)(output_ptr - output) + 1;
-    /* todo: don't resize if final_size == initial_size */
+    return output_ptr;
+}
+
+/* Copies and processes passed string up to supplied length. */
+static char *process_string(const char *input, size_t len)
+{
+    size_t initial_size = (len + 1) * sizeof(char);
+    size_t final_size = 0;
+    char *output = NULL, *output_end = NULL, *resized_output = NULL;
+    output = (char *)parson_alloc(initial_size);
+    if (output == NULL) {
+        goto error;
+    }
+    output_end = unescape_string(input, len, output);
+    if (output_end == NULL) {
+        goto error;
+    }
+    /* resize to new length, arena storage can't be given back */
+    final_size = (size_t)(output_end - output) + 1;
+    if (final_size == initial_size || parson_arena != NULL) {
+        return output;
+    }
     resized_output = (char *)parson_malloc(final_size);
     if (resized_output == NULL) {
         goto error;
@@ -683,7 +1301,7 @@ static char *process_string(const char *input, size_t len)
     parson_free(output);
     return resized_output;
 error:
-    parson_free(output);
+    parson_release(parson_arena, output);
     return NULL;
 }
 
@@ -698,6 +1316,12 @@ static char *get_quoted_string(const char **string)
         return NULL;
     }
     string_len = (size_t)(*string - string_start - 2); /* length without quotes */
+    if (parson_arena != NULL && parson_arena->text != NULL) {
+        /* in place parse, the closing quote is already behind the parser and may be overwritten */
+        return unescape_string(string_start + 1, string_len, (char *)string_start + 1) != NULL
+                   ? (char *)string_start + 1
+                   : NULL;
+    }
     return process_string(string_start + 1, string_len);
 }
 
@@ -707,7 +1331,7 @@ static JSON_Value *parse_value(const char **string, size_t nesting)
         return NULL;
     }
     SKIP_WHITESPACES(string);
-    switch (**string) {
+    switch (CURRENT_CHAR(string)) {
     case '{':
         return parse_object_value(string, nesting + 1);
     case '[':
@@ -745,53 +1369,53 @@ static JSON_Value *parse_object_value(const char **string, size_t nesting)
     if (output_value == NULL) {
         return NULL;
     }
-    if (**string != '{') {
+    if (CURRENT_CHAR(string) != '{') {
         json_value_free(output_value);
         return NULL;
     }
     output_object = json_value_get_object(output_value);
     SKIP_CHAR(string);
     SKIP_WHITESPACES(string);
-    if (**string == '}') { /* empty object */
+    if (CURRENT_CHAR(string) == '}') { /* empty object */
         SKIP_CHAR(string);
         return output_value;
     }
-    while (**string != '\0') {
+    while (CURRENT_CHAR(string) != '\0') {
         new_key = get_quoted_string(string);
         if (new_key == NULL) {
             json_value_free(output_value);
             return NULL;
         }
         SKIP_WHITESPACES(string);
-        if (**string != ':') {
-            parson_free(new_key);
+        if (CURRENT_CHAR(string) != ':') {
+            parson_release(parson_arena, new_key);
             json_value_free(output_value);
             return NULL;
         }
         SKIP_CHAR(string);
         new_value = parse_value(string, nesting);
         if (new_value == NULL) {
-            parson_free(new_key);
+            parson_release(parson_arena, new_key);
             json_value_free(output_value);
             return NULL;
         }
-        if (json_object_add(output_object, new_key, new_value) == JSONFailure) {
-            parson_free(new_key);
+        if (json_object_add_owned(output_object, new_key, new_value) == JSONFailure) {
+            parson_release(parson_arena, new_key);
             json_value_free(new_value);
             json_value_free(output_value);
             return NULL;
         }
-        parson_free(new_key);
         SKIP_WHITESPACES(string);
-        if (**string != ',') {
+        if (CURRENT_CHAR(string) != ',') {
             break;
         }
         SKIP_CHAR(string);
         SKIP_WHITESPACES(string);
     }
     SKIP_WHITESPACES(string);
-    if (**string != '}' || /* Trim object after parsing is over */
-        json_object_resize(output_object, json_object_get_count(output_object)) == JSONFailure) {
+    if (CURRENT_CHAR(string) != '}' || /* Trim object after parsing is over, arena storage can't be given back */
+        (parson_arena == NULL &&
+         json_object_resize(output_object, json_object_get_count(output_object)) == JSONFailure)) {
         json_value_free(output_value);
         return NULL;
     }
@@ -807,18 +1431,18 @@ static JSON_Value *parse_array_value(const char **string, size_t nesting)
     if (output_value == NULL) {
         return NULL;
     }
-    if (**string != '[') {
+    if (CURRENT_CHAR(string) != '[') {
         json_value_free(output_value);
         return NULL;
     }
     output_array = json_value_get_array(output_value);
     SKIP_CHAR(string);
     SKIP_WHITESPACES(string);
-    if (**string == ']') { /* empty array */
+    if (CURRENT_CHAR(string) == ']') { /* empty array */
         SKIP_CHAR(string);
         return output_value;
     }
-    while (**string != '\0') {
+    while (CURRENT_CHAR(string) != '\0') {
         new_array_value = parse_value(string, nesting);
         if (new_array_value == NULL) {
             json_value_free(output_value);
@@ -830,15 +1454,16 @@ static JSON_Value *parse_array_value(const char **string, size_t nesting)
             return NULL;
         }
         SKIP_WHITESPACES(string);
-        if (**string != ',') {
+        if (CURRENT_CHAR(string) != ',') {
             break;
         }
         SKIP_CHAR(string);
         SKIP_WHITESPACES(string);
     }
     SKIP_WHITESPACES(string);
-    if (**string != ']' || /* Trim array after parsing is over */
-        json_array_resize(output_array, json_array_get_count(output_array)) == JSONFailure) {
+    if (CURRENT_CHAR(string) != ']' || /* Trim array after parsing is over, arena storage can't be given back */
+        (parson_arena == NULL &&
+         json_array_resize(output_array, json_array_get_count(output_array)) == JSONFailure)) {
         json_value_free(output_value);
         return NULL;
     }
@@ -849,13 +1474,37 @@ static JSON_Value *parse_array_value(const char **string, size_t nesting)
 static JSON_Value *parse_string_value(const char **string)
 {
     JSON_Value *value = NULL;
-    char *new_string = get_quoted_string(string);
+    const char *string_start = *string;
+    size_t string_len = 0;
+    char *new_string = NULL;
+    if (parson_arena == NULL || parson_arena->text == NULL) {
+        if (skip_quotes(string) != JSONSuccess) {
+            return NULL;
+        }
+        string_len = (size_t)(*string - string_start - 2); /* length without quotes */
+        if (string_len <= VALUE_INLINE_STRING_MAX) {
+            /* unescaping never lengthens a string, so short ones are unescaped straight into the value */
+            value = value_alloc(JSONString);
+            if (value == NULL) {
+                return NULL;
+            }
+            if (unescape_string(string_start + 1, string_len, value->short_string) == NULL) {
+                value_release(value);
+                return NULL;
+            }
+            value->value.string = value->short_string;
+            return value;
+        }
+        new_string = process_string(string_start + 1, string_len);
+    } else {
+        new_string = get_quoted_string(string);
+    }
     if (new_string == NULL) {
         return NULL;
     }
     value = json_value_init_string_no_copy(new_string);
     if (value == NULL) {
-        parson_free(new_string);
+        parson_release(parson_arena, new_string);
         return NULL;
     }
     return value;
@@ -863,366 +1512,1100 @@ static JSON_Value *parse_string_value(const char **string)
 
 static JSON_Value *parse_boolean_value(const char **string)
 {
-    size_t true_token_size = SIZEOF_TOKEN("true");
-    size_t false_token_size = SIZEOF_TOKEN("false");
-    if (strncmp("true", *string, true_token_size) == 0) {
-        *string += true_token_size;
+    if (parse_literal(string, parson_parse_end, "true", SIZEOF_TOKEN("true")) == JSONSuccess) {
         return json_value_init_boolean(1);
-    } else if (strncmp("false", *string, false_token_size) == 0) {
-        *string += false_token_size;
+    } else if (parse_literal(string, parson_parse_end, "false", SIZEOF_TOKEN("false")) == JSONSuccess) {
         return json_value_init_boolean(0);
     }
     return NULL;
 }
 
-static JSON_Value *parse_number_value(const char **string)
+/* strtod needs a null terminated copy of the number, which may not be followed by a null in the text */
+static JSON_Status parse_number(const char **string, double *number)
 {
-    char *end;
-    double number = 0;
-    errno = 0;
-    number = strtod(*string, &end);
-    if (errno || !is_decimal(*string, (size_t)(end - *string))) {
-        return NULL;
+    char buf[NUM_BUF_SIZE];
+    char *copy = buf, *end = NULL;
+    const char *ptr = *string;
+    size_t len = 0;
+    JSON_Status status = JSONFailure;
+    if (parse_number_fast(string, parson_parse_end, number) == JSONSuccess) {
+        return JSONSuccess;
     }
-    *string = end;
-    return json_value_init_number(number);
-}
+    while (ptr < parson_parse_end && (isdigit((unsigned char)*ptr) || *ptr == '-' || *ptr == '+' ||
+                                      *ptr == '.' || *ptr == 'e' || *ptr == 'E')) {
+        ptr++;
+    }
+    /* a number running into a name, as in 0x1 or 1abc, is not JSON */
+    if (ptr < parson_parse_end && (isalpha((unsigned char)*ptr) || *ptr == '_')) {
+        return JSONFailure;
+    }
+    len = (size_t)(ptr - *string);
+    if (len >= sizeof(buf) && (copy = (char *)parson_malloc(len + 1)) == NULL) {
+        return JSONFailure;
+    }
+    memcpy(copy, *string, len);
+    copy[len] = '\0';
+    errno = 0;
+    *number = strtod(copy, &end);
+    if (!errno && is_decimal(copy, (size_t)(end - copy))) {
+        *string += end - copy;
+        status = JSONSuccess;
+    }
+    if (copy != buf) {
+        parson_free(copy);
+    }
+    return status;
+}
+
+/* Reads numbers in the JSON grammar with up to 19 significant digits without strtod. Integers are
+   converted directly, which rounds correctly. Others are exact when the digits fit a double's 53 bit
+   mantissa and the power of ten is exact too (up to 1e22), then a single multiplication or division
+   rounds correctly (Clinger's fast path). Everything else, including text strtod would read further,
+   fails without consuming anything and is left to strtod. */
+static JSON_Status parse_number_fast(const char **string, const char *end, double *number)
+{
+    static const double powers_of_ten[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                                           1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                                           1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    const char *ptr = *string;
+    uint64_t mantissa = 0;
+    int negative = 0, digits = 0, exponent = 0, exponent_negative = 0, exponent_digits = 0;
+    double value = 0;
+    if (ptr < end && *ptr == '-') {
+        negative = 1;
+        ptr++;
+    }
+    if (ptr == end || !isdigit((unsigned char)*ptr)) {
+        return JSONFailure;
+    }
+    if (*ptr == '0') {
+        ptr++; /* a digit after a leading 0 is caught below */
+    } else {
+        while (ptr < end && isdigit((unsigned char)*ptr)) {
+            if (digits == 19) {
+                return JSONFailure;
+            }
+            mantissa = mantissa * 10 + (uint64_t)(*ptr - '0');
+            digits++;
+            ptr++;
+        }
+    }
+    if (ptr < end && *ptr == '.') {
+        ptr++;
+        if (ptr == end || !isdigit((unsigned char)*ptr)) {
+            return JSONFailure;
+        }
+        while (ptr < end && isdigit((unsigned char)*ptr)) {
+            if (mantissa != 0 || *ptr != '0') { /* zeros before the first significant digit only scale */
+                if (digits == 19) {
+                    return JSONFailure;
+                }
+                mantissa = mantissa * 10 + (uint64_t)(*ptr - '0');
+                digits++;
+            }
+            exponent--;
+            ptr++;
+        }
+    }
+    if (ptr < end && (*ptr == 'e' || *ptr == 'E')) {
+        ptr++;
+        if (ptr < end && (*ptr == '+' || *ptr == '-')) {
+            exponent_negative = *ptr == '-';
+            ptr++;
+        }
+        if (ptr == end || !isdigit((unsigned char)*ptr)) {
+            return JSONFailure;
+        }
+        while (ptr < end && isdigit((unsigned char)*ptr)) {
+            if (exponent_digits > 999) {
+                return JSONFailure;
+            }
+            exponent_digits = exponent_digits * 10 + (*ptr - '0');
+            ptr++;
+        }
+        exponent += exponent_negative ? -exponent_digits : exponent_digits;
+    }
+    if (ptr < end && (isalnum((unsigned char)*ptr) || *ptr == '_' || *ptr == '.' || *ptr == '+' ||
+                      *ptr == '-')) {
+        return JSONFailure;
+    }
+    if (mantissa == 0 || exponent == 0) {
+        value = (double)mantissa;
+    } else if (mantissa <= ((uint64_t)1 << 53) && exponent >= -22 && exponent <= 22) {
+        value = exponent < 0 ? (double)mantissa / powers_of_ten[-exponent]
+                             : (double)mantissa * powers_of_ten[exponent];
+    } else {
+        return JSONFailure;
+    }
+    *number = negative ? -value : value;
+    *string = ptr;
+    return JSONSuccess;
+}
+
+static JSON_Value *parse_number_value(const char **string)
+{
+    double number = 0;
+    if (parse_number(string, &number) == JSONFailure) {
+        return NULL;
+    }
+    return json_value_init_number(number);
+}
 
 static JSON_Value *parse_null_value(const char **string)
 {
-    size_t token_size = SIZEOF_TOKEN("null");
-    if (strncmp("null", *string, token_size) == 0) {
-        *string += token_size;
+    if (parse_literal(string, parson_parse_end, "null", SIZEOF_TOKEN("null")) == JSONSuccess) {
         return json_value_init_null();
     }
     return NULL;
 }
 
+/* Parses an object keeping only the members selected by filter. Keys of skipped members are not
+   copied and their values are scanned without allocating. */
+static JSON_Value *parse_object_value_filtered(const char **string, size_t nesting, size_t depth,
+                                               JSON_Member_Filter filter, void *context)
+{
+    JSON_Value *output_value = NULL, *new_value = NULL;
+    JSON_Object *output_object = NULL;
+    const char *key_start = NULL;
+    size_t key_len = 0;
+    char *new_key = NULL;
+    int filter_result = JSONFilterSkip;
+    if (nesting > MAX_NESTING || CURRENT_CHAR(string) != '{') {
+        return NULL;
+    }
+    output_value = json_value_init_object();
+    if (output_value == NULL) {
+        return NULL;
+    }
+    output_object = json_value_get_object(output_value);
+    SKIP_CHAR(string);
+    SKIP_WHITESPACES(string);
+    if (CURRENT_CHAR(string) == '}') { /* empty object */
+        SKIP_CHAR(string);
+        return output_value;
+    }
+    while (CURRENT_CHAR(string) != '\0') {
+        key_start = *string;
+        if (skip_quotes(string) != JSONSuccess) {
+            goto error;
+        }
+        /* the filter sees the raw key, escape sequences are not processed */
+        key_len = (size_t)(*string - key_start - 2);
+        filter_result = filter(key_start + 1, key_len, depth, context);
+        SKIP_WHITESPACES(string);
+        if (CURRENT_CHAR(string) != ':') {
+            goto error;
+        }
+        SKIP_CHAR(string);
+        SKIP_WHITESPACES(string);
+        if (filter_result == JSONFilterSkip) {
+            if (skip_value(string, nesting) != JSONSuccess) {
+                goto error;
+            }
+        } else {
+            new_key = process_string(key_start + 1, key_len);
+            if (new_key == NULL) {
+                goto error;
+            }
+            if (filter_result == JSONFilterDescend && CURRENT_CHAR(string) == '{') {
+                new_value = parse_object_value_filtered(string, nesting + 1, depth + 1, filter, context);
+            } else {
+                new_value = parse_value(string, nesting);
+            }
+            if (new_value == NULL || json_object_add_owned(output_object, new_key, new_value) == JSONFailure) {
+                json_value_free(new_value);
+                goto error;
+            }
+            new_key = NULL;
+        }
+        SKIP_WHITESPACES(string);
+        if (CURRENT_CHAR(string) != ',') {
+            break;
+        }
+        SKIP_CHAR(string);
+        SKIP_WHITESPACES(string);
+    }
+    SKIP_WHITESPACES(string);
+    if (CURRENT_CHAR(string) != '}') {
+        goto error;
+    }
+    /* Trim object after parsing is over, every member may have been skipped */
+    if (parson_arena == NULL && json_object_get_count(output_object) > 0 &&
+        json_object_resize(output_object, json_object_get_count(output_object)) == JSONFailure) {
+        goto error;
+    }
+    SKIP_CHAR(string);
+    return output_value;
+error:
+    parson_release(parson_arena, new_key);
+    json_value_free(output_value);
+    return NULL;
+}
+
+/* Advances past a value with the same grammar as parse_value, without building it */
+static JSON_Status skip_value(const char **string, size_t nesting)
+{
+    double number = 0;
+    char close = 0;
+    if (nesting > MAX_NESTING) {
+        return JSONFailure;
+    }
+    SKIP_WHITESPACES(string);
+    switch (CURRENT_CHAR(string)) {
+    case '{':
+    case '[':
+        close = CURRENT_CHAR(string) == '{' ? '}' : ']';
+        SKIP_CHAR(string);
+        SKIP_WHITESPACES(string);
+        if (CURRENT_CHAR(string) == close) {
+            SKIP_CHAR(string);
+            return JSONSuccess;
+        }
+        while (CURRENT_CHAR(string) != '\0') {
+            if (close == '}') {
+                if (skip_quotes(string) != JSONSuccess) {
+                    return JSONFailure;
+                }
+                SKIP_WHITESPACES(string);
+                if (CURRENT_CHAR(string) != ':') {
+                    return JSONFailure;
+                }
+                SKIP_CHAR(string);
+            }
+            if (skip_value(string, nesting + 1) != JSONSuccess) {
+                return JSONFailure;
+            }
+            SKIP_WHITESPACES(string);
+            if (CURRENT_CHAR(string) != ',') {
+                break;
+            }
+            SKIP_CHAR(string);
+            SKIP_WHITESPACES(string);
+        }
+        if (CURRENT_CHAR(string) != close) {
+            return JSONFailure;
+        }
+        SKIP_CHAR(string);
+        return JSONSuccess;
+    case '\"':
+        return skip_quotes(string);
+    case 't':
+        return parse_literal(string, parson_parse_end, "true", SIZEOF_TOKEN("true"));
+    case 'f':
+        return parse_literal(string, parson_parse_end, "false", SIZEOF_TOKEN("false"));
+    case 'n':
+        return parse_literal(string, parson_parse_end, "null", SIZEOF_TOKEN("null"));
+    default:
+        if (CURRENT_CHAR(string) != '-' && !isdigit((unsigned char)CURRENT_CHAR(string))) {
+            return JSONFailure;
+        }
+        return parse_number(string, &number);
+    }
+}
+
+/* Parses a document into an arena. With text (the string itself) names and strings are unescaped in
+   place and point into it, otherwise they are copied into the arena. */
+static JSON_Value *parse_document_arena(const char *string, size_t len, char *text)
+{
+    JSON_Value *value = NULL;
+    JSON_Arena *arena = NULL;
+    parson_parse_end = string + len;
+    if (len >= 3 && string[0] == '\xEF' && string[1] == '\xBB' && string[2] == '\xBF') {
+        string = string + 3; /* Support for UTF-8 BOM */
+    }
+    /* a parsed document takes about 3 (32 bit) to 5 (64 bit) times the size of its text, its values and
+       containers alone about 3 (32 bit) to 6 (64 bit) times when names and strings stay in the text */
+    arena = arena_new(text != NULL ? len * (3 * sizeof(void *) + 1) / 4 : len + len * sizeof(void *) / 2);
+    if (arena == NULL) {
+        return NULL;
+    }
+    arena->text = text;
+    arena->text_size = text != NULL ? len + 1 : 0;
+    parson_arena = arena;
+    value = parse_value((const char **)&string, 0);
+    parson_arena = NULL;
+    if (value == NULL) {
+        arena_destroy(arena);
+        return NULL;
+    }
+    arena->root = value;
+    return value;
+}
+
+/* Reads the string at the quote *string points to without reading past end. Strings without escape
+   sequences are returned in place, others are unescaped into scratch, neither is null terminated. */
+static JSON_Status sax_parse_string(const char **string, const char *end, char *scratch,
+                                    size_t scratch_size, const char **output, size_t *output_len)
+{
+    const char *start = *string + 1, *close = start;
+    char *output_end = NULL;
+    int escaped = 0;
+    for (;;) {
+        close = scan_string(close, end, '\"');
+        if (close == end || *close == '\"') {
+            break;
+        } else if (*close == '\\') {
+            escaped = 1;
+            close++;
+            if (close == end) {
+                return JSONFailure;
+            }
+        } else {
+            return JSONFailure; /* control character */
+        }
+        close++;
+    }
+    if (close == end) {
+        return JSONFailure;
+    }
+    *string = close + 1;
+    if (!escaped) {
+        *output = start;
+        *output_len = (size_t)(close - start);
+        return JSONSuccess;
+    }
+    /* escape sequences are never shorter than the characters they stand for */
+    if (scratch == NULL || (size_t)(close - start) > scratch_size ||
+        (output_end = unescape_string(start, (size_t)(close - start), scratch)) == NULL) {
+        return JSONFailure;
+    }
+    *output = scratch;
+    *output_len = (size_t)(output_end - scratch);
+    return JSONSuccess;
+}
+
+/* strtod needs a null terminated copy of the number, long ones are copied into scratch */
+static JSON_Status sax_parse_number(const char **string, const char *end, char *scratch,
+                                    size_t scratch_size, double *number)
+{
+    char buf[NUM_BUF_SIZE];
+    char *copy = buf, *copy_end = NULL;
+    const char *ptr = *string;
+    size_t len = 0;
+    if (parse_number_fast(string, end, number) == JSONSuccess) {
+        return JSONSuccess;
+    }
+    while (ptr < end && (isdigit((unsigned char)*ptr) || *ptr == '-' || *ptr == '+' || *ptr == '.' ||
+                         *ptr == 'e' || *ptr == 'E')) {
+        ptr++;
+    }
+    if (ptr < end && (isalpha((unsigned char)*ptr) || *ptr == '_')) {
+        return JSONFailure;
+    }
+    len = (size_t)(ptr - *string);
+    if (len >= sizeof(buf)) {
+        if (scratch == NULL || len >= scratch_size) {
+            return JSONFailure;
+        }
+        copy = scratch;
+    }
+    memcpy(copy, *string, len);
+    copy[len] = '\0';
+    errno = 0;
+    *number = strtod(copy, &copy_end);
+    if (errno || copy_end != copy + len || !is_decimal(copy, len)) {
+        return JSONFailure;
+    }
+    *string = ptr;
+    return JSONSuccess;
+}
+
+/* Advances past the string at the quote *string points to, checking its escape sequences and UTF-8
+   without unescaping it */
+static JSON_Status validate_string(const char **string, const char *end)
+{
+    const char *ptr = *string + 1, *run = ptr;
+    unsigned int cp = 0;
+    for (;;) {
+        ptr = scan_string(ptr, end, '\"');
+        /* a run ends before an ASCII character, so its last sequence can't be read past it */
+        if (ptr == end || (unsigned char)*ptr < 0x20 || !is_valid_utf8(run, (size_t)(ptr - run))) {
+            return JSONFailure;
+        }
+        if (*ptr == '\"') {
+            break;
+        }
+        ptr++; /* skips backslash */
+        if (ptr == end) {
+            return JSONFailure;
+        }
+        switch (*ptr) {
+        case '\"':
+        case '\\':
+        case '/':
+        case 'b':
+        case 'f':
+        case 'n':
+        case 'r':
+        case 't':
+            ptr++;
+            break;
+        case 'u':
+            /* surrogates must come in lead, trail pairs as parse_utf16 requires */
+            if (end - ptr < 5 || !parse_utf16_hex(ptr + 1, &cp) || (cp >= 0xDC00 && cp <= 0xDFFF)) {
+                return JSONFailure;
+            }
+            ptr += 5;
+            if (cp >= 0xD800 && cp <= 0xDBFF) {
+                if (end - ptr < 6 || ptr[0] != '\\' || ptr[1] != 'u' || !parse_utf16_hex(ptr + 2, &cp) ||
+                    cp < 0xDC00 || cp > 0xDFFF) {
+                    return JSONFailure;
+                }
+                ptr += 6;
+            }
+            break;
+        default:
+            return JSONFailure;
+        }
+        run = ptr;
+    }
+    *string = ptr + 1;
+    return JSONSuccess;
+}
+
+/* Advances past a number in the JSON grammar, whether or not a double can hold it */
+static JSON_Status validate_number(const char **string, const char *end)
+{
+    const char *ptr = *string;
+    if (ptr < end && *ptr == '-') {
+        ptr++;
+    }
+    if (ptr == end || !isdigit((unsigned char)*ptr)) {
+        return JSONFailure;
+    }
+    if (*ptr == '0') {
+        ptr++; /* no leading zeros */
+    } else {
+        while (ptr < end && isdigit((unsigned char)*ptr)) {
+            ptr++;
+        }
+    }
+    if (ptr < end && *ptr == '.') {
+        ptr++;
+        if (ptr == end || !isdigit((unsigned char)*ptr)) {
+            return JSONFailure;
+        }
+        while (ptr < end && isdigit((unsigned char)*ptr)) {
+            ptr++;
+        }
+    }
+    if (ptr < end && (*ptr == 'e' || *ptr == 'E')) {
+        ptr++;
+        if (ptr < end && (*ptr == '+' || *ptr == '-')) {
+            ptr++;
+        }
+        if (ptr == end || !isdigit((unsigned char)*ptr)) {
+            return JSONFailure;
+        }
+        while (ptr < end && isdigit((unsigned char)*ptr)) {
+            ptr++;
+        }
+    }
+    *string = ptr;
+    return JSONSuccess;
+}
+
+static JSON_Status parse_literal(const char **string, const char *end, const char *token,
+                                 size_t token_len)
+{
+    if ((size_t)(end - *string) < token_len || strncmp(token, *string, token_len) != 0) {
+        return JSONFailure;
+    }
+    *string += token_len;
+    return JSONSuccess;
+}
+
+/* Number formatting
+   Grisu2 (Loitsch, "Printing Floating-Point Numbers Quickly and Accurately with Integers", laid out
+   as in nlohmann/json). A number v = f * 2^e has neighbours m- and m+, and every decimal strictly
+   between the midpoints to them reads back as v. The boundaries are scaled by a cached power of ten
+   so that their integral part fits 32 bits, then digits are generated until the rest falls within the
+   boundaries. The output always reads back to v and is the shortest such text for almost all v. */
+typedef struct diy_fp_t {
+    uint64_t f;
+    int e;
+} Diy_Fp;
+
+typedef struct cached_power_t {
+    uint64_t f;
+    int e;
+    int k;
+} Cached_Power;
+
+static Diy_Fp diy_fp_make(uint64_t f, int e)
+{
+    Diy_Fp x;
+    x.f = f;
+    x.e = e;
+    return x;
+}
+
+/* Upper 64 bits of the 128 bit product, rounded */
+static Diy_Fp diy_fp_mul(Diy_Fp x, Diy_Fp y)
+{
+    uint64_t a = x.f >> 32, b = x.f & 0xFFFFFFFFu, c = y.f >> 32, d = y.f & 0xFFFFFFFFu;
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t middle = (bd >> 32) + (ad & 0xFFFFFFFFu) + (bc & 0xFFFFFFFFu) + ((uint64_t)1 << 31);
+    return diy_fp_make(ac + (ad >> 32) + (bc >> 32) + (middle >> 32), x.e + y.e + 64);
+}
+
+/* bits is a positive, non zero IEEE number with precision significand bits, hidden bit included */
+static void grisu2_boundaries(uint64_t bits, int precision, int bias, Diy_Fp *minus, Diy_Fp *v,
+                              Diy_Fp *plus)
+{
+    uint64_t hidden = (uint64_t)1 << (precision - 1);
+    uint64_t fraction = bits & (hidden - 1);
+    int biased_exponent = (int)(bits >> (precision - 1));
+    Diy_Fp lower;
+    *v = biased_exponent == 0 ? diy_fp_make(fraction, 1 - bias)
+                              : diy_fp_make(fraction + hidden, biased_exponent - bias);
+    /* the gap below a power of two is half the gap above it */
+    lower = fraction == 0 && biased_exponent > 1 ? diy_fp_make(4 * v->f - 1, v->e - 2)
+                                                  : diy_fp_make(2 * v->f - 1, v->e - 1);
+    *plus = diy_fp_make(2 * v->f + 1, v->e - 1);
+    while ((plus->f >> 63) == 0) {
+        plus->f <<= 1;
+        plus->e--;
+    }
+    *minus = diy_fp_make(lower.f << (lower.e - plus->e), plus->e);
+    *v = diy_fp_make(v->f << (v->e - plus->e), plus->e);
+}
+
+/* 10^k for k = -300, -292, ... 324, normalized to 64 bits */
+static Cached_Power grisu2_cached_power(int e)
+{
+    static const Cached_Power cached_powers[] = {
+        {0xAB70FE17C79AC6CAULL, -1060, -300},
+        {0xFF77B1FCBEBCDC4FULL, -1034, -292},
+        {0xBE5691EF416BD60CULL, -1007, -284},
+        {0x8DD01FAD907FFC3CULL, -980, -276},
+        {0xD3515C2831559A83ULL, -954, -268},
+        {0x9D71AC8FADA6C9B5ULL, -927, -260},
+        {0xEA9C227723EE8BCBULL, -901, -252},
+        {0xAECC49914078536DULL, -874, -244},
+        {0x823C12795DB6CE57ULL, -847, -236},
+        {0xC21094364DFB5637ULL, -821, -228},
+        {0x9096EA6F3848984FULL, -794, -220},
+        {0xD77485CB25823AC7ULL, -768, -212},
+        {0xA086CFCD97BF97F4ULL, -741, -204},
+        {0xEF340A98172AACE5ULL, -715, -196},
+        {0xB23867FB2A35B28EULL, -688, -188},
+        {0x84C8D4DFD2C63F3BULL, -661, -180},
+        {0xC5DD44271AD3CDBAULL, -635, -172},
+        {0x936B9FCEBB25C996ULL, -608, -164},
+        {0xDBAC6C247D62A584ULL, -582, -156},
+        {0xA3AB66580D5FDAF6ULL, -555, -148},
+        {0xF3E2F893DEC3F126ULL, -529, -140},
+        {0xB5B5ADA8AAFF80B8ULL, -502, -132},
+        {0x87625F056C7C4A8BULL, -475, -124},
+        {0xC9BCFF6034C13053ULL, -449, -116},
+        {0x964E858C91BA2655ULL, -422, -108},
+        {0xDFF9772470297EBDULL, -396, -100},
+        {0xA6DFBD9FB8E5B88FULL, -369, -92},
+        {0xF8A95FCF88747D94ULL, -343, -84},
+        {0xB94470938FA89BCFULL, -316, -76},
+        {0x8A08F0F8BF0F156BULL, -289, -68},
+        {0xCDB02555653131B6ULL, -263, -60},
+        {0x993FE2C6D07B7FACULL, -236, -52},
+        {0xE45C10C42A2B3B06ULL, -210, -44},
+        {0xAA242499697392D3ULL, -183, -36},
+        {0xFD87B5F28300CA0EULL, -157, -28},
+        {0xBCE5086492111AEBULL, -130, -20},
+        {0x8CBCCC096F5088CCULL, -103, -12},
+        {0xD1B71758E219652CULL, -77, -4},
+        {0x9C40000000000000ULL, -50, 4},
+        {0xE8D4A51000000000ULL, -24, 12},
+        {0xAD78EBC5AC620000ULL, 3, 20},
+        {0x813F3978F8940984ULL, 30, 28},
+        {0xC097CE7BC90715B3ULL, 56, 36},
+        {0x8F7E32CE7BEA5C70ULL, 83, 44},
+        {0xD5D238A4ABE98068ULL, 109, 52},
+        {0x9F4F2726179A2245ULL, 136, 60},
+        {0xED63A231D4C4FB27ULL, 162, 68},
+        {0xB0DE65388CC8ADA8ULL, 189, 76},
+        {0x83C7088E1AAB65DBULL, 216, 84},
+        {0xC45D1DF942711D9AULL, 242, 92},
+        {0x924D692CA61BE758ULL, 269, 100},
+        {0xDA01EE641A708DEAULL, 295, 108},
+        {0xA26DA3999AEF774AULL, 322, 116},
+        {0xF209787BB47D6B85ULL, 348, 124},
+        {0xB454E4A179DD1877ULL, 375, 132},
+        {0x865B86925B9BC5C2ULL, 402, 140},
+        {0xC83553C5C8965D3DULL, 428, 148},
+        {0x952AB45CFA97A0B3ULL, 455, 156},
+        {0xDE469FBD99A05FE3ULL, 481, 164},
+        {0xA59BC234DB398C25ULL, 508, 172},
+        {0xF6C69A72A3989F5CULL, 534, 180},
+        {0xB7DCBF5354E9BECEULL, 561, 188},
+        {0x88FCF317F22241E2ULL, 588, 196},
+        {0xCC20CE9BD35C78A5ULL, 614, 204},
+        {0x98165AF37B2153DFULL, 641, 212},
+        {0xE2A0B5DC971F303AULL, 667, 220},
+        {0xA8D9D1535CE3B396ULL, 694, 228},
+        {0xFB9B7CD9A4A7443CULL, 720, 236},
+        {0xBB764C4CA7A44410ULL, 747, 244},
+        {0x8BAB8EEFB6409C1AULL, 774, 252},
+        {0xD01FEF10A657842CULL, 800, 260},
+        {0x9B10A4E5E9913129ULL, 827, 268},
+        {0xE7109BFBA19C0C9DULL, 853, 276},
+        {0xAC2820D9623BF429ULL, 880, 284},
+        {0x80444B5E7AA7CF85ULL, 907, 292},
+        {0xBF21E44003ACDD2DULL, 933, 300},
+        {0x8E679C2F5E44FF8FULL, 960, 308},
+        {0xD433179D9C8CB841ULL, 986, 316},
+        {0x9E19DB92B4E31BA9ULL, 1013, 324}};
+    /* the smallest k with 10^-k * 2^e scaled into 2^-60 .. 2^-32 */
+    int f = -60 - e - 1;
+    int k = (f * 78913) / (1 << 18) + (f > 0);
+    return cached_powers[(300 + k + 7) / 8];
+}
+
+/* Moves the last digit towards v while the digits stay within the boundaries */
+static void grisu2_round(char *digits, int length, uint64_t dist, uint64_t delta, uint64_t rest,
+                         uint64_t ten_k)
+{
+    while (rest < dist && delta - rest >= ten_k &&
+           (rest + ten_k < dist || dist - rest > rest + ten_k - dist)) {
+        digits[length - 1]--;
+        rest += ten_k;
+    }
+}
+
+/* Writes the digits of v, at most 17, and sets v = digits * 10^decimal_exponent */
+static int grisu2_digits(char *digits, int *decimal_exponent, Diy_Fp minus, Diy_Fp v, Diy_Fp plus)
+{
+    Cached_Power cached = grisu2_cached_power(plus.e);
+    Diy_Fp power = diy_fp_make(cached.f, cached.e);
+    Diy_Fp w = diy_fp_mul(v, power), w_minus = diy_fp_mul(minus, power), w_plus = diy_fp_mul(plus, power);
+    /* stay one unit inside the scaled boundaries, which are off by up to one unit */
+    uint64_t upper = w_plus.f - 1, delta = upper - (w_minus.f + 1), dist = upper - w.f;
+    int shift = -w_plus.e, length = 0, n = 1;
+    uint64_t one = (uint64_t)1 << shift, fraction = upper & (one - 1), rest = 0;
+    uint32_t integral = (uint32_t)(upper >> shift), pow10 = 1;
+    *decimal_exponent = -cached.k;
+    while (n < 10 && integral / pow10 >= 10) {
+        pow10 *= 10;
+        n++;
+    }
+    while (n > 0) {
+        digits[length++] = (char)('0' + integral / pow10);
+        integral %= pow10;
+        n--;
+        rest = ((uint64_t)integral << shift) + fraction;
+        if (rest <= delta) {
+            *decimal_exponent += n;
+            grisu2_round(digits, length, dist, delta, rest, (uint64_t)pow10 << shift);
+            return length;
+        }
+        pow10 /= 10;
+    }
+    do {
+        fraction *= 10;
+        digits[length++] = (char)('0' + (fraction >> shift));
+        fraction &= one - 1;
+        delta *= 10;
+        dist *= 10;
+        (*decimal_exponent)--;
+    } while (fraction > delta);
+    grisu2_round(digits, length, dist, delta, fraction, one);
+    return length;
+}
+
+static int format_integer(char *buf, uint64_t value)
+{
+    char digits[20];
+    int length = 0, i = 0;
+    do {
+        digits[length++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    for (i = 0; i < length; i++) {
+        buf[i] = digits[length - 1 - i];
+    }
+    buf[length] = '\0';
+    return length;
+}
+
+/* Lays out digits * 10^decimal_exponent as JavaScript does: plainly up to 21 integral digits, with
+   leading zeros down to 1e-6 and in exponent notation otherwise */
+static int format_decimal(char *buf, const char *digits, int length, int decimal_exponent)
+{
+    char *ptr = buf;
+    int point = length + decimal_exponent, exponent = point - 1;
+    if (decimal_exponent >= 0 && point <= 21) {
+        memcpy(ptr, digits, length);
+        memset(ptr + length, '0', decimal_exponent);
+        ptr += point;
+    } else if (point > 0 && point <= 21) {
+        memcpy(ptr, digits, point);
+        ptr[point] = '.';
+        memcpy(ptr + point + 1, digits + point, length - point);
+        ptr += length + 1;
+    } else if (point > -6 && point <= 0) {
+        *ptr++ = '0';
+        *ptr++ = '.';
+        memset(ptr, '0', -point);
+        memcpy(ptr - point, digits, length);
+        ptr += length - point;
+    } else {
+        *ptr++ = digits[0];
+        if (length > 1) {
+            *ptr++ = '.';
+            memcpy(ptr, digits + 1, length - 1);
+            ptr += length - 1;
+        }
+        *ptr++ = 'e';
+        *ptr++ = exponent < 0 ? '-' : '+';
+        return (int)(ptr - buf) + format_integer(ptr, (uint64_t)(exponent < 0 ? -exponent : exponent));
+    }
+    *ptr = '\0';
+    return (int)(ptr - buf);
+}
+
+int json_format_number(double number, char *buf)
+{
+    uint64_t bits = 0;
+    Diy_Fp minus, v, plus;
+    char digits[20];
+    int length = 0, decimal_exponent = 0, sign = 0;
+    if (number != number || number - number != 0.0) { /* NaN and infinities have no JSON form */
+        return -1;
+    }
+    memcpy(&bits, &number, sizeof(bits));
+    if (bits >> 63) {
+        buf[sign++] = '-';
+        bits &= ~((uint64_t)1 << 63);
+        number = -number;
+    }
+    if (number < 9007199254740992.0 && number == (double)(uint64_t)number) { /* exact below 2^53 */
+        return sign + format_integer(buf + sign, (uint64_t)number);
+    }
+    grisu2_boundaries(bits, 53, 1075, &minus, &v, &plus);
+    length = grisu2_digits(digits, &decimal_exponent, minus, v, plus);
+    return sign + format_decimal(buf + sign, digits, length, decimal_exponent);
+}
+
+int json_format_float(float number, char *buf)
+{
+    uint32_t bits = 0;
+    Diy_Fp minus, v, plus;
+    char digits[20];
+    int length = 0, decimal_exponent = 0, sign = 0;
+    if (number != number || number - number != 0.0f) {
+        return -1;
+    }
+    memcpy(&bits, &number, sizeof(bits));
+    if (bits >> 31) {
+        buf[sign++] = '-';
+        bits &= ~((uint32_t)1 << 31);
+        number = -number;
+    }
+    if (number < 16777216.0f && number == (float)(uint32_t)number) { /* exact below 2^24 */
+        return sign + format_integer(buf + sign, (uint64_t)number);
+    }
+    grisu2_boundaries(bits, 24, 150, &minus, &v, &plus);
+    length = grisu2_digits(digits, &decimal_exponent, minus, v, plus);
+    return sign + format_decimal(buf + sign, digits, length, decimal_exponent);
+}
+
 /* Serialization */
-#define APPEND_STRING(str)                   \
-    do {                                     \
-        written = append_string(buf, (str)); \
-        if (written < 0) {                   \
-            return -1;                       \
-        }                                    \
-        if (buf != NULL) {                   \
-            buf += written;                  \
-        }                                    \
-        written_total += written;            \
-    } while (0)
-
-#define APPEND_INDENT(level)                   \
-    do {                                       \
-        written = append_indent(buf, (level)); \
-        if (written < 0) {                     \
-            return -1;                         \
-        }                                      \
-        if (buf != NULL) {                     \
-            buf += written;                    \
-        }                                      \
-        written_total += written;              \
-    } while (0)
-
-static int json_serialize_to_buffer_r(const JSON_Value *value, char *buf, int level, int is_pretty,
-                                      char *num_buf)
-{
-    const char *key = NULL, *string = NULL;
-    JSON_Value *temp_value = NULL;
+/* Makes room for len more characters and the null character. A fixed sink that is full only counts */
+static int sink_reserve(JSON_Sink *sink, size_t len)
+{
+    size_t new_capacity = sink->capacity > 0 ? sink->capacity : SINK_STARTING_CAPACITY;
+    char *new_buffer = NULL;
+    if (sink->length + len < sink->capacity) {
+        return 1;
+    }
+    if (!sink->growable || sink->failed) {
+        return 0;
+    }
+    while (new_capacity <= sink->length + len) {
+        new_capacity *= 2;
+    }
+    new_buffer = (char *)parson_malloc(new_capacity);
+    if (new_buffer == NULL) {
+        sink->failed = 1;
+        return 0;
+    }
+    if (sink->buffer != NULL) {
+        memcpy(new_buffer, sink->buffer, sink->length);
+        parson_free(sink->buffer);
+    }
+    sink->buffer = new_buffer;
+    sink->capacity = new_capacity;
+    return 1;
+}
+
+static void sink_append(JSON_Sink *sink, const char *string, size_t len)
+{
+    if (sink_reserve(sink, len)) {
+        memcpy(sink->buffer + sink->length, string, len);
+    } else if (!sink->growable && sink->length + 1 < sink->capacity) { /* keep the part that fits */
+        memcpy(sink->buffer + sink->length, string, sink->capacity - 1 - sink->length);
+    }
+    sink->length += len;
+}
+
+/* Null terminates the output, in a fixed sink that overflowed after the last character that fit */
+static void sink_terminate(JSON_Sink *sink)
+{
+    if (sink->length < sink->capacity) {
+        sink->buffer[sink->length] = '\0';
+    } else if (!sink->growable && sink->capacity > 0) {
+        sink->buffer[sink->capacity - 1] = '\0';
+    }
+}
+
+static void sink_init(JSON_Sink *sink, char *buffer, size_t capacity, int growable)
+{
+    sink->buffer = buffer;
+    sink->length = 0;
+    sink->capacity = capacity;
+    sink->growable = growable;
+    sink->failed = 0;
+}
+
+/* Writes in a single pass, running out of memory is left in sink->failed */
+static JSON_Status serialize_value(JSON_Sink *sink, const JSON_Value *value, int level, int is_pretty)
+{
     JSON_Array *array = NULL;
     JSON_Object *object = NULL;
     size_t i = 0, count = 0;
-    double num = 0.0;
-    int written = -1, written_total = 0;
 
     switch (json_value_get_type(value)) {
     case JSONArray:
         array = json_value_get_array(value);
         count = json_array_get_count(array);
-        APPEND_STRING("[");
+        sink_append(sink, "[", 1);
         if (count > 0 && is_pretty) {
-            APPEND_STRING("\n");
+            sink_append(sink, "\n", 1);
         }
         for (i = 0; i < count; i++) {
             if (is_pretty) {
-                APPEND_INDENT(level + 1);
+                serialize_indent(sink, level + 1);
             }
-            temp_value = json_array_get_value(array, i);
-            written = json_serialize_to_buffer_r(temp_value, buf, level + 1, is_pretty, num_buf);
-            if (written < 0) {
-                return -1;
-            }
-            if (buf != NULL) {
-                buf += written;
+            if (serialize_value(sink, array->items[i], level + 1, is_pretty) == JSONFailure) {
+                return JSONFailure;
             }
-            written_total += written;
             if (i < (count - 1)) {
-                APPEND_STRING(",");
+                sink_append(sink, ",", 1);
             }
             if (is_pretty) {
-                APPEND_STRING("\n");
+                sink_append(sink, "\n", 1);
             }
         }
         if (count > 0 && is_pretty) {
-            APPEND_INDENT(level);
+            serialize_indent(sink, level);
         }
-        APPEND_STRING("]");
-        return written_total;
+        sink_append(sink, "]", 1);
+        return JSONSuccess;
     case JSONObject:
         object = json_value_get_object(value);
         count = json_object_get_count(object);
-        APPEND_STRING("{");
+        sink_append(sink, "{", 1);
         if (count > 0 && is_pretty) {
-            APPEND_STRING("\n");
+            sink_append(sink, "\n", 1);
         }
         for (i = 0; i < count; i++) {
-            key = json_object_get_name(object, i);
-            if (key == NULL) {
-                return -1;
-            }
             if (is_pretty) {
-                APPEND_INDENT(level + 1);
-            }
-            written = json_serialize_string(key, buf);
-            if (written < 0) {
-                return -1;
-            }
-            if (buf != NULL) {
-                buf += written;
+                serialize_indent(sink, level + 1);
             }
-            written_total += written;
-            APPEND_STRING(":");
+            serialize_string(sink, object->entries[i].name, object->entries[i].name_length);
             if (is_pretty) {
-                APPEND_STRING(" ");
+                sink_append(sink, ": ", 2);
+            } else {
+                sink_append(sink, ":", 1);
             }
-            temp_value = json_object_get_value(object, key);
-            written = json_serialize_to_buffer_r(temp_value, buf, level + 1, is_pretty, num_buf);
-            if (written < 0) {
-                return -1;
-            }
-            if (buf != NULL) {
-                buf += written;
+            if (serialize_value(sink, object->entries[i].value, level + 1, is_pretty) == JSONFailure) {
+                return JSONFailure;
             }
-            written_total += written;
             if (i < (count - 1)) {
-                APPEND_STRING(",");
+                sink_append(sink, ",", 1);
             }
             if (is_pretty) {
-                APPEND_STRING("\n");
+                sink_append(sink, "\n", 1);
             }
         }
         if (count > 0 && is_pretty) {
-            APPEND_INDENT(level);
+            serialize_indent(sink, level);
         }
-        APPEND_STRING("}");
-        return written_total;
+        sink_append(sink, "}", 1);
+        return JSONSuccess;
     case JSONString:
-        string = json_value_get_string(value);
-        if (string == NULL) {
-            return -1;
-        }
-        written = json_serialize_string(string, buf);
-        if (written < 0) {
-            return -1;
-        }
-        if (buf != NULL) {
-            buf += written;
+        if (value->value.string == NULL) {
+            return JSONFailure;
         }
-        written_total += written;
-        return written_total;
+        serialize_string(sink, value->value.string, strlen(value->value.string));
+        return JSONSuccess;
     case JSONBoolean:
         if (json_value_get_boolean(value)) {
-            APPEND_STRING("true");
+            sink_append(sink, "true", 4);
         } else {
-            APPEND_STRING("false");
+            sink_append(sink, "false", 5);
         }
-        return written_total;
+        return JSONSuccess;
     case JSONNumber:
-        num = json_value_get_number(value);
-        if (buf != NULL) {
-            num_buf = buf;
-        }
-        written = sprintf(num_buf, FLOAT_FORMAT, num);
-        if (written < 0) {
-            return -1;
-        }
-        if (buf != NULL) {
-            buf += written;
-        }
-        written_total += written;
-        return written_total;
+        return serialize_number(sink, json_value_get_number(value));
     case JSONNull:
-        APPEND_STRING("null");
-        return written_total;
+        sink_append(sink, "null", 4);
+        return JSONSuccess;
     case JSONError:
-        return -1;
+        return JSONFailure;
     default:
-        return -1;
+        return JSONFailure;
     }
 }
 
-static int json_serialize_string(const char *string, char *buf)
+/* Copies the runs between characters that need escaping in one go. Escapes '/' too, to make json
+   embeddable in xml\/html */
+static void serialize_string(JSON_Sink *sink, const char *string, size_t len)
 {
-    size_t i = 0, len = strlen(string);
-    char c = '\0';
-    int written = -1, written_total = 0;
-    APPEND_STRING("\"");
-    for (i = 0; i < len; i++) {
-        c = string[i];
+    static const char hex_digits[] = "0123456789abcdef";
+    const char *end = string + len, *run = string, *ptr = NULL;
+    char escape[6] = {'\\', 'u', '0', '0', '0', '0'};
+    unsigned char c = 0;
+    sink_append(sink, "\"", 1);
+    for (;;) {
+        ptr = scan_string(run, end, '/');
+        sink_append(sink, run, (size_t)(ptr - run));
+        if (ptr == end) {
+            break;
+        }
+        c = (unsigned char)*ptr;
+        run = ptr + 1;
         switch (c) {
         case '\"':
-            APPEND_STRING("\\\"");
+            sink_append(sink, "\\\"", 2);
             break;
         case '\\':
-            APPEND_STRING("\\\\");
+            sink_append(sink, "\\\\", 2);
             break;
         case '/':
-            APPEND_STRING("\\/");
-            break; /* to make json embeddable in xml\/html */
+            sink_append(sink, "\\/", 2);
+            break;
         case '\b':
-            APPEND_STRING("\\b");
+            sink_append(sink, "\\b", 2);
             break;
         case '\f':
-            APPEND_STRING("\\f");
+            sink_append(sink, "\\f", 2);
             break;
         case '\n':
-            APPEND_STRING("\\n");
+            sink_append(sink, "\\n", 2);
             break;
         case '\r':
-            APPEND_STRING("\\r");
+            sink_append(sink, "\\r", 2);
             break;
         case '\t':
-            APPEND_STRING("\\t");
-            break;
-        case '\x00':
-            APPEND_STRING("\\u0000");
-            break;
-        case '\x01':
-            APPEND_STRING("\\u0001");
-            break;
-        case '\x02':
-            APPEND_STRING("\\u0002");
-            break;
-        case '\x03':
-            APPEND_STRING("\\u0003");
-            break;
-        case '\x04':
-            APPEND_STRING("\\u0004");
-            break;
-        case '\x05':
-            APPEND_STRING("\\u0005");
-            break;
-        case '\x06':
-            APPEND_STRING("\\u0006");
-            break;
-        case '\x07':
-            APPEND_STRING("\\u0007");
-            break;
-        /* '\x08' duplicate: '\b' */
-        /* '\x09' duplicate: '\t' */
-        /* '\x0a' duplicate: '\n' */
-        case '\x0b':
-            APPEND_STRING("\\u000b");
-            break;
-        /* '\x0c' duplicate: '\f' */
-        /* '\x0d' duplicate: '\r' */
-        case '\x0e':
-            APPEND_STRING("\\u000e");
-            break;
-        case '\x0f':
-            APPEND_STRING("\\u000f");
-            break;
-        case '\x10':
-            APPEND_STRING("\\u0010");
-            break;
-        case '\x11':
-            APPEND_STRING("\\u0011");
-            break;
-        case '\x12':
-            APPEND_STRING("\\u0012");
-            break;
-        case '\x13':
-            APPEND_STRING("\\u0013");
-            break;
-        case '\x14':
-            APPEND_STRING("\\u0014");
-            break;
-        case '\x15':
-            APPEND_STRING("\\u0015");
-            break;
-        case '\x16':
-            APPEND_STRING("\\u0016");
-            break;
-        case '\x17':
-            APPEND_STRING("\\u0017");
-            break;
-        case '\x18':
-            APPEND_STRING("\\u0018");
-            break;
-        case '\x19':
-            APPEND_STRING("\\u0019");
-            break;
-        case '\x1a':
-            APPEND_STRING("\\u001a");
-            break;
-        case '\x1b':
-            APPEND_STRING("\\u001b");
-            break;
-        case '\x1c':
-            APPEND_STRING("\\u001c");
-            break;
-        case '\x1d':
-            APPEND_STRING("\\u001d");
-            break;
-        case '\x1e':
-            APPEND_STRING("\\u001e");
-            break;
-        case '\x1f':
-            APPEND_STRING("\\u001f");
+            sink_append(sink, "\\t", 2);
             break;
         default:
-            if (buf != NULL) {
-                buf[0] = c;
-                buf += 1;
-            }
-            written_total += 1;
+            escape[4] = hex_digits[c >> 4];
+            escape[5] = hex_digits[c & 0xF];
+            sink_append(sink, escape, sizeof(escape));
             break;
         }
     }
-    APPEND_STRING("\"");
-    return written_total;
+    sink_append(sink, "\"", 1);
+}
+
+/* Formats straight into the sink when there is room */
+static JSON_Status serialize_number(JSON_Sink *sink, double number)
+{
+    char num_buf[JSON_NUMBER_BUF_SIZE];
+    int written = 0;
+    if (sink_reserve(sink, JSON_NUMBER_BUF_SIZE)) {
+        written = json_format_number(number, sink->buffer + sink->length);
+        if (written < 0) {
+            return JSONFailure;
+        }
+        sink->length += (size_t)written;
+        return JSONSuccess;
+    }
+    written = json_format_number(number, num_buf);
+    if (written < 0) {
+        return JSONFailure;
+    }
+    sink_append(sink, num_buf, (size_t)written);
+    return JSONSuccess;
 }
 
-static int append_indent(char *buf, int level)
+static void serialize_indent(JSON_Sink *sink, int level)
 {
     int i;
-    int written = -1, written_total = 0;
     for (i = 0; i < level; i++) {
-        APPEND_STRING("    ");
+        sink_append(sink, "    ", 4);
     }
-    return written_total;
 }
 
-static int append_string(char *buf, const char *string)
+/* Parser API */
+JSON_Value *json_parse_string(const char *string)
 {
-    if (buf == NULL) {
-        return (int)strlen(string);
+    if (string == NULL) {
+        return NULL;
     }
-    return sprintf(buf, "%s", string);
+    return json_parse_buffer(string, strlen(string));
 }
 
-#undef APPEND_STRING
-#undef APPEND_INDENT
+JSON_Value *json_parse_buffer(const char *buffer, size_t length)
+{
+    if (buffer == NULL) {
+        return NULL;
+    }
+    parson_parse_end = buffer + length;
+    if (length >= 3 && buffer[0] == '\xEF' && buffer[1] == '\xBB' && buffer[2] == '\xBF') {
+        buffer = buffer + 3; /* Support for UTF-8 BOM */
+    }
+    return parse_value((const char **)&buffer, 0);
+}
 
-/* Parser API */
-JSON_Value *json_parse_string(const char *string)
+JSON_Value *json_parse_string_filtered(const char *string, JSON_Member_Filter filter, void *context)
 {
     if (string == NULL) {
         return NULL;
     }
-    if (string[0] == '\xEF' && string[1] == '\xBB' && string[2] == '\xBF') {
-        string = string + 3; /* Support for UTF-8 BOM */
+    return json_parse_buffer_filtered(string, strlen(string), filter, context);
+}
+
+JSON_Value *json_parse_buffer_filtered(const char *buffer, size_t length, JSON_Member_Filter filter,
+                                       void *context)
+{
+    if (buffer == NULL) {
+        return NULL;
+    }
+    parson_parse_end = buffer + length;
+    if (length >= 3 && buffer[0] == '\xEF' && buffer[1] == '\xBB' && buffer[2] == '\xBF') {
+        buffer = buffer + 3; /* Support for UTF-8 BOM */
+    }
+    SKIP_WHITESPACES(&buffer);
+    if (filter == NULL || CURRENT_CHAR(&buffer) != '{') {
+        return parse_value((const char **)&buffer, 0);
+    }
+    return parse_object_value_filtered((const char **)&buffer, 1, 0, filter, context);
+}
+
+JSON_Value *json_parse_string_arena(const char *string)
+{
+    if (string == NULL) {
+        return NULL;
+    }
+    return parse_document_arena(string, strlen(string), NULL);
+}
+
+JSON_Value *json_parse_buffer_arena(const char *buffer, size_t length)
+{
+    if (buffer == NULL) {
+        return NULL;
+    }
+    return parse_document_arena(buffer, length, NULL);
+}
+
+JSON_Value *json_parse_string_insitu(char *string)
+{
+    if (string == NULL) {
+        return NULL;
     }
-    return parse_value((const char **)&string, 0);
+    return parse_document_arena(string, strlen(string), string);
 }
 
 JSON_Value *json_parse_string_with_comments(const char *string)
@@ -1236,11 +2619,237 @@ JSON_Value *json_parse_string_with_comments(const char *string)
     remove_comments(string_mutable_copy, "/*", "*/");
     remove_comments(string_mutable_copy, "//", "\n");
     string_mutable_copy_ptr = string_mutable_copy;
+    parson_parse_end = string_mutable_copy + strlen(string_mutable_copy);
     result = parse_value((const char **)&string_mutable_copy_ptr, 0);
     parson_free(string_mutable_copy);
     return result;
 }
 
+#define SAX_SKIP_WHITESPACES(str, end)                         \
+    while (*str < end && isspace((unsigned char)(**str))) { \
+        SKIP_CHAR(str);                                     \
+    }
+#define SAX_EVENT(callback, call)                                  \
+    if (handler->callback != NULL && handler->call != JSONSuccess) { \
+        return JSONFailure;                                        \
+    }
+
+JSON_Status json_sax_parse(const char *string, size_t length, const JSON_Sax_Handler *handler,
+                           void *context, char *scratch, size_t scratch_size)
+{
+    /* one bit per open container, set for objects */
+    unsigned char objects[MAX_NESTING / 8];
+    const char *end = NULL, *text = NULL;
+    size_t depth = 0, text_len = 0;
+    double number = 0;
+    int expect_key = 0, is_object = 0, boolean = 0;
+    if (string == NULL || handler == NULL) {
+        return JSONFailure;
+    }
+    end = string + length;
+    if (length >= 3 && string[0] == '\xEF' && string[1] == '\xBB' && string[2] == '\xBF') {
+        string = string + 3; /* Support for UTF-8 BOM */
+    }
+    for (;;) {
+        SAX_SKIP_WHITESPACES(&string, end);
+        if (string == end) {
+            return JSONFailure;
+        }
+        if (expect_key) {
+            if (*string != '\"' ||
+                sax_parse_string(&string, end, scratch, scratch_size, &text, &text_len) != JSONSuccess) {
+                return JSONFailure;
+            }
+            SAX_EVENT(key, key(text, text_len, context))
+            SAX_SKIP_WHITESPACES(&string, end);
+            if (string == end || *string != ':') {
+                return JSONFailure;
+            }
+            SKIP_CHAR(&string);
+            expect_key = 0;
+            continue;
+        }
+        switch (*string) {
+        case '{':
+        case '[':
+            if (depth == MAX_NESTING) {
+                return JSONFailure;
+            }
+            is_object = *string == '{';
+            if (is_object) {
+                objects[depth / 8] |= (unsigned char)(1 << (depth % 8));
+                SAX_EVENT(begin_object, begin_object(context))
+            } else {
+                objects[depth / 8] &= (unsigned char)~(1 << (depth % 8));
+                SAX_EVENT(begin_array, begin_array(context))
+            }
+            depth++;
+            SKIP_CHAR(&string);
+            SAX_SKIP_WHITESPACES(&string, end);
+            if (string < end && *string == (is_object ? '}' : ']')) {
+                break; /* empty, closed below */
+            }
+            expect_key = is_object;
+            continue;
+        case '\"':
+            if (sax_parse_string(&string, end, scratch, scratch_size, &text, &text_len) != JSONSuccess) {
+                return JSONFailure;
+            }
+            SAX_EVENT(string, string(text, text_len, context))
+            break;
+        case 't':
+        case 'f':
+            boolean = *string == 't';
+            if (parse_literal(&string, end, boolean ? "true" : "false",
+                                  boolean ? SIZEOF_TOKEN("true") : SIZEOF_TOKEN("false")) != JSONSuccess) {
+                return JSONFailure;
+            }
+            SAX_EVENT(boolean, boolean(boolean, context))
+            break;
+        case 'n':
+            if (parse_literal(&string, end, "null", SIZEOF_TOKEN("null")) != JSONSuccess) {
+                return JSONFailure;
+            }
+            SAX_EVENT(null, null(context))
+            break;
+        default:
+            if ((*string != '-' && !isdigit((unsigned char)*string)) ||
+                sax_parse_number(&string, end, scratch, scratch_size, &number) != JSONSuccess) {
+                return JSONFailure;
+            }
+            SAX_EVENT(number, number(number, context))
+            break;
+        }
+        /* a value is complete, close the containers it completes */
+        for (;;) {
+            if (depth == 0) {
+                return JSONSuccess;
+            }
+            is_object = (objects[(depth - 1) / 8] >> ((depth - 1) % 8)) & 1;
+            SAX_SKIP_WHITESPACES(&string, end);
+            if (string == end) {
+                return JSONFailure;
+            }
+            if (*string == ',') {
+                SKIP_CHAR(&string);
+                expect_key = is_object;
+                break;
+            }
+            if (*string != (is_object ? '}' : ']')) {
+                return JSONFailure;
+            }
+            SKIP_CHAR(&string);
+            depth--;
+            if (is_object) {
+                SAX_EVENT(end_object, end_object(context))
+            } else {
+                SAX_EVENT(end_array, end_array(context))
+            }
+        }
+    }
+}
+
+JSON_Status json_validate_syntax(const char *string, size_t length)
+{
+    /* one bit per open container, set for objects */
+    unsigned char objects[MAX_NESTING / 8];
+    const char *end = NULL;
+    size_t depth = 0;
+    int expect_key = 0, is_object = 0;
+    if (string == NULL) {
+        return JSONFailure;
+    }
+    end = string + length;
+    for (;;) {
+        SAX_SKIP_WHITESPACES(&string, end);
+        if (string == end) {
+            return JSONFailure;
+        }
+        if (expect_key) {
+            if (*string != '\"' || validate_string(&string, end) != JSONSuccess) {
+                return JSONFailure;
+            }
+            SAX_SKIP_WHITESPACES(&string, end);
+            if (string == end || *string != ':') {
+                return JSONFailure;
+            }
+            SKIP_CHAR(&string);
+            expect_key = 0;
+            continue;
+        }
+        switch (*string) {
+        case '{':
+        case '[':
+            if (depth == MAX_NESTING) {
+                return JSONFailure;
+            }
+            is_object = *string == '{';
+            if (is_object) {
+                objects[depth / 8] |= (unsigned char)(1 << (depth % 8));
+            } else {
+                objects[depth / 8] &= (unsigned char)~(1 << (depth % 8));
+            }
+            depth++;
+            SKIP_CHAR(&string);
+            SAX_SKIP_WHITESPACES(&string, end);
+            if (string < end && *string == (is_object ? '}' : ']')) {
+                break; /* empty, closed below */
+            }
+            expect_key = is_object;
+            continue;
+        case '\"':
+            if (validate_string(&string, end) != JSONSuccess) {
+                return JSONFailure;
+            }
+            break;
+        case 't':
+            if (parse_literal(&string, end, "true", SIZEOF_TOKEN("true")) != JSONSuccess) {
+                return JSONFailure;
+            }
+            break;
+        case 'f':
+            if (parse_literal(&string, end, "false", SIZEOF_TOKEN("false")) != JSONSuccess) {
+                return JSONFailure;
+            }
+            break;
+        case 'n':
+            if (parse_literal(&string, end, "null", SIZEOF_TOKEN("null")) != JSONSuccess) {
+                return JSONFailure;
+            }
+            break;
+        default:
+            if (validate_number(&string, end) != JSONSuccess) {
+                return JSONFailure;
+            }
+            break;
+        }
+        /* a value is complete, close the containers it completes */
+        for (;;) {
+            SAX_SKIP_WHITESPACES(&string, end);
+            if (depth == 0) {
+                return string == end ? JSONSuccess : JSONFailure;
+            }
+            is_object = (objects[(depth - 1) / 8] >> ((depth - 1) % 8)) & 1;
+            if (string == end) {
+                return JSONFailure;
+            }
+            if (*string == ',') {
+                SKIP_CHAR(&string);
+                expect_key = is_object;
+                break;
+            }
+            if (*string != (is_object ? '}' : ']')) {
+                return JSONFailure;
+            }
+            SKIP_CHAR(&string);
+            depth--;
+        }
+    }
+}
+
+#undef SAX_SKIP_WHITESPACES
+#undef SAX_EVENT
+
 /* JSON Object API */
 
 JSON_Value *json_object_get_value(const JSON_Object *object, const char *name)
@@ -1292,73 +2901,239 @@ const char *json_object_dotget_string(const JSON_Object *object, const char *nam
     return json_value_get_string(json_object_dotget_value(object, name));
 }
 
-double json_object_dotget_number(const JSON_Object *object, const char *name)
+double json_object_dotget_number(const JSON_Object *object, const char *name)
+{
+    return json_value_get_number(json_object_dotget_value(object, name));
+}
+
+JSON_Object *json_object_dotget_object(const JSON_Object *object, const char *name)
+{
+    return json_value_get_object(json_object_dotget_value(object, name));
+}
+
+JSON_Array *json_object_dotget_array(const JSON_Object *object, const char *name)
+{
+    return json_value_get_array(json_object_dotget_value(object, name));
+}
+
+int json_object_dotget_boolean(const JSON_Object *object, const char *name)
+{
+    return json_value_get_boolean(json_object_dotget_value(object, name));
+}
+
+size_t json_object_get_count(const JSON_Object *object)
+{
+    return object ? object->count : 0;
+}
+
+const char *json_object_get_name(const JSON_Object *object, size_t index)
+{
+    if (object == NULL || index >= json_object_get_count(object)) {
+        return NULL;
+    }
+    return object->entries[index].name;
+}
+
+JSON_Value *json_object_get_value_at(const JSON_Object *object, size_t index)
+{
+    if (object == NULL || index >= json_object_get_count(object)) {
+        return NULL;
+    }
+    return object->entries[index].value;
+}
+
+JSON_Value *json_object_get_wrapping_value(const JSON_Object *object)
+{
+    return object->wrapping_value;
+}
+
+int json_object_has_value(const JSON_Object *object, const char *name)
+{
+    return json_object_get_value(object, name) != NULL;
+}
+
+int json_object_has_value_of_type(const JSON_Object *object, const char *name, JSON_Value_Type type)
+{
+    JSON_Value *val = json_object_get_value(object, name);
+    return val != NULL && json_value_get_type(val) == type;
+}
+
+int json_object_dothas_value(const JSON_Object *object, const char *name)
 {
-    return json_value_get_number(json_object_dotget_value(object, name));
+    return json_object_dotget_value(object, name) != NULL;
 }
 
-JSON_Object *json_object_dotget_object(const JSON_Object *object, const char *name)
+int json_object_dothas_value_of_type(const JSON_Object *object, const char *name,
+                                     JSON_Value_Type type)
 {
-    return json_value_get_object(json_object_dotget_value(object, name));
+    JSON_Value *val = json_object_dotget_value(object, name);
+    return val != NULL && json_value_get_type(val) == type;
 }
 
-JSON_Array *json_object_dotget_array(const JSON_Object *object, const char *name)
+/* JSON Path API */
+static JSON_Path *json_path_alloc(size_t count, size_t text_size)
 {
-    return json_value_get_array(json_object_dotget_value(object, name));
+    JSON_Path *path = (JSON_Path *)parson_malloc(sizeof(JSON_Path) + count * sizeof(JSON_Path_Segment) + text_size);
+    if (path == NULL) {
+        return NULL;
+    }
+    path->segments = (JSON_Path_Segment *)(path + 1);
+    path->count = count;
+    return path;
 }
 
-int json_object_dotget_boolean(const JSON_Object *object, const char *name)
+static void json_path_set_segment(JSON_Path_Segment *segment, const char *name, size_t name_len)
 {
-    return json_value_get_boolean(json_object_dotget_value(object, name));
+    segment->name = name;
+    segment->name_length = name_len;
+    segment->name_hash = hash_name(name, name_len);
+    segment->is_index = 0;
+    segment->index = 0;
 }
 
-size_t json_object_get_count(const JSON_Object *object)
+JSON_Path *json_path_compile(const char *path)
 {
-    return object ? object->count : 0;
+    JSON_Path *output = NULL;
+    char *text = NULL, *name = NULL, *dot_position = NULL;
+    size_t count = 1, path_len = 0, i = 0;
+    if (path == NULL) {
+        return NULL;
+    }
+    path_len = strlen(path);
+    for (i = 0; i < path_len; i++) {
+        count += path[i] == '.';
+    }
+    output = json_path_alloc(count, path_len + 1);
+    if (output == NULL) {
+        return NULL;
+    }
+    text = (char *)(output->segments + count);
+    memcpy(text, path, path_len + 1);
+    name = text;
+    for (i = 0; i < count; i++) {
+        dot_position = strchr(name, '.');
+        if (dot_position == NULL) {
+            dot_position = name + strlen(name);
+        }
+        json_path_set_segment(&output->segments[i], name, (size_t)(dot_position - name));
+        name = dot_position + 1;
+    }
+    return output;
 }
 
-const char *json_object_get_name(const JSON_Object *object, size_t index)
+JSON_Path *json_path_compile_pointer(const char *pointer)
 {
-    if (object == NULL || index >= json_object_get_count(object)) {
+    JSON_Path *output = NULL;
+    JSON_Path_Segment *segment = NULL;
+    char *text = NULL, *name = NULL;
+    size_t count = 0, pointer_len = 0, i = 0, index = 0;
+    if (pointer == NULL || (pointer[0] != '\0' && pointer[0] != '/')) {
+        return NULL;
+    }
+    pointer_len = strlen(pointer);
+    for (i = 0; i < pointer_len; i++) {
+        count += pointer[i] == '/';
+    }
+    output = json_path_alloc(count, pointer_len + 1);
+    if (output == NULL) {
         return NULL;
     }
-    return object->names[index];
+    /* reference tokens are unescaped into the block, ~1 stands for / and ~0 for ~ */
+    text = (char *)(output->segments + count);
+    segment = output->segments - 1;
+    for (i = 0; i < pointer_len; i++) {
+        if (pointer[i] == '/') {
+            if (segment >= output->segments) {
+                json_path_set_segment(segment, name, (size_t)(text - name));
+            }
+            segment++;
+            name = text;
+        } else if (pointer[i] == '~') {
+            if (pointer[i + 1] != '0' && pointer[i + 1] != '1') {
+                parson_free(output);
+                return NULL;
+            }
+            *text++ = pointer[i + 1] == '0' ? '~' : '/';
+            i++;
+        } else {
+            *text++ = pointer[i];
+        }
+    }
+    if (segment >= output->segments) {
+        json_path_set_segment(segment, name, (size_t)(text - name));
+    }
+    /* "0" and digits without a leading zero also index arrays, "-" (past the last item) never resolves */
+    for (segment = output->segments; segment < output->segments + count; segment++) {
+        if (segment->name_length == 0 || (segment->name[0] == '0' && segment->name_length > 1)) {
+            continue;
+        }
+        index = 0;
+        for (i = 0; i < segment->name_length && isdigit((unsigned char)segment->name[i]); i++) {
+            if (index > ((size_t)-1 - 9) / 10) {
+                break;
+            }
+            index = index * 10 + (size_t)(segment->name[i] - '0');
+        }
+        segment->is_index = i == segment->name_length;
+        segment->index = index;
+    }
+    return output;
 }
 
-JSON_Value *json_object_get_value_at(const JSON_Object *object, size_t index)
+void json_path_free(JSON_Path *path)
 {
-    if (object == NULL || index >= json_object_get_count(object)) {
+    parson_free(path);
+}
+
+JSON_Value *json_path_get_value(const JSON_Value *value, const JSON_Path *path)
+{
+    const JSON_Path_Segment *segment = NULL;
+    const JSON_Object *object = NULL;
+    size_t i = 0, position = 0;
+    if (path == NULL) {
         return NULL;
     }
-    return object->values[index];
+    for (i = 0; i < path->count && value != NULL; i++) {
+        segment = &path->segments[i];
+        switch (value->type) {
+        case JSONObject:
+            object = value->value.object;
+            position = json_object_find_hashed(object, segment->name, segment->name_length, segment->name_hash);
+            value = position < object->count ? object->entries[position].value : NULL;
+            break;
+        case JSONArray:
+            value = segment->is_index ? json_array_get_value(value->value.array, segment->index) : NULL;
+            break;
+        default:
+            return NULL;
+        }
+    }
+    return (JSON_Value *)value;
 }
 
-JSON_Value *json_object_get_wrapping_value(const JSON_Object *object)
+const char *json_path_get_string(const JSON_Value *value, const JSON_Path *path)
 {
-    return object->wrapping_value;
+    return json_value_get_string(json_path_get_value(value, path));
 }
 
-int json_object_has_value(const JSON_Object *object, const char *name)
+double json_path_get_number(const JSON_Value *value, const JSON_Path *path)
 {
-    return json_object_get_value(object, name) != NULL;
+    return json_value_get_number(json_path_get_value(value, path));
 }
 
-int json_object_has_value_of_type(const JSON_Object *object, const char *name, JSON_Value_Type type)
+JSON_Object *json_path_get_object(const JSON_Value *value, const JSON_Path *path)
 {
-    JSON_Value *val = json_object_get_value(object, name);
-    return val != NULL && json_value_get_type(val) == type;
+    return json_value_get_object(json_path_get_value(value, path));
 }
 
-int json_object_dothas_value(const JSON_Object *object, const char *name)
+JSON_Array *json_path_get_array(const JSON_Value *value, const JSON_Path *path)
 {
-    return json_object_dotget_value(object, name) != NULL;
+    return json_value_get_array(json_path_get_value(value, path));
 }
 
-int json_object_dothas_value_of_type(const JSON_Object *object, const char *name,
-                                     JSON_Value_Type type)
+int json_path_get_boolean(const JSON_Value *value, const JSON_Path *path)
 {
-    JSON_Value *val = json_object_dotget_value(object, name);
-    return val != NULL && json_value_get_type(val) == type;
+    return json_value_get_boolean(json_path_get_value(value, path));
 }
 
 /* JSON Array API */
@@ -1443,33 +3218,48 @@ JSON_Value *json_value_get_parent(const JSON_Value *value)
 
 void json_value_free(JSON_Value *value)
 {
+    if (value != NULL && value->arena != NULL) {
+        /* arena values are released with the arena, the root frees the whole document */
+        if (value->arena == parson_arena) {
+            return; /* parse error, the arena is dropped by the parser */
+        }
+        if (value->arena->has_foreign) {
+            arena_free_foreign(value->arena, value);
+        }
+        if (value->arena->root == value) {
+            arena_destroy(value->arena);
+        }
+        return;
+    }
     switch (json_value_get_type(value)) {
     case JSONObject:
         json_object_free(value->value.object);
         break;
     case JSONString:
-        parson_free(value->value.string);
+        if (value->value.string != value->short_string) {
+            parson_free(value->value.string);
+        }
         break;
     case JSONArray:
         json_array_free(value->value.array);
         break;
+    case JSONError:
+        return;
     default:
         break;
     }
-    parson_free(value);
+    value_release(value);
 }
 
 JSON_Value *json_value_init_object(void)
 {
-    JSON_Value *new_value = (JSON_Value *)parson_malloc(sizeof(JSON_Value));
+    JSON_Value *new_value = value_alloc(JSONObject);
     if (!new_value) {
         return NULL;
     }
-    new_value->parent = NULL;
-    new_value->type = JSONObject;
     new_value->value.object = json_object_init(new_value);
     if (!new_value->value.object) {
-        parson_free(new_value);
+        value_release(new_value);
         return NULL;
     }
     return new_value;
@@ -1477,15 +3267,13 @@ JSON_Value *json_value_init_object(void)
 
 JSON_Value *json_value_init_array(void)
 {
-    JSON_Value *new_value = (JSON_Value *)parson_malloc(sizeof(JSON_Value));
+    JSON_Value *new_value = value_alloc(JSONArray);
     if (!new_value) {
         return NULL;
     }
-    new_value->parent = NULL;
-    new_value->type = JSONArray;
     new_value->value.array = json_array_init(new_value);
     if (!new_value->value.array) {
-        parson_free(new_value);
+        value_release(new_value);
         return NULL;
     }
     return new_value;
@@ -1493,8 +3281,6 @@ JSON_Value *json_value_init_array(void)
 
 JSON_Value *json_value_init_string(const char *string)
 {
-    char *copy = NULL;
-    JSON_Value *value;
     size_t string_len = 0;
     if (string == NULL) {
         return NULL;
@@ -1503,15 +3289,7 @@ JSON_Value *json_value_init_string(const char *string)
     if (!is_valid_utf8(string, string_len)) {
         return NULL;
     }
-    copy = parson_strndup(string, string_len);
-    if (copy == NULL) {
-        return NULL;
-    }
-    value = json_value_init_string_no_copy(copy);
-    if (value == NULL) {
-        parson_free(copy);
-    }
-    return value;
+    return json_value_init_string_copy(string, string_len);
 }
 
 JSON_Value *json_value_init_number(double number)
@@ -1520,37 +3298,27 @@ JSON_Value *json_value_init_number(double number)
     if ((number * 0.0) != 0.0) { /* nan and inf test */
         return NULL;
     }
-    new_value = (JSON_Value *)parson_malloc(sizeof(JSON_Value));
+    new_value = value_alloc(JSONNumber);
     if (new_value == NULL) {
         return NULL;
     }
-    new_value->parent = NULL;
-    new_value->type = JSONNumber;
     new_value->value.number = number;
     return new_value;
 }
 
 JSON_Value *json_value_init_boolean(int boolean)
 {
-    JSON_Value *new_value = (JSON_Value *)parson_malloc(sizeof(JSON_Value));
+    JSON_Value *new_value = value_alloc(JSONBoolean);
     if (!new_value) {
         return NULL;
     }
-    new_value->parent = NULL;
-    new_value->type = JSONBoolean;
     new_value->value.boolean = boolean ? 1 : 0;
     return new_value;
 }
 
 JSON_Value *json_value_init_null(void)
 {
-    JSON_Value *new_value = (JSON_Value *)parson_malloc(sizeof(JSON_Value));
-    if (!new_value) {
-        return NULL;
-    }
-    new_value->parent = NULL;
-    new_value->type = JSONNull;
-    return new_value;
+    return value_alloc(JSONNull);
 }
 
 JSON_Value *json_value_deep_copy(const JSON_Value *value)
@@ -1558,7 +3326,6 @@ JSON_Value *json_value_deep_copy(const JSON_Value *value)
     size_t i = 0;
     JSON_Value *return_value = NULL, *temp_value_copy = NULL, *temp_value = NULL;
     const char *temp_string = NULL, *temp_key = NULL;
-    char *temp_string_copy = NULL;
     JSON_Array *temp_array = NULL, *temp_array_copy = NULL;
     JSON_Object *temp_object = NULL, *temp_object_copy = NULL;
 
@@ -1615,15 +3382,7 @@ JSON_Value *json_value_deep_copy(const JSON_Value *value)
         if (temp_string == NULL) {
             return NULL;
         }
-        temp_string_copy = parson_strdup(temp_string);
-        if (temp_string_copy == NULL) {
-            return NULL;
-        }
-        return_value = json_value_init_string_no_copy(temp_string_copy);
-        if (return_value == NULL) {
-            parson_free(temp_string_copy);
-        }
-        return return_value;
+        return json_value_init_string_copy(temp_string, strlen(temp_string));
     case JSONNull:
         return json_value_init_null();
     case JSONError:
@@ -1633,94 +3392,345 @@ JSON_Value *json_value_deep_copy(const JSON_Value *value)
     }
 }
 
+static int serialize_to_buffer(const JSON_Value *value, char *buf, size_t buf_size, int is_pretty)
+{
+    JSON_Sink sink;
+    sink_init(&sink, buf, buf_size, 0);
+    if (serialize_value(&sink, value, 0, is_pretty) == JSONFailure || sink.length > INT_MAX) {
+        sink_terminate(&sink);
+        return -1;
+    }
+    sink_terminate(&sink);
+    return (int)sink.length;
+}
+
+static char *serialize_to_string(const JSON_Value *value, int is_pretty)
+{
+    JSON_Sink sink;
+    sink_init(&sink, NULL, 0, 1);
+    if (serialize_value(&sink, value, 0, is_pretty) == JSONFailure || sink.failed) {
+        parson_free(sink.buffer);
+        return NULL;
+    }
+    sink_terminate(&sink);
+    return sink.buffer;
+}
+
 size_t json_serialization_size(const JSON_Value *value)
 {
-    char num_buf[NUM_BUF_SIZE]; /* recursively allocating buffer on stack is a bad idea, so let's do
-                                   it only once */
-    int res = json_serialize_to_buffer_r(value, NULL, 0, 0, num_buf);
+    int res = serialize_to_buffer(value, NULL, 0, 0);
     return res < 0 ? 0 : (size_t)(res + 1);
 }
 
 JSON_Status json_serialize_to_buffer(const JSON_Value *value, char *buf, size_t buf_size_in_bytes)
 {
-    int written = -1;
-    size_t needed_size_in_bytes = json_serialization_size(value);
-    if (needed_size_in_bytes == 0 || buf_size_in_bytes < needed_size_in_bytes) {
+    int written = serialize_to_buffer(value, buf, buf_size_in_bytes, 0);
+    return written < 0 || (size_t)written >= buf_size_in_bytes ? JSONFailure : JSONSuccess;
+}
+
+int json_serialize_to_buffer_n(const JSON_Value *value, char *buf, size_t buf_size_in_bytes)
+{
+    return serialize_to_buffer(value, buf, buf_size_in_bytes, 0);
+}
+
+char *json_serialize_to_string(const JSON_Value *value)
+{
+    return serialize_to_string(value, 0);
+}
+
+size_t json_serialization_size_pretty(const JSON_Value *value)
+{
+    int res = serialize_to_buffer(value, NULL, 0, 1);
+    return res < 0 ? 0 : (size_t)(res + 1);
+}
+
+JSON_Status json_serialize_to_buffer_pretty(const JSON_Value *value, char *buf,
+                                            size_t buf_size_in_bytes)
+{
+    int written = serialize_to_buffer(value, buf, buf_size_in_bytes, 1);
+    return written < 0 || (size_t)written >= buf_size_in_bytes ? JSONFailure : JSONSuccess;
+}
+
+char *json_serialize_to_string_pretty(const JSON_Value *value)
+{
+    return serialize_to_string(value, 1);
+}
+
+void json_free_serialized_string(char *string)
+{
+    parson_free(string);
+}
+
+/* JSON Writer */
+#define WRITER_LEVEL_OBJECT 0x1
+#define WRITER_LEVEL_HAS_ITEMS 0x2
+#define WRITER_LEVEL_AFTER_KEY 0x4
+
+static JSON_Status writer_fail(JSON_Writer *writer)
+{
+    writer->failed = 1;
+    return JSONFailure;
+}
+
+/* The writer's buffer is lent to a sink for each write, growable unless it is the caller's */
+static void writer_sink(JSON_Writer *writer, JSON_Sink *sink)
+{
+    sink_init(sink, writer->buffer, writer->capacity, !writer->fixed);
+    sink->length = writer->length;
+}
+
+static JSON_Status writer_sink_done(JSON_Writer *writer, JSON_Sink *sink, JSON_Status status)
+{
+    writer->buffer = sink->buffer;
+    writer->capacity = sink->capacity;
+    /* a fixed sink that ran out of room has counted past its capacity */
+    if (status == JSONFailure || sink->failed || (!sink->growable && sink->length >= sink->capacity)) {
+        if (writer->length < writer->capacity) {
+            writer->buffer[writer->length] = '\0';
+        }
+        return writer_fail(writer);
+    }
+    writer->length = sink->length;
+    sink_terminate(sink);
+    return JSONSuccess;
+}
+
+static JSON_Status writer_append(JSON_Writer *writer, const char *string, size_t len)
+{
+    JSON_Sink sink;
+    writer_sink(writer, &sink);
+    sink_append(&sink, string, len);
+    return writer_sink_done(writer, &sink, JSONSuccess);
+}
+
+/* Checks a value may be written at this point and writes the separator before it */
+static JSON_Status writer_begin_value(JSON_Writer *writer)
+{
+    unsigned char *level = NULL;
+    if (writer->failed) {
         return JSONFailure;
     }
-    written = json_serialize_to_buffer_r(value, buf, 0, 0, NULL);
-    if (written < 0) {
+    if (writer->depth == 0) {
+        return writer->length == 0 ? JSONSuccess : writer_fail(writer);
+    }
+    level = &writer->levels[writer->depth - 1];
+    if (*level & WRITER_LEVEL_OBJECT) {
+        if (!(*level & WRITER_LEVEL_AFTER_KEY)) {
+            return writer_fail(writer);
+        }
+        *level &= (unsigned char)~WRITER_LEVEL_AFTER_KEY;
+        return JSONSuccess;
+    }
+    if ((*level & WRITER_LEVEL_HAS_ITEMS) && writer_append(writer, ",", 1) == JSONFailure) {
         return JSONFailure;
     }
+    *level |= WRITER_LEVEL_HAS_ITEMS;
     return JSONSuccess;
 }
 
-char *json_serialize_to_string(const JSON_Value *value)
+static JSON_Status writer_open(JSON_Writer *writer, const char *token, unsigned char flags)
 {
-    JSON_Status serialization_result = JSONFailure;
-    size_t buf_size_bytes = json_serialization_size(value);
-    char *buf = NULL;
-    if (buf_size_bytes == 0) {
-        return NULL;
+    if (writer_begin_value(writer) == JSONFailure) {
+        return JSONFailure;
     }
-    buf = (char *)parson_malloc(buf_size_bytes);
-    if (buf == NULL) {
-        return NULL;
+    if (writer->depth >= JSON_WRITER_MAX_DEPTH) {
+        return writer_fail(writer);
     }
-    serialization_result = json_serialize_to_buffer(value, buf, buf_size_bytes);
-    if (serialization_result == JSONFailure) {
-        json_free_serialized_string(buf);
-        return NULL;
+    if (writer_append(writer, token, 1) == JSONFailure) {
+        return JSONFailure;
     }
-    return buf;
+    writer->levels[writer->depth++] = flags;
+    return JSONSuccess;
 }
 
-size_t json_serialization_size_pretty(const JSON_Value *value)
+static JSON_Status writer_close(JSON_Writer *writer, const char *token, unsigned char flags)
 {
-    char num_buf[NUM_BUF_SIZE]; /* recursively allocating buffer on stack is a bad idea, so let's do
-                                   it only once */
-    int res = json_serialize_to_buffer_r(value, NULL, 0, 1, num_buf);
-    return res < 0 ? 0 : (size_t)(res + 1);
+    if (writer->failed) {
+        return JSONFailure;
+    }
+    if (writer->depth == 0 || (writer->levels[writer->depth - 1] & WRITER_LEVEL_OBJECT) != flags ||
+        (writer->levels[writer->depth - 1] & WRITER_LEVEL_AFTER_KEY)) {
+        return writer_fail(writer);
+    }
+    writer->depth--;
+    return writer_append(writer, token, 1);
 }
 
-JSON_Status json_serialize_to_buffer_pretty(const JSON_Value *value, char *buf,
-                                            size_t buf_size_in_bytes)
+void json_writer_init(JSON_Writer *writer)
+{
+    memset(writer, 0, sizeof(JSON_Writer));
+}
+
+void json_writer_init_buffer(JSON_Writer *writer, char *buf, size_t size)
+{
+    json_writer_init(writer);
+    writer->buffer = buf;
+    writer->capacity = buf != NULL ? size : 0;
+    writer->fixed = 1;
+    if (writer->capacity > 0) {
+        writer->buffer[0] = '\0';
+    }
+}
+
+void json_writer_reset(JSON_Writer *writer)
+{
+    writer->length = 0;
+    writer->depth = 0;
+    writer->failed = 0;
+    if (writer->capacity > 0) {
+        writer->buffer[0] = '\0';
+    }
+}
+
+void json_writer_free(JSON_Writer *writer)
+{
+    if (writer->buffer != NULL && !writer->fixed) {
+        parson_free(writer->buffer);
+    }
+    json_writer_init(writer);
+}
+
+JSON_Status json_writer_begin_object(JSON_Writer *writer)
+{
+    return writer_open(writer, "{", WRITER_LEVEL_OBJECT);
+}
+
+JSON_Status json_writer_end_object(JSON_Writer *writer)
 {
-    int written = -1;
-    size_t needed_size_in_bytes = json_serialization_size_pretty(value);
-    if (needed_size_in_bytes == 0 || buf_size_in_bytes < needed_size_in_bytes) {
+    return writer_close(writer, "}", WRITER_LEVEL_OBJECT);
+}
+
+JSON_Status json_writer_begin_array(JSON_Writer *writer)
+{
+    return writer_open(writer, "[", 0);
+}
+
+JSON_Status json_writer_end_array(JSON_Writer *writer)
+{
+    return writer_close(writer, "]", 0);
+}
+
+JSON_Status json_writer_key(JSON_Writer *writer, const char *name)
+{
+    unsigned char *level = NULL;
+    JSON_Sink sink;
+    if (writer->failed) {
         return JSONFailure;
     }
-    written = json_serialize_to_buffer_r(value, buf, 0, 1, NULL);
-    if (written < 0) {
+    if (name == NULL || writer->depth == 0) {
+        return writer_fail(writer);
+    }
+    level = &writer->levels[writer->depth - 1];
+    if (!(*level & WRITER_LEVEL_OBJECT) || (*level & WRITER_LEVEL_AFTER_KEY)) {
+        return writer_fail(writer);
+    }
+    writer_sink(writer, &sink);
+    if (*level & WRITER_LEVEL_HAS_ITEMS) {
+        sink_append(&sink, ",", 1);
+    }
+    serialize_string(&sink, name, strlen(name));
+    sink_append(&sink, ":", 1);
+    *level |= WRITER_LEVEL_HAS_ITEMS | WRITER_LEVEL_AFTER_KEY;
+    return writer_sink_done(writer, &sink, JSONSuccess);
+}
+
+JSON_Status json_writer_string(JSON_Writer *writer, const char *string)
+{
+    if (string == NULL) {
+        return writer_fail(writer);
+    }
+    return json_writer_string_len(writer, string, strlen(string));
+}
+
+JSON_Status json_writer_string_len(JSON_Writer *writer, const char *string, size_t len)
+{
+    JSON_Sink sink;
+    if (string == NULL) {
+        return writer_fail(writer);
+    }
+    if (writer_begin_value(writer) == JSONFailure) {
         return JSONFailure;
     }
-    return JSONSuccess;
+    writer_sink(writer, &sink);
+    serialize_string(&sink, string, len);
+    return writer_sink_done(writer, &sink, JSONSuccess);
 }
 
-char *json_serialize_to_string_pretty(const JSON_Value *value)
+JSON_Status json_writer_number(JSON_Writer *writer, double number)
 {
-    JSON_Status serialization_result = JSONFailure;
-    size_t buf_size_bytes = json_serialization_size_pretty(value);
-    char *buf = NULL;
-    if (buf_size_bytes == 0) {
-        return NULL;
+    JSON_Sink sink;
+    if (number != number || number - number != 0.0) { /* NaN and infinities have no JSON form */
+        return writer_fail(writer);
     }
-    buf = (char *)parson_malloc(buf_size_bytes);
-    if (buf == NULL) {
-        return NULL;
+    if (writer_begin_value(writer) == JSONFailure) {
+        return JSONFailure;
+    }
+    writer_sink(writer, &sink);
+    return writer_sink_done(writer, &sink, serialize_number(&sink, number));
+}
+
+JSON_Status json_writer_float(JSON_Writer *writer, float number)
+{
+    char buf[JSON_NUMBER_BUF_SIZE];
+    int len = json_format_float(number, buf);
+    if (len < 0) {
+        return writer_fail(writer);
     }
-    serialization_result = json_serialize_to_buffer_pretty(value, buf, buf_size_bytes);
-    if (serialization_result == JSONFailure) {
-        json_free_serialized_string(buf);
+    if (writer_begin_value(writer) == JSONFailure) {
+        return JSONFailure;
+    }
+    return writer_append(writer, buf, (size_t)len);
+}
+
+JSON_Status json_writer_boolean(JSON_Writer *writer, int boolean)
+{
+    if (writer_begin_value(writer) == JSONFailure) {
+        return JSONFailure;
+    }
+    return boolean ? writer_append(writer, "true", 4) : writer_append(writer, "false", 5);
+}
+
+JSON_Status json_writer_null(JSON_Writer *writer)
+{
+    if (writer_begin_value(writer) == JSONFailure) {
+        return JSONFailure;
+    }
+    return writer_append(writer, "null", 4);
+}
+
+JSON_Status json_writer_value(JSON_Writer *writer, const JSON_Value *value)
+{
+    JSON_Sink sink;
+    if (json_value_get_type(value) == JSONError) {
+        return writer_fail(writer);
+    }
+    if (writer_begin_value(writer) == JSONFailure) {
+        return JSONFailure;
+    }
+    writer_sink(writer, &sink);
+    return writer_sink_done(writer, &sink, serialize_value(&sink, value, 0, 0));
+}
+
+const char *json_writer_get_string(const JSON_Writer *writer, size_t *length)
+{
+    if (writer->failed || writer->depth != 0 || writer->length == 0) {
         return NULL;
     }
-    return buf;
+    if (length != NULL) {
+        *length = writer->length;
+    }
+    return writer->buffer;
 }
 
-void json_free_serialized_string(char *string)
+char *json_writer_detach(JSON_Writer *writer, size_t *length)
 {
-    parson_free(string);
+    char *buffer = NULL;
+    if (writer->fixed || json_writer_get_string(writer, length) == NULL) {
+        return NULL;
+    }
+    buffer = writer->buffer;
+    json_writer_init(writer);
+    return buffer;
 }
 
 JSON_Status json_array_remove(JSON_Array *array, size_t ix)
@@ -1745,6 +3755,7 @@ JSON_Status json_array_replace_value(JSON_Array *array, size_t ix, JSON_Value *v
     json_value_free(json_array_get_value(array, ix));
     value->parent = json_array_get_wrapping_value(array);
     array->items[ix] = value;
+    arena_note_foreign(array->wrapping_value);
     return JSONSuccess;
 }
 
@@ -1880,16 +3891,14 @@ JSON_Status json_object_set_value(JSON_Object *object, const char *name, JSON_Va
     if (object == NULL || name == NULL || value == NULL || value->parent != NULL) {
         return JSONFailure;
     }
-    old_value = json_object_get_value(object, name);
-    if (old_value != NULL) { /* free and overwrite old value */
+    i = json_object_find(object, name, strlen(name));
+    if (i < object->count) { /* free and overwrite old value */
+        old_value = object->entries[i].value;
         json_value_free(old_value);
-        for (i = 0; i < json_object_get_count(object); i++) {
-            if (strcmp(object->names[i], name) == 0) {
-                value->parent = json_object_get_wrapping_value(object);
-                object->values[i] = value;
-                return JSONSuccess;
-            }
-        }
+        value->parent = json_object_get_wrapping_value(object);
+        object->entries[i].value = value;
+        arena_note_foreign(object->wrapping_value);
+        return JSONSuccess;
     }
     /* add new key value pair */
     return json_object_add(object, name, value);
@@ -2028,10 +4037,13 @@ JSON_Status json_object_clear(JSON_Object *object)
         return JSONFailure;
     }
     for (i = 0; i < json_object_get_count(object); i++) {
-        parson_free(object->names[i]);
-        json_value_free(object->values[i]);
+        parson_release(object->wrapping_value->arena, object->entries[i].name);
+        json_value_free(object->entries[i].value);
     }
     object->count = 0;
+    if (object->index != NULL) {
+        memset(object->index, 0, object->index_capacity * sizeof(size_t));
+    }
     return JSONSuccess;
 }
 
@@ -2197,6 +4209,10 @@ int json_boolean(const JSON_Value *value)
 
 void json_set_allocation_functions(JSON_Malloc_Function malloc_fun, JSON_Free_Function free_fun)
 {
+    if (parson_spare_chunk != NULL) {
+        parson_free(parson_spare_chunk);
+        parson_spare_chunk = NULL;
+    }
     parson_malloc = malloc_fun;
     parson_free = free_fun;
 }
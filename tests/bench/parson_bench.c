@@ -0,0 +1,339 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+/* Timings of parson on documents shaped like the ones the library handles: a device twin, a batch of
+   telemetry and a message heavy on strings. Each operation is repeated until it has run for a while
+   and the best of several rounds is printed, in microseconds per document.
+
+   parson_bench [rounds]
+
+   Built with the host tests but not run by ctest, build with -DCMAKE_BUILD_TYPE=Release for timings. */
+
+#include "parson.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BATCH 32
+#define MIN_SECONDS_PER_ROUND 0.05
+
+typedef struct {
+    const char *name;
+    char *text;
+    size_t length;
+} Document;
+
+typedef void (*Operation)(const Document *document, void *state);
+
+static double seconds_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
+
+/* Documents */
+
+static char *take_serialized(JSON_Value *value, size_t *length)
+{
+    char *text = json_serialize_to_string(value);
+    *length = strlen(text);
+    json_value_free(value);
+    return text;
+}
+
+/* Desired and reported properties, as sent on connect and on each desired property update */
+static char *make_twin(int properties, size_t *length)
+{
+    JSON_Value *root = json_value_init_object();
+    JSON_Object *object = json_object(root);
+    char path[64];
+    int i;
+
+    for (i = 0; i < properties; i++) {
+        snprintf(path, sizeof(path), "desired.property%d.value", i);
+        json_object_dotset_number(object, path, i * 1.5);
+        snprintf(path, sizeof(path), "desired.property%d.enabled", i);
+        json_object_dotset_boolean(object, path, i % 2);
+        snprintf(path, sizeof(path), "reported.property%d.value", i);
+        json_object_dotset_number(object, path, i * 1.5);
+        snprintf(path, sizeof(path), "reported.property%d.status", i);
+        json_object_dotset_string(object, path, i % 3 ? "completed" : "pending");
+    }
+    json_object_dotset_number(object, "desired.$version", 42);
+    json_object_dotset_number(object, "reported.$version", 7);
+    return take_serialized(root, length);
+}
+
+/* A batch of sensor readings */
+static char *make_telemetry(int readings, size_t *length)
+{
+    JSON_Value *root = json_value_init_array();
+    int i;
+
+    for (i = 0; i < readings; i++) {
+        JSON_Value *reading = json_value_init_object();
+        json_object_set_number(json_object(reading), "temperature", 20 + (i % 50) * 0.137);
+        json_object_set_number(json_object(reading), "humidity", 40 + (i % 30) * 0.91);
+        json_object_set_number(json_object(reading), "pressure", 1000 + (i % 20) * 1.3);
+        json_object_set_number(json_object(reading), "timestamp", 1700000000.0 + i);
+        json_object_set_string(json_object(reading), "deviceId", "sensor-node-01");
+        json_array_append_value(json_array(root), reading);
+    }
+    return take_serialized(root, length);
+}
+
+/* Long strings, some with characters that need escaping, as in cloud to device messages */
+static char *make_strings(int messages, size_t *length)
+{
+    JSON_Value *root = json_value_init_object();
+    JSON_Array *array = NULL;
+    char text[256];
+    int i, j;
+
+    json_object_set_value(json_object(root), "messages", json_value_init_array());
+    array = json_object_get_array(json_object(root), "messages");
+    for (i = 0; i < messages; i++) {
+        for (j = 0; j < (int)sizeof(text) - 1; j++) {
+            text[j] = (char)('a' + (i + j) % 26);
+        }
+        text[sizeof(text) - 1] = '\0';
+        if (i % 4 == 0) {
+            text[i % 200] = '"';
+            text[i % 200 + 20] = '\n';
+        }
+        json_array_append_string(array, text);
+    }
+    return take_serialized(root, length);
+}
+
+/* Operations, each handles one document */
+
+static void op_parse_string(const Document *document, void *state)
+{
+    (void)state;
+    json_value_free(json_parse_string(document->text));
+}
+
+static void op_parse_buffer(const Document *document, void *state)
+{
+    (void)state;
+    json_value_free(json_parse_buffer(document->text, document->length));
+}
+
+static void op_parse_arena(const Document *document, void *state)
+{
+    (void)state;
+    json_value_free(json_parse_buffer_arena(document->text, document->length));
+}
+
+static void op_parse_insitu(const Document *document, void *state)
+{
+    char *copy = (char *)state;
+    memcpy(copy, document->text, document->length + 1);
+    json_value_free(json_parse_string_insitu(copy));
+}
+
+static void op_copy_only(const Document *document, void *state)
+{
+    memcpy((char *)state, document->text, document->length + 1);
+}
+
+static int keep_desired(const char *name, size_t name_len, size_t depth, void *context)
+{
+    (void)depth;
+    (void)context;
+    return name_len == 7 && memcmp(name, "desired", 7) == 0 ? JSONFilterKeep : JSONFilterSkip;
+}
+
+static void op_parse_filtered(const Document *document, void *state)
+{
+    (void)state;
+    json_value_free(json_parse_buffer_filtered(document->text, document->length, keep_desired, NULL));
+}
+
+static void op_validate(const Document *document, void *state)
+{
+    (void)state;
+    if (json_validate_syntax(document->text, document->length) != JSONSuccess) {
+        printf("%s failed to validate\n", document->name);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static JSON_Status count_event(void *context)
+{
+    (*(size_t *)context)++;
+    return JSONSuccess;
+}
+
+static JSON_Status count_text(const char *text, size_t length, void *context)
+{
+    (void)text;
+    (void)length;
+    (*(size_t *)context)++;
+    return JSONSuccess;
+}
+
+static JSON_Status count_number(double number, void *context)
+{
+    (void)number;
+    (*(size_t *)context)++;
+    return JSONSuccess;
+}
+
+static JSON_Status count_boolean(int boolean, void *context)
+{
+    (void)boolean;
+    (*(size_t *)context)++;
+    return JSONSuccess;
+}
+
+static const JSON_Sax_Handler counting_handler = {count_event, count_event,  count_event,   count_event, count_text,
+                                                  count_text,  count_number, count_boolean, count_event};
+
+static void op_sax(const Document *document, void *state)
+{
+    static char scratch[1024];
+    size_t events = 0;
+    (void)state;
+    json_sax_parse(document->text, document->length, &counting_handler, &events, scratch, sizeof(scratch));
+}
+
+static void op_serialize(const Document *document, void *state)
+{
+    json_free_serialized_string(json_serialize_to_string((const JSON_Value *)state));
+    (void)document;
+}
+
+static void op_serialize_buffer(const Document *document, void *state)
+{
+    static char buf[1 << 20];
+    json_serialize_to_buffer_n((const JSON_Value *)state, buf, sizeof(buf));
+    (void)document;
+}
+
+typedef struct {
+    const JSON_Value *root;
+    JSON_Writer writer; /* reset between calls, so its buffer is reused as an application would */
+} Writing;
+
+static void op_writer(const Document *document, void *state)
+{
+    Writing *writing = (Writing *)state;
+    json_writer_reset(&writing->writer);
+    json_writer_value(&writing->writer, writing->root);
+    (void)document;
+}
+
+typedef struct {
+    const JSON_Value *root;
+    JSON_Path *compiled;
+} Lookup;
+
+static void op_dotget(const Document *document, void *state)
+{
+    const Lookup *lookup = (const Lookup *)state;
+    if (json_object_dotget_value(json_object(lookup->root), "desired.property7.value") == NULL) {
+        printf("%s has no desired.property7.value\n", document->name);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void op_path(const Document *document, void *state)
+{
+    const Lookup *lookup = (const Lookup *)state;
+    if (json_path_get_value(lookup->root, lookup->compiled) == NULL) {
+        printf("%s has no desired.property7.value\n", document->name);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* Best of rounds, in microseconds per call */
+static double time_operation(const Document *document, Operation operation, void *state, int rounds)
+{
+    double best = 1e30, start, elapsed;
+    long calls, i;
+    int round;
+
+    for (round = 0; round < rounds; round++) {
+        calls = 0;
+        start = seconds_now();
+        do {
+            for (i = 0; i < BATCH; i++) {
+                operation(document, state);
+            }
+            calls += BATCH;
+            elapsed = seconds_now() - start;
+        } while (elapsed < MIN_SECONDS_PER_ROUND);
+        if (elapsed / (double)calls < best) {
+            best = elapsed / (double)calls;
+        }
+    }
+    return best * 1e6;
+}
+
+static void run_document(const Document *document, int rounds)
+{
+    JSON_Value *root = json_parse_buffer(document->text, document->length);
+    char *copy = (char *)malloc(document->length + 1);
+    Lookup lookup;
+    Writing writing;
+    double copy_time = 0;
+
+    printf("%s, %zu bytes\n", document->name, document->length);
+    printf("  parse string     %10.2f\n", time_operation(document, op_parse_string, NULL, rounds));
+    printf("  parse buffer     %10.2f\n", time_operation(document, op_parse_buffer, NULL, rounds));
+    printf("  parse arena      %10.2f\n", time_operation(document, op_parse_arena, NULL, rounds));
+    copy_time = time_operation(document, op_copy_only, copy, rounds);
+    printf("  parse insitu     %10.2f  (less %.2f for the copy)\n", time_operation(document, op_parse_insitu, copy, rounds) - copy_time,
+           copy_time);
+    printf("  parse filtered   %10.2f\n", time_operation(document, op_parse_filtered, NULL, rounds));
+    printf("  validate         %10.2f\n", time_operation(document, op_validate, NULL, rounds));
+    printf("  event parse      %10.2f\n", time_operation(document, op_sax, NULL, rounds));
+    printf("  serialize        %10.2f\n", time_operation(document, op_serialize, root, rounds));
+    printf("  serialize buffer %10.2f\n", time_operation(document, op_serialize_buffer, root, rounds));
+    writing.root = root;
+    json_writer_init(&writing.writer);
+    printf("  writer           %10.2f\n", time_operation(document, op_writer, &writing, rounds));
+    json_writer_free(&writing.writer);
+
+    if (json_object_dotget_value(json_object(root), "desired.property7.value") != NULL) {
+        lookup.root = root;
+        lookup.compiled = json_path_compile("desired.property7.value");
+        printf("  dotget           %10.3f\n", time_operation(document, op_dotget, &lookup, rounds));
+        printf("  compiled path    %10.3f\n", time_operation(document, op_path, &lookup, rounds));
+        json_path_free(lookup.compiled);
+    }
+
+    free(copy);
+    json_value_free(root);
+}
+
+int main(int argc, char **argv)
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : 5;
+    Document documents[4];
+    size_t i;
+
+    if (rounds < 1) {
+        rounds = 1;
+    }
+    documents[0].name = "twin";
+    documents[0].text = make_twin(10, &documents[0].length);
+    documents[1].name = "large twin";
+    documents[1].text = make_twin(200, &documents[1].length);
+    documents[2].name = "telemetry";
+    documents[2].text = make_telemetry(100, &documents[2].length);
+    documents[3].name = "strings";
+    documents[3].text = make_strings(100, &documents[3].length);
+
+    printf("microseconds per document, best of %d rounds\n", rounds);
+    for (i = 0; i < sizeof(documents) / sizeof(documents[0]); i++) {
+        run_document(&documents[i], rounds);
+        json_free_serialized_string(documents[i].text);
+    }
+    return EXIT_SUCCESS;
+}
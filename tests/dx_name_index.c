@@ -0,0 +1,100 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+/* DX_NAME_INDEX, the hash index the twin and direct method bindings are looked up through */
+
+#include "dx_utilities.h"
+
+static int failures = 0;
+
+#define CHECK(condition, ...)                                                                      \
+    do {                                                                                           \
+        if (!(condition)) {                                                                        \
+            printf("FAIL line %d: ", __LINE__);                                                    \
+            printf(__VA_ARGS__);                                                                   \
+            printf("\n");                                                                          \
+            failures++;                                                                            \
+        }                                                                                          \
+    } while (0)
+
+#define NAME_COUNT 64
+
+static void check_add_and_find(void)
+{
+    static char names[NAME_COUNT][16];
+    static int values[NAME_COUNT];
+    DX_NAME_INDEX index;
+    char lookup[32];
+
+    CHECK(dx_nameIndexInit(&index, NAME_COUNT), "init for %d names", NAME_COUNT);
+    for (size_t i = 0; i < NAME_COUNT; i++) {
+        snprintf(names[i], sizeof(names[i]), "name%zu", i);
+        CHECK(dx_nameIndexAdd(&index, names[i], &values[i]), "add %s", names[i]);
+    }
+    CHECK(index.count == NAME_COUNT, "count %zu", index.count);
+
+    for (size_t i = 0; i < NAME_COUNT; i++) {
+        // lookups come from JSON text, so the name is followed by more of the document
+        snprintf(lookup, sizeof(lookup), "%s\":true}", names[i]);
+        CHECK(dx_nameIndexFind(&index, lookup, strlen(names[i])) == &values[i], "find %s", names[i]);
+    }
+
+    CHECK(dx_nameIndexFind(&index, "name64", 6) == NULL, "find a name never added");
+    CHECK(dx_nameIndexFind(&index, "name1", 4) == NULL, "find a prefix of a name");
+    CHECK(dx_nameIndexFind(&index, "", 0) == NULL, "find the empty name");
+    CHECK(!dx_nameIndexAdd(&index, "name7", NULL), "add a duplicate");
+    CHECK(dx_nameIndexFind(&index, "name7", 5) == &values[7], "duplicate left the first value");
+
+    dx_nameIndexFree(&index);
+    CHECK(index.entries == NULL && index.capacity == 0 && index.count == 0, "free resets the index");
+    CHECK(dx_nameIndexFind(&index, "name1", 5) == NULL, "find after free");
+    CHECK(!dx_nameIndexAdd(&index, "name1", NULL), "add after free");
+}
+
+// Names that land on the same slot are found by probing past each other, also across the end of the table
+static void check_collisions(void)
+{
+    static char names[4][16];
+    static int values[4];
+    DX_NAME_INDEX index;
+    size_t found = 0;
+
+    CHECK(dx_nameIndexInit(&index, 4), "init for 4 names");
+    CHECK(index.capacity == 8, "capacity %zu", index.capacity);
+
+    // four names hashing to the last slot
+    for (unsigned int i = 0; found < 4; i++) {
+        snprintf(names[found], sizeof(names[found]), "k%u", i);
+        if ((dx_nameHash(names[found], strlen(names[found])) & (index.capacity - 1)) == index.capacity - 1) {
+            found++;
+        }
+    }
+    for (size_t i = 0; i < 4; i++) {
+        CHECK(dx_nameIndexAdd(&index, names[i], &values[i]), "add %s", names[i]);
+    }
+    for (size_t i = 0; i < 4; i++) {
+        CHECK(dx_nameIndexFind(&index, names[i], strlen(names[i])) == &values[i], "find colliding %s", names[i]);
+    }
+    CHECK(!dx_nameIndexAdd(&index, "one more", NULL), "add past half the capacity");
+    CHECK(dx_nameIndexFind(&index, "one more", 8) == NULL, "find a name the full index refused");
+
+    dx_nameIndexFree(&index);
+}
+
+static void check_hash(void)
+{
+    // FNV-1a reference values
+    CHECK(dx_nameHash("", 0) == 2166136261u, "hash of the empty name");
+    CHECK(dx_nameHash("a", 1) == 0xe40c292cu, "hash of a");
+    CHECK(dx_nameHash("foobar", 6) == 0xbf9cf968u, "hash of foobar");
+}
+
+int main(void)
+{
+    check_add_and_find();
+    check_collisions();
+    check_hash();
+
+    printf("%s: %d failure(s)\n", failures == 0 ? "PASS" : "FAIL", failures);
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
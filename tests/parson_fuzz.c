@@ -0,0 +1,792 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+/* Differential fuzz of parson. Random documents are built through the API, serialized and read back
+   through every parse mode and the event parser, which must all give the document back. Mutated copies
+   of the text are checked against a small reference validator written from the JSON grammar, and the
+   parse modes must agree with each other on every mutation. Numbers are checked to read back to the
+   same bits.
+
+   parson_fuzz [iterations [seed]] */
+
+#include "parson.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_DEPTH 6
+#define REFERENCE_MAX_NESTING 2048
+#define SCRATCH_SIZE 4096
+
+static int failures = 0;
+static uint64_t rng_state = 0;
+
+#define CHECK(condition, ...)                                                                      \
+    do {                                                                                           \
+        if (!(condition)) {                                                                        \
+            if (failures++ < 20) {                                                                 \
+                printf("FAIL line %d: ", __LINE__);                                                \
+                printf(__VA_ARGS__);                                                               \
+                printf("\n");                                                                      \
+            }                                                                                      \
+        }                                                                                          \
+    } while (0)
+
+static uint64_t next_random(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static size_t random_below(size_t bound)
+{
+    return (size_t)(next_random() % bound);
+}
+
+/* Generator */
+
+/* Strings mix plain ASCII runs with characters that need escaping and multi byte UTF-8, at lengths
+   around the inline string limit and the 8 and 16 byte scanner strides */
+static void random_string(char *out, size_t max)
+{
+    static const char *pieces[] = {"\"", "\\", "/", "\n", "\t", "\x01", "\x1f", "\x7f", "\xc3\xa9", "\xe2\x82\xac", "\xf0\x9f\x98\x80", "."};
+    size_t length = random_below(max), used = 0;
+    while (used < length) {
+        if (random_below(6) == 0) {
+            const char *piece = pieces[random_below(sizeof(pieces) / sizeof(pieces[0]))];
+            size_t piece_length = strlen(piece);
+            if (used + piece_length > length) {
+                break;
+            }
+            memcpy(out + used, piece, piece_length);
+            used += piece_length;
+        } else {
+            out[used++] = (char)('a' + random_below(26));
+        }
+    }
+    out[used] = '\0';
+}
+
+static double random_number(void)
+{
+    uint64_t bits = 0;
+    double number = 0;
+    switch (random_below(5)) {
+    case 0:
+        return (double)(int64_t)(next_random() >> random_below(64));
+    case 1:
+        return (double)(int)random_below(2000) - 1000;
+    case 2:
+        return (double)(int)random_below(100000) / 1000.0;
+    case 3:
+        return (double)(int)random_below(1000) * pow(10, (double)(int)random_below(40) - 20);
+    default:
+        do {
+            bits = next_random();
+            memcpy(&number, &bits, sizeof(number));
+        } while (!isfinite(number) || (number != 0 && fabs(number) < 2.2250738585072014e-308));
+        return number;
+    }
+}
+
+static JSON_Value *random_value(int depth)
+{
+    char text[48];
+    JSON_Value *value = NULL;
+    size_t count = 0, i;
+    switch (random_below(depth < MAX_DEPTH ? 7 : 5)) {
+    case 0:
+        random_string(text, sizeof(text));
+        return json_value_init_string(text);
+    case 1:
+        return json_value_init_number(random_number());
+    case 2:
+        return json_value_init_boolean((int)random_below(2));
+    case 3:
+        return json_value_init_null();
+    case 4:
+        return json_value_init_string(random_below(2) ? "short" : "");
+    case 5:
+        value = json_value_init_array();
+        count = random_below(12);
+        for (i = 0; i < count; i++) {
+            json_array_append_value(json_array(value), random_value(depth + 1));
+        }
+        return value;
+    default:
+        value = json_value_init_object();
+        count = random_below(depth == 0 ? 20 : 12);
+        for (i = 0; i < count; i++) {
+            random_string(text, 16);
+            if (json_object_set_value(json_object(value), text, NULL) == JSONFailure) {
+                JSON_Value *member = random_value(depth + 1);
+                if (json_object_set_value(json_object(value), text, member) == JSONFailure) {
+                    json_value_free(member);
+                }
+            }
+        }
+        return value;
+    }
+}
+
+/* Reference validator, a direct transcription of the RFC 8259 grammar with parson's nesting limit */
+
+typedef struct {
+    const unsigned char *ptr;
+    const unsigned char *end;
+} Reference;
+
+static int reference_value(Reference *r, int depth);
+
+static void reference_whitespace(Reference *r)
+{
+    while (r->ptr < r->end && (*r->ptr == ' ' || *r->ptr == '\t' || *r->ptr == '\n' || *r->ptr == '\r')) {
+        r->ptr++;
+    }
+}
+
+static int reference_hex4(Reference *r, unsigned int *code)
+{
+    int i;
+    *code = 0;
+    if (r->end - r->ptr < 4) {
+        return 0;
+    }
+    for (i = 0; i < 4; i++) {
+        unsigned char c = *r->ptr++;
+        *code <<= 4;
+        if (c >= '0' && c <= '9') {
+            *code |= (unsigned int)(c - '0');
+        } else if (c >= 'a' && c <= 'f') {
+            *code |= (unsigned int)(c - 'a' + 10);
+        } else if (c >= 'A' && c <= 'F') {
+            *code |= (unsigned int)(c - 'A' + 10);
+        } else {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* One well formed UTF-8 sequence: no overlong forms, no surrogates, nothing past U+10FFFF */
+static int reference_utf8(Reference *r)
+{
+    unsigned char c = *r->ptr++;
+    unsigned char low = 0x80, high = 0xbf;
+    int continuation = 0;
+    if (c < 0x80) {
+        return 1;
+    } else if (c >= 0xc2 && c <= 0xdf) {
+        continuation = 1;
+    } else if (c >= 0xe0 && c <= 0xef) {
+        continuation = 2;
+        low = c == 0xe0 ? 0xa0 : 0x80;
+        high = c == 0xed ? 0x9f : 0xbf;
+    } else if (c >= 0xf0 && c <= 0xf4) {
+        continuation = 3;
+        low = c == 0xf0 ? 0x90 : 0x80;
+        high = c == 0xf4 ? 0x8f : 0xbf;
+    } else {
+        return 0;
+    }
+    while (continuation--) {
+        if (r->ptr == r->end || *r->ptr < low || *r->ptr > high) {
+            return 0;
+        }
+        r->ptr++;
+        low = 0x80;
+        high = 0xbf;
+    }
+    return 1;
+}
+
+static int reference_string(Reference *r)
+{
+    unsigned int code = 0, low = 0;
+    r->ptr++;
+    for (;;) {
+        if (r->ptr == r->end || *r->ptr < 0x20) {
+            return 0;
+        }
+        if (*r->ptr == '"') {
+            r->ptr++;
+            return 1;
+        }
+        if (*r->ptr != '\\') {
+            if (!reference_utf8(r)) {
+                return 0;
+            }
+            continue;
+        }
+        r->ptr++;
+        if (r->ptr == r->end) {
+            return 0;
+        }
+        switch (*r->ptr++) {
+        case '"':
+        case '\\':
+        case '/':
+        case 'b':
+        case 'f':
+        case 'n':
+        case 'r':
+        case 't':
+            break;
+        case 'u':
+            if (!reference_hex4(r, &code) || (code >= 0xdc00 && code <= 0xdfff)) {
+                return 0;
+            }
+            if (code >= 0xd800 && code <= 0xdbff) { /* a high surrogate needs its low half */
+                if (r->end - r->ptr < 2 || r->ptr[0] != '\\' || r->ptr[1] != 'u') {
+                    return 0;
+                }
+                r->ptr += 2;
+                if (!reference_hex4(r, &low) || low < 0xdc00 || low > 0xdfff) {
+                    return 0;
+                }
+            }
+            break;
+        default:
+            return 0;
+        }
+    }
+}
+
+static int reference_digits(Reference *r)
+{
+    const unsigned char *start = r->ptr;
+    while (r->ptr < r->end && *r->ptr >= '0' && *r->ptr <= '9') {
+        r->ptr++;
+    }
+    return r->ptr > start;
+}
+
+static int reference_number(Reference *r)
+{
+    if (*r->ptr == '-') {
+        r->ptr++;
+    }
+    if (r->ptr < r->end && *r->ptr == '0') {
+        r->ptr++;
+    } else if (!reference_digits(r)) {
+        return 0;
+    }
+    if (r->ptr < r->end && *r->ptr == '.') {
+        r->ptr++;
+        if (!reference_digits(r)) {
+            return 0;
+        }
+    }
+    if (r->ptr < r->end && (*r->ptr == 'e' || *r->ptr == 'E')) {
+        r->ptr++;
+        if (r->ptr < r->end && (*r->ptr == '+' || *r->ptr == '-')) {
+            r->ptr++;
+        }
+        if (!reference_digits(r)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int reference_literal(Reference *r, const char *literal)
+{
+    size_t length = strlen(literal);
+    if ((size_t)(r->end - r->ptr) < length || memcmp(r->ptr, literal, length) != 0) {
+        return 0;
+    }
+    r->ptr += length;
+    return 1;
+}
+
+static int reference_container(Reference *r, int depth, unsigned char close)
+{
+    if (depth >= REFERENCE_MAX_NESTING) {
+        return 0;
+    }
+    r->ptr++;
+    reference_whitespace(r);
+    if (r->ptr < r->end && *r->ptr == close) {
+        r->ptr++;
+        return 1;
+    }
+    for (;;) {
+        if (close == '}') {
+            if (r->ptr == r->end || *r->ptr != '"' || !reference_string(r)) {
+                return 0;
+            }
+            reference_whitespace(r);
+            if (r->ptr == r->end || *r->ptr++ != ':') {
+                return 0;
+            }
+        }
+        if (!reference_value(r, depth + 1)) {
+            return 0;
+        }
+        if (r->ptr == r->end) {
+            return 0;
+        }
+        if (*r->ptr == close) {
+            r->ptr++;
+            return 1;
+        }
+        if (*r->ptr++ != ',') {
+            return 0;
+        }
+        reference_whitespace(r);
+    }
+}
+
+/* Reads a value and the whitespace after it */
+static int reference_value(Reference *r, int depth)
+{
+    int ok = 0;
+    reference_whitespace(r);
+    if (r->ptr == r->end) {
+        return 0;
+    }
+    switch (*r->ptr) {
+    case '{':
+        ok = reference_container(r, depth, '}');
+        break;
+    case '[':
+        ok = reference_container(r, depth, ']');
+        break;
+    case '"':
+        ok = reference_string(r);
+        break;
+    case 't':
+        ok = reference_literal(r, "true");
+        break;
+    case 'f':
+        ok = reference_literal(r, "false");
+        break;
+    case 'n':
+        ok = reference_literal(r, "null");
+        break;
+    default:
+        ok = (*r->ptr == '-' || (*r->ptr >= '0' && *r->ptr <= '9')) && reference_number(r);
+        break;
+    }
+    reference_whitespace(r);
+    return ok;
+}
+
+static int reference_validate(const char *text, size_t length)
+{
+    Reference r;
+    r.ptr = (const unsigned char *)text;
+    r.end = r.ptr + length;
+    return reference_value(&r, 0) && r.ptr == r.end;
+}
+
+/* Event parser, rebuilds the document from its events */
+
+typedef struct {
+    JSON_Value *stack[REFERENCE_MAX_NESTING + 1];
+    size_t depth;
+    JSON_Value *root;
+    char *key;
+    int unrepresentable; /* a name or string holds a null character, which a tree can't keep */
+} Rebuild;
+
+static JSON_Status rebuild_put(Rebuild *b, JSON_Value *value)
+{
+    JSON_Value *top = NULL;
+    JSON_Status status = JSONFailure;
+    if (value == NULL) {
+        return JSONFailure;
+    }
+    if (b->depth == 0) {
+        b->root = value;
+        return JSONSuccess;
+    }
+    top = b->stack[b->depth - 1];
+    if (json_value_get_type(top) == JSONArray) {
+        status = json_array_append_value(json_array(top), value);
+    } else if (b->key != NULL && !json_object_has_value(json_object(top), b->key)) { /* the tree rejects duplicates */
+        status = json_object_set_value(json_object(top), b->key, value);
+    }
+    free(b->key);
+    b->key = NULL;
+    if (status == JSONFailure) {
+        json_value_free(value);
+    }
+    return status;
+}
+
+static JSON_Status rebuild_begin(Rebuild *b, JSON_Value *container)
+{
+    if (rebuild_put(b, container) == JSONFailure) {
+        return JSONFailure;
+    }
+    b->stack[b->depth++] = container;
+    return JSONSuccess;
+}
+
+static JSON_Status on_begin_object(void *context)
+{
+    return rebuild_begin((Rebuild *)context, json_value_init_object());
+}
+
+static JSON_Status on_begin_array(void *context)
+{
+    return rebuild_begin((Rebuild *)context, json_value_init_array());
+}
+
+static JSON_Status on_end(void *context)
+{
+    ((Rebuild *)context)->depth--;
+    return JSONSuccess;
+}
+
+static char *copy_text(Rebuild *b, const char *text, size_t length)
+{
+    char *copy = (char *)malloc(length + 1);
+    if (copy == NULL) {
+        return NULL;
+    }
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    if (strlen(copy) != length) {
+        b->unrepresentable = 1;
+        free(copy);
+        return NULL;
+    }
+    return copy;
+}
+
+static JSON_Status on_key(const char *name, size_t name_len, void *context)
+{
+    Rebuild *b = (Rebuild *)context;
+    b->key = copy_text(b, name, name_len);
+    return b->key != NULL ? JSONSuccess : JSONFailure;
+}
+
+static JSON_Status on_string(const char *string, size_t string_len, void *context)
+{
+    Rebuild *b = (Rebuild *)context;
+    char *copy = copy_text(b, string, string_len);
+    JSON_Status status = JSONFailure;
+    if (copy != NULL) {
+        status = rebuild_put(b, json_value_init_string(copy));
+        free(copy);
+    }
+    return status;
+}
+
+static JSON_Status on_number(double number, void *context)
+{
+    return rebuild_put((Rebuild *)context, json_value_init_number(number));
+}
+
+static JSON_Status on_boolean(int boolean, void *context)
+{
+    return rebuild_put((Rebuild *)context, json_value_init_boolean(boolean));
+}
+
+static JSON_Status on_null(void *context)
+{
+    return rebuild_put((Rebuild *)context, json_value_init_null());
+}
+
+static const JSON_Sax_Handler rebuild_handler = {on_begin_object, on_end,     on_begin_array, on_end, on_key,
+                                                 on_string,       on_number,  on_boolean,     on_null};
+
+/* Returns the rebuilt document, or NULL when the event parse fails */
+static JSON_Value *sax_rebuild(const char *text, size_t length, int *unrepresentable)
+{
+    static Rebuild b;
+    static char scratch[SCRATCH_SIZE];
+    JSON_Status status;
+    memset(&b, 0, sizeof(b));
+    status = json_sax_parse(text, length, &rebuild_handler, &b, scratch, sizeof(scratch));
+    free(b.key);
+    *unrepresentable = b.unrepresentable;
+    if (status == JSONFailure) {
+        json_value_free(b.root);
+        return NULL;
+    }
+    return b.root;
+}
+
+/* Writes value with the streaming writer's calls, as an application building telemetry would */
+static void write_value(JSON_Writer *writer, const JSON_Value *value)
+{
+    size_t i;
+    switch (json_value_get_type(value)) {
+    case JSONObject:
+        json_writer_begin_object(writer);
+        for (i = 0; i < json_object_get_count(json_object(value)); i++) {
+            json_writer_key(writer, json_object_get_name(json_object(value), i));
+            write_value(writer, json_object_get_value_at(json_object(value), i));
+        }
+        json_writer_end_object(writer);
+        break;
+    case JSONArray:
+        json_writer_begin_array(writer);
+        for (i = 0; i < json_array_get_count(json_array(value)); i++) {
+            write_value(writer, json_array_get_value(json_array(value), i));
+        }
+        json_writer_end_array(writer);
+        break;
+    case JSONString:
+        json_writer_string(writer, json_value_get_string(value));
+        break;
+    case JSONNumber:
+        json_writer_number(writer, json_value_get_number(value));
+        break;
+    case JSONBoolean:
+        json_writer_boolean(writer, json_value_get_boolean(value));
+        break;
+    default:
+        json_writer_null(writer);
+        break;
+    }
+}
+
+static int descend_all(const char *name, size_t name_len, size_t depth, void *context)
+{
+    (void)name;
+    (void)name_len;
+    (void)depth;
+    (void)context;
+    return JSONFilterDescend;
+}
+
+/* Every tree parse mode must give the same answer for the same bytes */
+static JSON_Value *parse_all_modes(const char *text, size_t length)
+{
+    char *terminated = (char *)malloc(length + 1), *insitu_text = (char *)malloc(length + 1);
+    JSON_Value *parsed[5];
+    size_t i;
+
+    memcpy(terminated, text, length);
+    terminated[length] = '\0';
+    memcpy(insitu_text, terminated, length + 1);
+    parsed[0] = json_parse_buffer(text, length);
+    parsed[1] = json_parse_string(terminated);
+    parsed[2] = json_parse_buffer_arena(text, length);
+    parsed[3] = json_parse_string_insitu(insitu_text);
+    parsed[4] = json_parse_buffer_filtered(text, length, descend_all, NULL);
+
+    for (i = 1; i < sizeof(parsed) / sizeof(parsed[0]); i++) {
+        CHECK((parsed[0] == NULL) == (parsed[i] == NULL), "parse mode %zu %s %.*s", i, parsed[i] ? "accepted" : "rejected",
+              (int)length, text);
+        CHECK(parsed[0] == NULL || parsed[i] == NULL || json_value_equals(parsed[0], parsed[i]), "parse mode %zu differs on %.*s",
+              i, (int)length, text);
+        json_value_free(parsed[i]);
+    }
+    free(insitu_text);
+    free(terminated);
+    return parsed[0];
+}
+
+static void check_generated(const JSON_Value *value)
+{
+    char *compact = json_serialize_to_string(value);
+    char *pretty = json_serialize_to_string_pretty(value);
+    size_t length = strlen(compact), pretty_length = strlen(pretty);
+    JSON_Value *parsed = parse_all_modes(compact, length);
+    JSON_Value *parsed_pretty = json_parse_buffer(pretty, pretty_length);
+    JSON_Value *rebuilt = NULL;
+    JSON_Writer writer;
+    const char *written = NULL;
+    size_t cap = random_below(length + 2);
+    char *buf = (char *)malloc(cap + 1);
+    int unrepresentable = 0, measured = 0;
+
+    CHECK(parsed != NULL && json_value_equals(value, parsed), "round trip of %s", compact);
+    CHECK(parsed_pretty != NULL && json_value_equals(value, parsed_pretty), "pretty round trip of %s", compact);
+    CHECK(json_validate_syntax(compact, length) == JSONSuccess && reference_validate(compact, length), "validate %s", compact);
+    CHECK(json_validate_syntax(pretty, pretty_length) == JSONSuccess, "validate pretty %s", pretty);
+    CHECK(json_serialization_size(value) == length + 1, "size of %s", compact);
+
+    rebuilt = sax_rebuild(compact, length, &unrepresentable);
+    CHECK(rebuilt != NULL && json_value_equals(value, rebuilt), "event parse of %s", compact);
+
+    /* snprintf semantics: the whole length is returned, the output is a terminated prefix */
+    memset(buf, '#', cap + 1);
+    measured = json_serialize_to_buffer_n(value, cap ? buf : NULL, cap);
+    CHECK(measured == (int)length, "measured %d for %s", measured, compact);
+    CHECK(cap == 0 || (strlen(buf) == (cap - 1 < length ? cap - 1 : length) && strncmp(buf, compact, strlen(buf)) == 0),
+          "prefix in %zu bytes of %s", cap, compact);
+    CHECK(buf[cap] == '#', "serialize_to_buffer_n wrote past %zu bytes", cap);
+
+    json_writer_init(&writer);
+    write_value(&writer, value);
+    written = json_writer_get_string(&writer, NULL);
+    CHECK(written != NULL && strcmp(written, compact) == 0, "writer gave %s for %s", written, compact);
+    json_writer_reset(&writer);
+    json_writer_value(&writer, value);
+    written = json_writer_get_string(&writer, NULL);
+    CHECK(written != NULL && strcmp(written, compact) == 0, "json_writer_value gave %s for %s", written, compact);
+    json_writer_free(&writer);
+
+    free(buf);
+    json_value_free(rebuilt);
+    json_value_free(parsed_pretty);
+    json_value_free(parsed);
+    json_free_serialized_string(pretty);
+    json_free_serialized_string(compact);
+}
+
+static void check_mutated(const char *text, size_t length)
+{
+    static const char alphabet[] = "{}[]\":,0123456789-+.eEtrufalsnx \t\r\n\\/bu\x01\x1f\xc3\xa9\xff\xed\xa0\x80";
+    /* edge cases single bytes rarely reach: surrogate escapes, overlong and surrogate UTF-8, a byte order
+       mark, numbers at the edges of the grammar and of a double */
+    static const char *tokens[] = {"\\ud800", "\\udc00", "\\udbff\\udfff", "\\ud83d\\ude00", "\\u0000", "\\uD800\\u0041",
+                                   "\xc0\xaf", "\xe0\x80\xaf", "\xed\xa0\x80", "\xf4\x90\x80\x80", "\xef\xbb\xbf", "\x7f",
+                                   "1e400", "-0", "0x1", "1.5e+3", "01", "1e", "true", "null", "[", "{\"k\":"};
+    const char *token = NULL;
+    char *mutated = (char *)malloc(length + 16 * 4);
+    size_t mutated_length = length, edits = 1 + random_below(4), i, at;
+    JSON_Value *parsed = NULL, *rebuilt = NULL;
+    int valid = 0, unrepresentable = 0;
+
+    memcpy(mutated, text, length);
+    for (i = 0; i < edits; i++) {
+        at = random_below(mutated_length + 1);
+        switch (random_below(4)) {
+        case 0:
+            if (at < mutated_length) {
+                memmove(mutated + at, mutated + at + 1, mutated_length - at - 1);
+                mutated_length--;
+            }
+            break;
+        case 1:
+            memmove(mutated + at + 1, mutated + at, mutated_length - at);
+            mutated[at] = alphabet[random_below(sizeof(alphabet) - 1)];
+            mutated_length++;
+            break;
+        case 2:
+            token = tokens[random_below(sizeof(tokens) / sizeof(tokens[0]))];
+            memmove(mutated + at + strlen(token), mutated + at, mutated_length - at);
+            memcpy(mutated + at, token, strlen(token));
+            mutated_length += strlen(token);
+            break;
+        default:
+            if (at < mutated_length) {
+                mutated[at] = alphabet[random_below(sizeof(alphabet) - 1)];
+            }
+            break;
+        }
+    }
+
+    valid = reference_validate(mutated, mutated_length);
+    CHECK((json_validate_syntax(mutated, mutated_length) == JSONSuccess) == valid, "validator %s %.*s",
+          valid ? "rejected" : "accepted", (int)mutated_length, mutated);
+
+    parsed = parse_all_modes(mutated, mutated_length);
+    rebuilt = sax_rebuild(mutated, mutated_length, &unrepresentable);
+    /* On valid text the tree and the events agree. Both refuse duplicate names and numbers a double
+       can't hold, which the grammar allows. The tree parser is more lenient on invalid text. */
+    if (valid && !unrepresentable) {
+        CHECK((parsed == NULL) == (rebuilt == NULL), "tree %s, events %s %.*s", parsed ? "accepted" : "rejected",
+              rebuilt ? "accepted" : "rejected", (int)mutated_length, mutated);
+    }
+    if (parsed != NULL && rebuilt != NULL) {
+        CHECK(json_value_equals(parsed, rebuilt), "tree and events differ on %.*s", (int)mutated_length, mutated);
+    }
+    if (parsed != NULL && valid) {
+        check_generated(parsed);
+    } else if (parsed != NULL) { /* the tree parser accepts some invalid UTF-8, it must still read back */
+        char *serialized = json_serialize_to_string(parsed);
+        JSON_Value *reparsed = json_parse_string(serialized);
+        CHECK(reparsed != NULL && json_value_equals(parsed, reparsed), "round trip of lenient %.*s", (int)mutated_length,
+              mutated);
+        json_value_free(reparsed);
+        json_free_serialized_string(serialized);
+    }
+
+    json_value_free(rebuilt);
+    json_value_free(parsed);
+    free(mutated);
+}
+
+static void check_number_text(void)
+{
+    char buf[JSON_NUMBER_BUF_SIZE];
+    double number = random_number(), read_back = 0;
+    float single = 0, single_back = 0;
+    uint32_t bits = 0;
+    int length = json_format_number(number, buf);
+
+    read_back = strtod(buf, NULL);
+    CHECK(length == (int)strlen(buf) && memcmp(&number, &read_back, sizeof(number)) == 0, "%.17g formatted as %s", number, buf);
+
+    do {
+        bits = (uint32_t)next_random();
+        memcpy(&single, &bits, sizeof(single));
+    } while (!isfinite(single));
+    length = json_format_float(single, buf);
+    single_back = strtof(buf, NULL);
+    CHECK(length == (int)strlen(buf) && memcmp(&single, &single_back, sizeof(single)) == 0, "%.9g formatted as %s",
+          (double)single, buf);
+}
+
+/* Compiled paths must find what dotget finds, for names without dots */
+static void check_paths(const JSON_Value *value)
+{
+    char path[256] = "";
+    const JSON_Value *current = value;
+    JSON_Path *compiled = NULL;
+    size_t used = 0;
+
+    while (json_value_get_type(current) == JSONObject && json_object_get_count(json_object(current)) > 0) {
+        const JSON_Object *object = json_object(current);
+        size_t index = random_below(json_object_get_count(object));
+        const char *name = json_object_get_name(object, index);
+        if (strchr(name, '.') != NULL || used + strlen(name) + 2 > sizeof(path)) {
+            break;
+        }
+        used += (size_t)sprintf(path + used, "%s%s", used ? "." : "", name);
+        current = json_object_get_value_at(object, index);
+    }
+    compiled = json_path_compile(path);
+    CHECK(compiled != NULL && json_path_get_value(value, compiled) == json_object_dotget_value(json_object(value), path),
+          "compiled path %s", path);
+    json_path_free(compiled);
+}
+
+int main(int argc, char **argv)
+{
+    long iterations = argc > 1 ? strtol(argv[1], NULL, 10) : 2000;
+    long i;
+    static char deep[2 * (REFERENCE_MAX_NESTING + 1)];
+
+    rng_state = argc > 2 ? strtoull(argv[2], NULL, 10) : 0x2545f4914f6cdd1dULL;
+    if (rng_state == 0) {
+        rng_state = 1;
+    }
+
+    for (i = 0; i < iterations; i++) {
+        JSON_Value *value = random_value(0);
+        char *compact = json_serialize_to_string(value);
+        check_generated(value);
+        check_mutated(compact, strlen(compact));
+        check_number_text();
+        if (json_value_get_type(value) == JSONObject) {
+            check_paths(value);
+        }
+        json_free_serialized_string(compact);
+        json_value_free(value);
+    }
+
+    /* the nesting limit, on the edge */
+    memset(deep, '[', REFERENCE_MAX_NESTING);
+    memset(deep + REFERENCE_MAX_NESTING, ']', REFERENCE_MAX_NESTING);
+    CHECK(json_validate_syntax(deep, 2 * REFERENCE_MAX_NESTING) == JSONSuccess, "nesting of %d", REFERENCE_MAX_NESTING);
+    memset(deep, '[', REFERENCE_MAX_NESTING + 1);
+    memset(deep + REFERENCE_MAX_NESTING + 1, ']', REFERENCE_MAX_NESTING + 1);
+    CHECK(json_validate_syntax(deep, sizeof(deep)) == JSONFailure, "nesting of %d", REFERENCE_MAX_NESTING + 1);
+
+    printf("%s: %ld iterations, %d failure(s)\n", failures == 0 ? "PASS" : "FAIL", iterations, failures);
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,289 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+/* Parse and serialize round trips through every parse mode of parson, plus the inputs each mode must
+   reject. Documents are given in serialized form, so parsing and serializing one gives it back. */
+
+#include "parson.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int failures = 0;
+
+#define CHECK(condition, ...)                                                                      \
+    do {                                                                                           \
+        if (!(condition)) {                                                                        \
+            printf("FAIL line %d: ", __LINE__);                                                    \
+            printf(__VA_ARGS__);                                                                   \
+            printf("\n");                                                                          \
+            failures++;                                                                            \
+        }                                                                                          \
+    } while (0)
+
+static const char *documents[] = {
+    "null",
+    "true",
+    "\"text\"",
+    "-12.5",
+    "[]",
+    "{}",
+    "[1,2,3,\"abcdef\",\"abcdefg\",true,false,null]",
+    "{\"a\":1,\"b\":[1,2,{\"c\":\"x\\u0001y\"}],\"d\":{\"e\":null,\"f\":true}}",
+    "{\"escapes\":\"\\\"\\\\\\/\\b\\f\\n\\r\\t\\u001f\",\"utf8\":\"\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80\"}",
+    "[[[[[]]]],{\"x\":{\"y\":{}}}]",
+    "{\"desired\":{\"temperature\":21.5,\"led\":true,\"name\":\"dev1\",\"$version\":42},"
+    "\"reported\":{\"uptime\":123456789,\"firmware\":\"1.0.3\",\"$version\":7}}",
+    "[0.1,0.2,0.30000000000000004,1e+21,1e-7,2.2250738585072014e-308,1.7976931348623157e+308,-0,9007199254740992]",
+};
+
+/* Inputs no parse mode accepts */
+static const char *rejected[] = {
+    "", "[1,]", "{\"a\":1,}", "{\"a\" 1}", "[1 2]", "\"abc", "tru", "nul", "01", "-01", ".5", "[1e]", "[-]", "[.5]",
+    "0x1", "-0x5", "0X10", "1abc", "1e5x", "[0x10]", "1e400", "[\"\\u12\"]", "[\"\\ud800\"]", "[\"\\x\"]",
+    "{\"a\":1,\"a\":2}", "[\"tab\there\"]",
+};
+
+/* Number text and the text it is serialized as */
+static const char *numbers[][2] = {
+    {"0", "0"},
+    {"-0", "-0"},
+    {"0.1", "0.1"},
+    {"1.5e3", "1500"},
+    {"123456789012345678", "123456789012345680"},
+    {"9007199254740992", "9007199254740992"},
+    {"1e21", "1e+21"},
+    {"0.000001", "0.000001"},
+    {"0.0000001", "1e-7"},
+    {"2.5E-3", "0.0025"},
+    {"2.2250738585072014e-308", "2.2250738585072014e-308"},
+    {"1.7976931348623157e308", "1.7976931348623157e+308"},
+    {"-23.45", "-23.45"},
+};
+
+/* Keeps every member, so a filtered parse must match a plain one */
+static int keep_all(const char *name, size_t name_len, size_t depth, void *context)
+{
+    (void)name;
+    (void)name_len;
+    (void)depth;
+    (void)context;
+    return JSONFilterDescend;
+}
+
+/* Keeps desired.temperature and desired.$version of a twin document, as the device twin module does */
+static int twin_filter(const char *name, size_t name_len, size_t depth, void *context)
+{
+    (void)context;
+    if (depth == 0) {
+        return name_len == 7 && strncmp(name, "desired", 7) == 0 ? JSONFilterDescend : JSONFilterSkip;
+    }
+    if ((name_len == 11 && strncmp(name, "temperature", 11) == 0) || (name_len == 8 && strncmp(name, "$version", 8) == 0)) {
+        return JSONFilterKeep;
+    }
+    return JSONFilterSkip;
+}
+
+static void check_serialized(const JSON_Value *value, const char *expected)
+{
+    char *serialized = json_serialize_to_string(value);
+    char *pretty = json_serialize_to_string_pretty(value);
+    JSON_Value *reparsed = pretty != NULL ? json_parse_string(pretty) : NULL;
+    size_t length = strlen(expected);
+    char *buf = (char *)malloc(length + 1);
+    JSON_Writer writer;
+    const char *written = NULL;
+
+    CHECK(serialized != NULL && strcmp(serialized, expected) == 0, "serialized %s, expected %s", serialized, expected);
+    CHECK(json_serialization_size(value) == length + 1, "size of %s", expected);
+    CHECK(json_serialize_to_buffer_n(value, NULL, 0) == (int)length, "measured length of %s", expected);
+    CHECK(json_serialize_to_buffer(value, buf, length + 1) == JSONSuccess && strcmp(buf, expected) == 0,
+          "exact buffer for %s", expected);
+    CHECK(length == 0 || json_serialize_to_buffer(value, buf, length) == JSONFailure, "short buffer for %s", expected);
+    CHECK(reparsed != NULL && json_value_equals(value, reparsed), "pretty round trip of %s", expected);
+
+    json_writer_init(&writer);
+    json_writer_value(&writer, value);
+    written = json_writer_get_string(&writer, NULL);
+    CHECK(written != NULL && strcmp(written, expected) == 0, "writer gave %s, expected %s", written, expected);
+    json_writer_free(&writer);
+
+    json_value_free(reparsed);
+    json_free_serialized_string(pretty);
+    json_free_serialized_string(serialized);
+    free(buf);
+}
+
+static void check_document(const char *document)
+{
+    size_t length = strlen(document);
+    char *insitu_text = (char *)malloc(length + 1);
+    JSON_Value *parsed[6];
+    const char *modes[] = {"string", "buffer", "arena", "buffer arena", "in situ", "filtered"};
+    size_t i;
+
+    memcpy(insitu_text, document, length + 1);
+    parsed[0] = json_parse_string(document);
+    parsed[1] = json_parse_buffer(document, length);
+    parsed[2] = json_parse_string_arena(document);
+    parsed[3] = json_parse_buffer_arena(document, length);
+    parsed[4] = json_parse_string_insitu(insitu_text);
+    parsed[5] = json_parse_string_filtered(document, keep_all, NULL);
+
+    CHECK(json_validate_syntax(document, length) == JSONSuccess, "validate %s", document);
+    for (i = 0; i < sizeof(parsed) / sizeof(parsed[0]); i++) {
+        CHECK(parsed[i] != NULL, "%s parse of %s", modes[i], document);
+        if (parsed[i] != NULL) {
+            CHECK(parsed[0] == NULL || json_value_equals(parsed[0], parsed[i]), "%s parse of %s differs", modes[i], document);
+            check_serialized(parsed[i], document);
+        }
+    }
+
+    for (i = 0; i < sizeof(parsed) / sizeof(parsed[0]); i++) {
+        json_value_free(parsed[i]);
+    }
+    free(insitu_text);
+}
+
+static void check_rejected(const char *text)
+{
+    size_t length = strlen(text);
+    char *insitu_text = (char *)malloc(length + 1);
+    JSON_Value *parsed[5];
+    size_t i;
+
+    memcpy(insitu_text, text, length + 1);
+    parsed[0] = json_parse_string(text);
+    parsed[1] = json_parse_buffer(text, length);
+    parsed[2] = json_parse_buffer_arena(text, length);
+    parsed[3] = json_parse_string_insitu(insitu_text);
+    parsed[4] = json_parse_string_filtered(text, keep_all, NULL);
+
+    for (i = 0; i < sizeof(parsed) / sizeof(parsed[0]); i++) {
+        CHECK(parsed[i] == NULL, "parse mode %zu accepted %s", i, text);
+        json_value_free(parsed[i]);
+    }
+    /* the validator accepts duplicate names and numbers too large for a double */
+    if (strcmp(text, "{\"a\":1,\"a\":2}") != 0 && strcmp(text, "1e400") != 0) {
+        CHECK(json_validate_syntax(text, length) == JSONFailure, "validator accepted %s", text);
+    }
+    free(insitu_text);
+}
+
+static void check_numbers(void)
+{
+    char buf[JSON_NUMBER_BUF_SIZE];
+    JSON_Writer writer;
+    const char *written = NULL;
+    size_t i;
+
+    for (i = 0; i < sizeof(numbers) / sizeof(numbers[0]); i++) {
+        JSON_Value *value = json_parse_string(numbers[i][0]);
+        CHECK(value != NULL, "parse of %s", numbers[i][0]);
+        if (value != NULL) {
+            check_serialized(value, numbers[i][1]);
+            CHECK(json_format_number(json_value_get_number(value), buf) == (int)strlen(numbers[i][1]) &&
+                      strcmp(buf, numbers[i][1]) == 0,
+                  "json_format_number of %s", numbers[i][0]);
+        }
+        json_value_free(value);
+    }
+
+    CHECK(json_format_float(0.1f, buf) == 3 && strcmp(buf, "0.1") == 0, "json_format_float 0.1f gave %s", buf);
+    CHECK(json_format_float(23.45f, buf) > 0 && strcmp(buf, "23.45") == 0, "json_format_float 23.45f gave %s", buf);
+    CHECK(json_format_float(16777216.0f, buf) > 0 && strcmp(buf, "16777216") == 0, "json_format_float 2^24 gave %s", buf);
+    CHECK(json_format_number(0.0 / 0.0, buf) == -1, "json_format_number NaN");
+
+    json_writer_init(&writer);
+    json_writer_begin_array(&writer);
+    json_writer_float(&writer, 0.1f);
+    json_writer_number(&writer, 0.1f);
+    json_writer_end_array(&writer);
+    written = json_writer_get_string(&writer, NULL);
+    CHECK(written != NULL && strcmp(written, "[0.1,0.10000000149011612]") == 0, "float writer gave %s", written);
+    json_writer_free(&writer);
+}
+
+static void check_filtered_twin(void)
+{
+    const char *twin = "{\"desired\":{\"temperature\":21.5,\"led\":true,\"$metadata\":{\"$lastUpdated\":\"x\"},\"$version\":42},"
+                       "\"reported\":{\"temperature\":20,\"$version\":7}}";
+    JSON_Value *value = json_parse_string_filtered(twin, twin_filter, NULL);
+    CHECK(value != NULL, "filtered twin parse");
+    if (value != NULL) {
+        check_serialized(value, "{\"desired\":{\"temperature\":21.5,\"$version\":42}}");
+    }
+    json_value_free(value);
+}
+
+/* A writer on a caller's buffer fails once the output no longer fits and keeps the part written */
+static void check_fixed_writer(void)
+{
+    const char *expected = "{\"name\":\"x\\\"y\",\"list\":[1.5,false,null]}";
+    size_t length = strlen(expected), size;
+    char buf[64];
+
+    for (size = 1; size <= length + 1; size++) {
+        JSON_Writer writer;
+        const char *written = NULL;
+        json_writer_init_buffer(&writer, buf, size);
+        json_writer_begin_object(&writer);
+        json_writer_key(&writer, "name");
+        json_writer_string(&writer, "x\"y");
+        json_writer_key(&writer, "list");
+        json_writer_begin_array(&writer);
+        json_writer_number(&writer, 1.5);
+        json_writer_boolean(&writer, 0);
+        json_writer_null(&writer);
+        json_writer_end_array(&writer);
+        json_writer_end_object(&writer);
+        written = json_writer_get_string(&writer, NULL);
+        if (size > length) {
+            CHECK(written == buf && strcmp(buf, expected) == 0, "writer in %zu bytes", size);
+        } else {
+            CHECK(written == NULL && strlen(buf) < size && strncmp(buf, expected, strlen(buf)) == 0,
+                  "truncated writer in %zu bytes", size);
+        }
+        json_writer_free(&writer);
+    }
+}
+
+static void check_paths(void)
+{
+    const char *document = "{\"d\":{\"ec\":0,\"meta\":{\"dtg\":\"g\",\"a.b\":1},\"arr\":[10,{\"k\":\"v\"}]}}";
+    const char *paths[] = {"d", "d.ec", "d.meta.dtg", "d.meta.a.b", "d.arr", "d.nope", "", "d..ec"};
+    JSON_Value *value = json_parse_string(document);
+    JSON_Path *path = NULL;
+    size_t i;
+
+    for (i = 0; i < sizeof(paths) / sizeof(paths[0]); i++) {
+        path = json_path_compile(paths[i]);
+        CHECK(path != NULL && json_path_get_value(value, path) == json_object_dotget_value(json_object(value), paths[i]),
+              "compiled path %s", paths[i]);
+        json_path_free(path);
+    }
+    path = json_path_compile_pointer("/d/arr/1/k");
+    CHECK(path != NULL && strcmp(json_path_get_string(value, path), "v") == 0, "pointer /d/arr/1/k");
+    json_path_free(path);
+    json_value_free(value);
+}
+
+int main(void)
+{
+    size_t i;
+
+    for (i = 0; i < sizeof(documents) / sizeof(documents[0]); i++) {
+        check_document(documents[i]);
+    }
+    for (i = 0; i < sizeof(rejected) / sizeof(rejected[0]); i++) {
+        check_rejected(rejected[i]);
+    }
+    check_numbers();
+    check_filtered_twin();
+    check_fixed_writer();
+    check_paths();
+
+    printf("%s: %d failure(s)\n", failures == 0 ? "PASS" : "FAIL", failures);
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,10 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+/* Host stand in for the Azure Sphere SDK header, declares only what the host tests build against */
+
+#pragma once
+
+#include <stdbool.h>
+
+int Application_IsDeviceAuthReady(bool *isReady);
@@ -0,0 +1,10 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+/* Host stand in for the Azure Sphere SDK header, Log_Debug writes to stdout */
+
+#pragma once
+
+#include <stdarg.h>
+
+int Log_Debug(const char *fmt, ...);
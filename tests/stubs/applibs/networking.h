@@ -0,0 +1,20 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+/* Host stand in for the Azure Sphere SDK header, declares only what the host tests build against */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef uint32_t Networking_InterfaceConnectionStatus;
+
+#define Networking_InterfaceConnectionStatus_InterfaceUp 0x1
+#define Networking_InterfaceConnectionStatus_ConnectedToNetwork 0x2
+#define Networking_InterfaceConnectionStatus_IpAvailable 0x4
+#define Networking_InterfaceConnectionStatus_ConnectedToInternet 0x8
+
+int Networking_IsNetworkingReady(bool *outIsNetworkingReady);
+int Networking_GetInterfaceConnectionStatus(const char *networkInterfaceName,
+                                            Networking_InterfaceConnectionStatus *outStatus);